@@ -8,140 +8,1969 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <unistd.h>
+#include <getopt.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "yuv_convert.h"
+#include "yuv_pool.h"
+#include "yuv_chunk.h"
+#include "yuv_trace.h"
+#include "yuv_shm.h"
+#include "yuv_metrics.h"
+#include "yuv_scope.h"
+#include "yuv_cache.h"
+
+/* How compare mode puts the two streams on screen */
+enum compare_view {
+    VIEW_SIDE_BY_SIDE,
+    VIEW_WIPE,          /* a left of the split, b right of it */
+    VIEW_DIFFERENCE,    /* |a - b| per channel, amplified */
+    VIEW_COUNT
+};
+
+static const char *view_names[VIEW_COUNT] = {
+    "side by side", "wipe", "difference",
+};
+
+#define MAX_DIFF_SHIFT 4    /* difference gain up to 16x */
 
 struct viewer_cfg {
     unsigned int width;
     unsigned int height;
-    unsigned int size;
-    gint channel;
-    FILE *fp;
+    gint threads;
+    gint thumb_threads; /* filmstrip workers, 0 hides the strip */
+    gint ring_depth;
+    gboolean check_crc;
+    gboolean stats;     /* stage timings drawn over the video */
+    gboolean benchmark; /* show every frame as soon as it is ready */
+    gboolean live;      /* chunks arrive on a pipe or socket, no index */
+    struct yuv_shm *shm;    /* or in a shared ring, read by the producer */
+    gdouble fps;        /* 0 plays by the stream timestamps */
+    const struct yuv_coefs *coefs;
+    struct yuv_pool *pool;
+    int fd;             /* read with pread at index offsets only */
+    char *fn;
+    struct yuv_index index;
+    char *cmp_fn;       /* compare mode: played in lockstep with fn */
+    int cmp_fd;
+    struct yuv_index cmp_index;
+    enum compare_view view;
+    gdouble wipe;       /* split of the wipe view, 0..1 of the width */
+    gint diff_shift;    /* the difference is multiplied by 1 << diff_shift */
+    cairo_surface_t *diff_rgb;  /* main thread, the difference view */
+    struct yuv_scopes *scopes;  /* producer only, NULL without -V */
+    gint scope_step;    /* every step-th sample and row goes in the scopes */
+    gint scopes_shown;  /* atomic, the producer skips them while hidden */
+    struct yuv_cache *cache;    /* producer only, NULL when off or live */
+    GtkWidget *window;
+    GtkWidget *draw_area;
+    GtkWidget *scope_area;
+    GtkWidget *timeline;
+    gulong timeline_handler;
+};
+
+enum slot_state {
+    SLOT_FREE,
+    SLOT_READY,     /* read and converted, waiting to be shown */
+    SLOT_SHOWN,     /* owned by the main thread until the next swap */
+};
+
+struct ring_slot {
+    enum slot_state state;
+    gint frame;
+    guint64 timestamp_us;
+    gint64 pts;         /* presentation time on the playback clock */
+    gint64 read_us;     /* when the producer started on it, or when it
+                           arrived live, 0 once shown */
+    enum yuv_format format;
+    unsigned int width;
+    unsigned int height;
+    size_t size;        /* of buf, at least the payload */
     guchar *buf;
+    const guchar *src;  /* payload to convert: buf, or a shared ring slot */
+    /* RGB24 image the converter writes and cairo paints, kept per size */
+    cairo_surface_t *rgb;
+    /* Compare mode: the same frame of cmp_fn, if its layout matches */
+    gboolean compared;
+    guchar *cmp_buf;
+    size_t cmp_size;
+    cairo_surface_t *cmp_rgb;
+    struct yuv_metrics metrics;
+    /* Scopes of src, rendered for the panel next to the picture */
+    gboolean scoped;
+    cairo_surface_t *scope_rgb;
+};
+
+/*
+ * Frames read and converted ahead by the producer thread. Slots are
+ * filled at head and shown from tail in the same order; the slot on
+ * screen is SHOWN so the producer leaves it alone.
+ */
+struct frame_ring {
+    struct ring_slot *slots;
+    gint depth;
+    gint head;
+    gint tail;
+    gint shown;
+    gint ready;
+    gint seek;          /* frame requested by the main thread, or -1 */
+    gint next_frame;    /* frame number of the next chunk in the file */
+    gboolean eof;
+    gboolean quit;
+    GMutex lock;
+    GCond cond;
+    GThread *thread;
+    /*
+     * Playback clock: frame clock time start_us shows pts base_pts,
+     * start_us is -1 until the first frame after a start or seek
+     */
+    gint64 start_us;
+    gint64 base_pts;
+    gint64 interval_us; /* between the last two frames shown */
+    gboolean stalled;
+    guint64 produced;
+    guint64 presented;
+    guint64 dropped;    /* superseded before they were shown */
+    guint64 late;       /* shown more than a refresh after their time */
+    guint64 underruns;
+    guint64 crc_errors;
+    struct yuv_cache_stats cache;   /* as of the last frame produced */
+    /* Paused, only a seek or step puts a frame up */
+    gboolean paused;
+    gboolean step;      /* show the next ready frame while paused */
+};
+
+#define DEFAULT_RING_DEPTH 4
+#define DEFAULT_CACHE_MB 256
+#define DEFAULT_FPS 10
+#define NULL_REFRESH_US 16667   /* the null backend ticks like a 60 Hz display */
+
+/* read to cache run on the producer, the rest on the main thread */
+enum player_stage {
+    STAGE_READ,
+    STAGE_CRC,
+    STAGE_CONVERT,
+    STAGE_COMPARE,
+    STAGE_SCOPE,
+    STAGE_CACHE,
+    STAGE_COMPOSE,
+    STAGE_PAINT,
+    STAGE_COUNT
+};
+
+static struct yuv_stage stages[STAGE_COUNT] = {
+    { "read" }, { "crc" }, { "convert" }, { "compare" }, { "scope" }, { "cache" },
+    { "compose" }, { "paint" },
+};
+
+/* Read (or arrival) to present latency of each frame shown */
+struct bench_log {
+    GArray *latency_us;
+    gint64 first_us;
+    gint64 last_us;
+};
+
+/* Compare mode totals over the frames shown, main thread only */
+struct compare_log {
+    guint64 frames;
+    uint64_t sse[YUV_PLANE_COUNT];
+    uint64_t samples[YUV_PLANE_COUNT];
+    gdouble ssim[YUV_PLANE_COUNT];
+};
+
+#define THUMB_HEIGHT 72
+#define THUMB_GAP 4
+#define THUMB_AHEAD 256     /* thumbnails made past the first visible one */
+#define THUMB_NICE 10
+
+enum thumb_state {
+    THUMB_EMPTY,
+    THUMB_BUSY,
+    THUMB_DONE,
+    THUMB_FAILED,
+};
+
+/*
+ * Thumbnail of every frame in the index. Workers box-decimate the YUV
+ * chunk straight to thumbnail size, going forward from the first visible
+ * thumbnail, so the strip fills in wherever it is scrolled to. Only what
+ * has been near the view is ever made.
+ */
+struct filmstrip {
+    GtkWidget *area;
+    GtkAdjustment *adjustment;  /* in pixels along the strip */
+    gint width;         /* of one thumbnail */
+    gint height;
+    enum thumb_state *state;
+    uint32_t **rgb;
+    gint first;         /* first visible thumbnail */
+    gint pending;       /* finished since the last redraw */
+    gboolean quit;
+    GMutex lock;
+    GCond cond;
+    GThread **threads;
+    gint thread_count;
+    guint64 made;
+};
+
+enum live_part {
+    LIVE_HEADER,        /* the v1 sized start of a header */
+    LIVE_HEADER_V2,     /* the rest of a v2 header we know */
+    LIVE_SKIP,          /* header fields past ours, or a dropped payload */
+    LIVE_PAYLOAD,
+};
+
+/*
+ * Live input: chunks read without blocking as they come in, however the
+ * writer splits them, and reassembled straight into a ring slot. Runs on
+ * the main thread, there is no producer.
+ */
+struct live_input {
+    int fd;
+    GIOChannel *channel;
+    enum live_part part;
+    size_t need;        /* bytes in this part */
+    size_t got;
+    size_t skip;        /* header fields past ours, skipped before the payload */
+    struct yuv_info_v2 hdr;
+    struct yuv_chunk chunk;
+    struct ring_slot *slot;     /* NULL while a payload is dropped */
+    gint64 last_latency_us;     /* arrival to paint of the last frame */
+};
+
+struct viewer_cfg frame_cfg;
+static struct frame_ring ring;
+static struct bench_log bench;
+static struct compare_log compare;
+static struct filmstrip strip;
+static struct live_input live;
+static int read_chunk(struct ring_slot *slot);
+
+static int open_file(char *fn)
+{
+    frame_cfg.fd = open(fn, O_RDONLY);
+
+    if (frame_cfg.fd < 0) {
+        perror("File open fail!");
+        return -1;
+    }
+
+    /* Every read goes through the index, multi-GB captures included */
+    if (yuv_index_open(fn, frame_cfg.fd, &frame_cfg.index) < 0) {
+        close(frame_cfg.fd);
+        return -1;
+    }
+    printf("%s: %d frames\n", fn, frame_cfg.index.count);
+
+    if (frame_cfg.cmp_fn == NULL)
+        return 0;
+
+    frame_cfg.cmp_fd = open(frame_cfg.cmp_fn, O_RDONLY);
+    if (frame_cfg.cmp_fd < 0) {
+        perror("Compare file open fail!");
+        return -1;
+    }
+
+    if (yuv_index_open(frame_cfg.cmp_fn, frame_cfg.cmp_fd,
+                       &frame_cfg.cmp_index) < 0) {
+        close(frame_cfg.cmp_fd);
+        return -1;
+    }
+    printf("%s: %d frames\n", frame_cfg.cmp_fn, frame_cfg.cmp_index.count);
+
+    /* Lockstep, the timeline ends with the shorter stream */
+    if (frame_cfg.cmp_index.count < frame_cfg.index.count)
+        frame_cfg.index.count = frame_cfg.cmp_index.count;
+
+    return 0;
+}
+
+
+static gint64 frame_pts(gint frame, guint64 timestamp_us)
+{
+    if (frame_cfg.fps > 0)
+        return (gint64) (frame * (gdouble) G_USEC_PER_SEC / frame_cfg.fps);
+
+    return timestamp_us;
+}
+
+/* Frame clock time at which pts is due, called with the lock held */
+static gint64 frame_due(gint64 pts)
+{
+    return ring.start_us + (pts - ring.base_pts);
+}
+
+/*
+ * TRUE if the frame after pts is already due, so pts would never be on
+ * screen for its full interval. Called with the lock held.
+ */
+static gboolean frame_superseded(gint64 pts, gint64 now)
+{
+    if (ring.start_us < 0)
+        return FALSE;
+
+    return frame_due(pts) + ring.interval_us <= now;
+}
+
+/*
+ * Sizes *rgb to width x height. Cairo's RGB24 is 0x00RRGGBB in native
+ * order, the converter's own layout, so frames go in with no repacking.
+ */
+static int surface_reserve(cairo_surface_t **rgb, int width, int height)
+{
+    if (*rgb && cairo_image_surface_get_width(*rgb) == width &&
+        cairo_image_surface_get_height(*rgb) == height)
+        return 0;
+
+    cairo_surface_destroy(*rgb);
+    *rgb = cairo_image_surface_create(CAIRO_FORMAT_RGB24, width, height);
+    if (cairo_surface_status(*rgb) != CAIRO_STATUS_SUCCESS) {
+        printf("Create rgb surface fail: %s\n",
+               cairo_status_to_string(cairo_surface_status(*rgb)));
+        cairo_surface_destroy(*rgb);
+        *rgb = NULL;
+        return -1;
+    }
+
+    return 0;
+}
+
+static inline uint32_t *surface_pixels(cairo_surface_t *rgb)
+{
+    return (uint32_t *) cairo_image_surface_get_data(rgb);
+}
+
+static inline uint32_t *surface_row(cairo_surface_t *rgb, unsigned int j)
+{
+    return (uint32_t *) (cairo_image_surface_get_data(rgb) +
+                         (size_t) j * cairo_image_surface_get_stride(rgb));
+}
+
+static inline size_t surface_size(cairo_surface_t *rgb)
+{
+    return (size_t) cairo_image_surface_get_stride(rgb) *
+           cairo_image_surface_get_height(rgb);
+}
+
+/* Sizes *rgb for a frame of the slot */
+static int slot_reserve(struct ring_slot *slot, cairo_surface_t **rgb)
+{
+    return surface_reserve(rgb, slot->width, slot->height);
+}
+
+/* Copies a cached picture of the same size back into rgb */
+static void surface_fill(cairo_surface_t *rgb, const struct yuv_cache_part *part)
+{
+    cairo_surface_flush(rgb);
+    memcpy(surface_pixels(rgb), part->data,
+           MIN(part->size, surface_size(rgb)));
+    cairo_surface_mark_dirty(rgb);
+}
+
+/* Scopes of slot->src for the panel, unless they are off or already done */
+static int slot_scope(struct ring_slot *slot)
+{
+    gint64 start;
+
+    if (frame_cfg.scopes == NULL ||
+        !g_atomic_int_get(&frame_cfg.scopes_shown)) {
+        slot->scoped = FALSE;
+        return 0;
+    }
+    if (slot->scoped)
+        return 0;
+
+    if (surface_reserve(&slot->scope_rgb, YUV_SCOPE_WIDTH, YUV_SCOPE_HEIGHT) < 0)
+        return -1;
+
+    /* Straight off the YUV samples, before any matrix or range */
+    start = yuv_time_ns();
+    if (yuv_scopes_compute(frame_cfg.pool, frame_cfg.scopes, slot->src,
+                           slot->format, slot->width, slot->height,
+                           frame_cfg.scope_step) < 0)
+        return -1;
+    cairo_surface_flush(slot->scope_rgb);
+    yuv_scopes_render(frame_cfg.scopes, surface_pixels(slot->scope_rgb),
+                      cairo_image_surface_get_stride(slot->scope_rgb));
+    cairo_surface_mark_dirty(slot->scope_rgb);
+    yuv_stage_end(&stages[STAGE_SCOPE], slot->frame, start);
+    slot->scoped = TRUE;
+
+    return 0;
+}
+
+/* Converts slot->src into slot->rgb, and the compared frame if any */
+static int slot_convert(struct ring_slot *slot)
+{
+    gint64 start;
+
+    if (slot_reserve(slot, &slot->rgb) < 0 ||
+        (slot->compared && slot_reserve(slot, &slot->cmp_rgb) < 0))
+        return -1;
+
+    /* Straight into the surfaces the main thread paints */
+    start = yuv_time_ns();
+    cairo_surface_flush(slot->rgb);
+    yuv_rgb_conversion_stride_mt(frame_cfg.pool, yuv_kernel_select(),
+                                 surface_pixels(slot->rgb),
+                                 cairo_image_surface_get_stride(slot->rgb),
+                                 slot->src, slot->format, frame_cfg.coefs,
+                                 slot->width, slot->height);
+    cairo_surface_mark_dirty(slot->rgb);
+    if (slot->compared) {
+        cairo_surface_flush(slot->cmp_rgb);
+        yuv_rgb_conversion_stride_mt(frame_cfg.pool, yuv_kernel_select(),
+                                     surface_pixels(slot->cmp_rgb),
+                                     cairo_image_surface_get_stride(slot->cmp_rgb),
+                                     slot->cmp_buf, slot->format,
+                                     frame_cfg.coefs, slot->width,
+                                     slot->height);
+        cairo_surface_mark_dirty(slot->cmp_rgb);
+    }
+    start = yuv_stage_end(&stages[STAGE_CONVERT], slot->frame, start);
+
+    /* On the YUV planes, so the numbers do not depend on the matrix */
+    if (slot->compared) {
+        if (yuv_metrics_compute(frame_cfg.pool, &slot->metrics, slot->src,
+                                slot->cmp_buf, slot->format, slot->width,
+                                slot->height) < 0)
+            return -1;
+        yuv_stage_end(&stages[STAGE_COMPARE], slot->frame, start);
+    }
+
+    slot->scoped = FALSE;
+
+    return slot_scope(slot);
+}
+
+/* Parts of a cached frame, in this order */
+enum cache_part {
+    CACHE_INFO,
+    CACHE_YUV,
+    CACHE_RGB,
+    CACHE_CMP_YUV,      /* empty unless compared */
+    CACHE_CMP_RGB,
+    CACHE_SCOPE,        /* empty unless scoped */
+    CACHE_PARTS
+};
+
+/* What the slot knew of the frame besides its buffers */
+struct cached_info {
+    enum yuv_format format;
+    unsigned int width;
+    unsigned int height;
+    guint64 timestamp_us;
+    gboolean compared;
+    gboolean scoped;
+    struct yuv_metrics metrics;
 };
 
-struct yuv_info {
-    unsigned int magic;
-    unsigned int width;
-    unsigned int height;
-    unsigned int size;
-};
+/* Grows a payload buffer to need bytes, like yuv_chunk_pread() */
+static int buf_reserve(guchar **buf, size_t *size, size_t need)
+{
+    if (*buf && *size >= need)
+        return 0;
+
+    free(*buf);
+    *buf = malloc(need);
+    if (*buf == NULL) {
+        perror("Memory chunk malloc fail");
+        *size = 0;
+        return -1;
+    }
+    *size = need;
+
+    return 0;
+}
+
+/*
+ * Producer thread: the converted frame goes in the cache, so stepping
+ * back or scrubbing over it again skips the read and conversion
+ */
+static void cache_store(struct ring_slot *slot)
+{
+    struct yuv_cache_part parts[CACHE_PARTS];
+    struct cached_info info;
+    size_t payload = yuv_format_frame_size(slot->format, slot->width,
+                                           slot->height);
+    gint64 start = yuv_time_ns();
+
+    memset(&info, 0, sizeof(info));
+    info.format = slot->format;
+    info.width = slot->width;
+    info.height = slot->height;
+    info.timestamp_us = slot->timestamp_us;
+    info.compared = slot->compared;
+    info.scoped = slot->scoped;
+    info.metrics = slot->metrics;
+
+    parts[CACHE_INFO] = (struct yuv_cache_part) { &info, sizeof(info) };
+    parts[CACHE_YUV] = (struct yuv_cache_part) { slot->src, payload };
+    parts[CACHE_RGB] = (struct yuv_cache_part) {
+        surface_pixels(slot->rgb), surface_size(slot->rgb) };
+    parts[CACHE_CMP_YUV] = (struct yuv_cache_part) {
+        slot->cmp_buf, slot->compared ? payload : 0 };
+    parts[CACHE_CMP_RGB] = (struct yuv_cache_part) {
+        slot->compared ? surface_pixels(slot->cmp_rgb) : NULL,
+        slot->compared ? surface_size(slot->cmp_rgb) : 0 };
+    parts[CACHE_SCOPE] = (struct yuv_cache_part) {
+        slot->scoped ? surface_pixels(slot->scope_rgb) : NULL,
+        slot->scoped ? surface_size(slot->scope_rgb) : 0 };
+
+    /* Running out of memory only costs the hits */
+    yuv_cache_put(frame_cfg.cache, slot->frame, parts, CACHE_PARTS);
+    yuv_stage_end(&stages[STAGE_CACHE], slot->frame, start);
+}
+
+/*
+ * Producer thread: fills slot with frame from the cache. FALSE on a miss,
+ * the frame is then read and converted as usual.
+ */
+static gboolean cache_fetch(struct ring_slot *slot, gint frame)
+{
+    struct yuv_cache_part parts[YUV_CACHE_MAX_PARTS];
+    struct cached_info info;
+    gint64 start = yuv_time_ns();
+
+    if (frame_cfg.cache == NULL ||
+        yuv_cache_get(frame_cfg.cache, frame, parts) != CACHE_PARTS)
+        return FALSE;
+
+    memcpy(&info, parts[CACHE_INFO].data, sizeof(info));
+    slot->frame = frame;
+    slot->format = info.format;
+    slot->width = info.width;
+    slot->height = info.height;
+    slot->timestamp_us = info.timestamp_us;
+    slot->compared = info.compared;
+    slot->metrics = info.metrics;
+
+    if (buf_reserve(&slot->buf, &slot->size, parts[CACHE_YUV].size) < 0 ||
+        slot_reserve(slot, &slot->rgb) < 0)
+        return FALSE;
+    memcpy(slot->buf, parts[CACHE_YUV].data, parts[CACHE_YUV].size);
+    surface_fill(slot->rgb, &parts[CACHE_RGB]);
+    slot->src = slot->buf;
+
+    if (slot->compared) {
+        if (buf_reserve(&slot->cmp_buf, &slot->cmp_size,
+                        parts[CACHE_CMP_YUV].size) < 0 ||
+            slot_reserve(slot, &slot->cmp_rgb) < 0)
+            return FALSE;
+        memcpy(slot->cmp_buf, parts[CACHE_CMP_YUV].data,
+               parts[CACHE_CMP_YUV].size);
+        surface_fill(slot->cmp_rgb, &parts[CACHE_CMP_RGB]);
+    }
+
+    /* Scopes shown since it was cached are made from the cached YUV */
+    slot->scoped = info.scoped && frame_cfg.scopes &&
+                   surface_reserve(&slot->scope_rgb, YUV_SCOPE_WIDTH,
+                                   YUV_SCOPE_HEIGHT) == 0;
+    if (slot->scoped)
+        surface_fill(slot->scope_rgb, &parts[CACHE_SCOPE]);
+    yuv_stage_end(&stages[STAGE_CACHE], frame, start);
+
+    return slot_scope(slot) == 0;
+}
+
+/* Producer thread: done with the frame read, a shared slot goes back */
+static void read_release(void)
+{
+    if (frame_cfg.shm)
+        yuv_shm_release(frame_cfg.shm);
+}
+
+static gpointer producer_main(gpointer data)
+{
+    struct ring_slot *slot;
+    gboolean hit;
+    int rc;
+
+    g_mutex_lock(&ring.lock);
+    for (;;) {
+        if (ring.quit)
+            break;
+
+        /* Reads are by index, a seek is just the next frame number */
+        if (ring.seek >= 0) {
+            ring.next_frame = ring.seek;
+            ring.seek = -1;
+            ring.eof = FALSE;
+            continue;
+        }
+
+        /* At the end of the file wait for a seek */
+        if (ring.eof || ring.slots[ring.head].state != SLOT_FREE) {
+            g_cond_wait(&ring.cond, &ring.lock);
+            continue;
+        }
+
+        slot = &ring.slots[ring.head];
+        g_mutex_unlock(&ring.lock);
+
+        slot->read_us = g_get_monotonic_time();
+        /* next_frame only changes on this thread */
+        hit = cache_fetch(slot, ring.next_frame);
+        rc = hit ? 0 : read_chunk(slot);
+
+        g_mutex_lock(&ring.lock);
+
+        /* A seek came in while reading, this frame is stale */
+        if (ring.seek >= 0) {
+            if (rc == 0)
+                read_release();
+            continue;
+        }
+
+        if (rc < 0) {
+            ring.eof = TRUE;
+            g_cond_broadcast(&ring.cond);
+            continue;
+        }
+
+        slot->frame = ring.next_frame++;
+        slot->pts = frame_pts(slot->frame, slot->timestamp_us);
+
+        /* Behind the clock: skip the conversion, the reader catches up */
+        if (frame_superseded(slot->pts, g_get_monotonic_time())) {
+            ring.dropped++;
+            read_release();
+            continue;
+        }
+        g_mutex_unlock(&ring.lock);
+
+        if (!hit) {
+            rc = slot_convert(slot);
+            if (rc == 0 && frame_cfg.cache)
+                cache_store(slot);
+        }
+        read_release();
+
+        g_mutex_lock(&ring.lock);
+
+        if (frame_cfg.cache)
+            yuv_cache_get_stats(frame_cfg.cache, &ring.cache);
+
+        if (ring.seek >= 0)
+            continue;
+
+        if (rc < 0) {
+            ring.eof = TRUE;
+        }
+        else {
+            slot->state = SLOT_READY;
+            ring.head = (ring.head + 1) % ring.depth;
+            ring.ready++;
+            ring.produced++;
+        }
+        g_cond_broadcast(&ring.cond);
+    }
+    g_mutex_unlock(&ring.lock);
+
+    return NULL;
+}
+
+static int ring_start(gint depth)
+{
+    memset(&ring, 0, sizeof(ring));
+
+    ring.slots = calloc(depth, sizeof(struct ring_slot));
+    if (ring.slots == NULL) {
+        perror("Memory ring calloc fail");
+        return -1;
+    }
+
+    ring.depth = depth;
+    ring.shown = -1;
+    ring.seek = -1;
+    ring.start_us = -1;
+    ring.interval_us = frame_cfg.fps > 0 ? G_USEC_PER_SEC / frame_cfg.fps :
+                                           G_USEC_PER_SEC / DEFAULT_FPS;
+    g_mutex_init(&ring.lock);
+    g_cond_init(&ring.cond);
+
+    /* Live input fills the ring from the main loop instead */
+    if (!frame_cfg.live || frame_cfg.shm)
+        ring.thread = g_thread_new("producer", producer_main, NULL);
+
+    return 0;
+}
+
+static void ring_stop(void)
+{
+    gint i;
+
+    if (ring.slots == NULL)
+        return;
+
+    g_mutex_lock(&ring.lock);
+    ring.quit = TRUE;
+    g_cond_broadcast(&ring.cond);
+    g_mutex_unlock(&ring.lock);
+    if (ring.thread)
+        g_thread_join(ring.thread);
+
+    printf("Frames: %" G_GUINT64_FORMAT " read, %" G_GUINT64_FORMAT
+           " presented, %" G_GUINT64_FORMAT " dropped, %" G_GUINT64_FORMAT
+           " late, %" G_GUINT64_FORMAT " underruns, %" G_GUINT64_FORMAT
+           " CRC errors\n",
+           ring.produced, ring.presented, ring.dropped, ring.late,
+           ring.underruns, ring.crc_errors);
+
+    for (i = 0; i < ring.depth; i++) {
+        free(ring.slots[i].buf);
+        cairo_surface_destroy(ring.slots[i].rgb);
+        free(ring.slots[i].cmp_buf);
+        cairo_surface_destroy(ring.slots[i].cmp_rgb);
+        cairo_surface_destroy(ring.slots[i].scope_rgb);
+    }
+    free(ring.slots);
+    ring.slots = NULL;
+    g_cond_clear(&ring.cond);
+    g_mutex_clear(&ring.lock);
+}
+
+/* Blocks until the first frame is ready, FALSE if the stream has none */
+static gboolean ring_wait_first(void)
+{
+    gboolean ok;
+
+    g_mutex_lock(&ring.lock);
+    while (!ring.ready && !ring.eof)
+        g_cond_wait(&ring.cond, &ring.lock);
+    ok = ring.ready > 0;
+    g_mutex_unlock(&ring.lock);
+
+    return ok;
+}
+
+/* Blocks until the next frame is ready or the stream has ended */
+static void ring_wait_ready(void)
+{
+    g_mutex_lock(&ring.lock);
+    while (ring.slots[ring.tail].state != SLOT_READY && !ring.eof)
+        g_cond_wait(&ring.cond, &ring.lock);
+    g_mutex_unlock(&ring.lock);
+}
+
+/* Main thread: drop the frames read ahead and restart at frame */
+static void ring_seek(gint frame)
+{
+    gint i;
+
+    if (frame < 0 || frame >= frame_cfg.index.count)
+        return;
+
+    g_mutex_lock(&ring.lock);
+    for (i = 0; i < ring.depth; i++) {
+        if (ring.slots[i].state == SLOT_READY)
+            ring.slots[i].state = SLOT_FREE;
+    }
+    ring.ready = 0;
+    ring.head = ring.tail = (ring.shown + 1) % ring.depth;
+    ring.seek = frame;
+    ring.start_us = -1;
+    ring.step = TRUE;
+    g_cond_broadcast(&ring.cond);
+    g_mutex_unlock(&ring.lock);
+}
+
+/*
+ * Main thread: pauses or resumes. The clock restarts from the next frame
+ * on resume, and while paused nothing is due, so the producer drops none.
+ */
+static void ring_pause(gboolean paused)
+{
+    g_mutex_lock(&ring.lock);
+    ring.paused = paused;
+    ring.step = FALSE;
+    ring.start_us = -1;
+    ring.stalled = FALSE;
+    g_mutex_unlock(&ring.lock);
+}
+
+/*
+ * Main thread: pauses and moves one frame on or back. Forward is the
+ * frame the producer already has ready; back is a seek, usually served
+ * from the cache.
+ */
+static void ring_step(gint delta)
+{
+    gint frame;
+
+    if (!ring.paused)
+        ring_pause(TRUE);
+
+    if (delta > 0) {
+        g_mutex_lock(&ring.lock);
+        ring.step = TRUE;
+        g_mutex_unlock(&ring.lock);
+        return;
+    }
+
+    /* shown only changes on this thread */
+    frame = ring.shown >= 0 ? ring.slots[ring.shown].frame : 0;
+    ring_seek(frame + delta);
+}
+
+/*
+ * Main thread: swap the next ready frame in and hand the previous one
+ * back to the producer. Called with the lock held.
+ */
+static void ring_swap(void)
+{
+    struct ring_slot *slot = &ring.slots[ring.tail];
+
+    if (ring.shown >= 0) {
+        if (slot->pts > ring.slots[ring.shown].pts)
+            ring.interval_us = slot->pts - ring.slots[ring.shown].pts;
+        ring.slots[ring.shown].state = SLOT_FREE;
+    }
+    ring.shown = ring.tail;
+    slot->state = SLOT_SHOWN;
+    ring.tail = (ring.tail + 1) % ring.depth;
+    ring.ready--;
+    ring.presented++;
+    ring.stalled = FALSE;
+    frame_cfg.width = slot->width;
+    frame_cfg.height = slot->height;
+    g_cond_broadcast(&ring.cond);
+
+    if (slot->compared) {
+        gint p;
+
+        compare.frames++;
+        for (p = 0; p < YUV_PLANE_COUNT; p++) {
+            compare.sse[p] += slot->metrics.sse[p];
+            compare.samples[p] += slot->metrics.samples[p];
+            compare.ssim[p] += slot->metrics.ssim[p];
+        }
+    }
+}
+
+/*
+ * Main thread, once per frame clock tick: shows the newest frame that is
+ * due at now, dropping any older ones still queued. Returns 1 on a new
+ * frame, 0 if none is due yet and -1 once the stream has ended.
+ */
+static int ring_present(gint64 now, gint64 refresh_us)
+{
+    struct ring_slot *slot, *next;
+    int rc = 0;
+
+    g_mutex_lock(&ring.lock);
+    slot = &ring.slots[ring.tail];
+
+    /* Live: the newest frame that has arrived, older ones are dropped */
+    if (frame_cfg.live) {
+        for (;;) {
+            next = &ring.slots[(ring.tail + 1) % ring.depth];
+            if (slot->state != SLOT_READY || next->state != SLOT_READY)
+                break;
+            slot->state = SLOT_FREE;
+            ring.tail = (ring.tail + 1) % ring.depth;
+            ring.ready--;
+            ring.dropped++;
+            slot = next;
+        }
+
+        if (slot->state == SLOT_READY) {
+            ring_swap();
+            rc = 1;
+        }
+        else if (ring.eof) {
+            rc = -1;
+        }
+        g_mutex_unlock(&ring.lock);
+        return rc;
+    }
+
+    /* Paused: only the frame a seek or step asked for */
+    if (ring.paused) {
+        if (ring.step && slot->state == SLOT_READY) {
+            ring_swap();
+            ring.step = FALSE;
+            rc = 1;
+        }
+        else if (ring.step && ring.eof) {
+            ring.step = FALSE;
+            rc = -1;
+        }
+        g_mutex_unlock(&ring.lock);
+        return rc;
+    }
+
+    /* Unpaced: every frame in order, nothing is due or dropped */
+    if (frame_cfg.benchmark) {
+        if (slot->state == SLOT_READY) {
+            ring_swap();
+            rc = 1;
+        }
+        else if (ring.eof) {
+            rc = -1;
+        }
+        g_mutex_unlock(&ring.lock);
+        return rc;
+    }
+
+    /* The clock starts with the first frame after a start or seek */
+    if (ring.start_us < 0 && slot->state == SLOT_READY) {
+        ring.start_us = now;
+        ring.base_pts = slot->pts;
+    }
+
+    for (;;) {
+        next = &ring.slots[(ring.tail + 1) % ring.depth];
+        if (slot->state != SLOT_READY || next->state != SLOT_READY ||
+            frame_due(next->pts) > now)
+            break;
+
+        slot->state = SLOT_FREE;
+        ring.tail = (ring.tail + 1) % ring.depth;
+        ring.ready--;
+        ring.dropped++;
+        g_cond_broadcast(&ring.cond);
+        slot = next;
+    }
+
+    if (slot->state == SLOT_READY) {
+        if (frame_due(slot->pts) <= now) {
+            if (now - frame_due(slot->pts) > refresh_us)
+                ring.late++;
+            ring_swap();
+            rc = 1;
+        }
+    }
+    else if (ring.eof) {
+        rc = -1;
+    }
+    else if (ring.shown >= 0 && !ring.stalled && ring.start_us >= 0 &&
+             frame_due(ring.slots[ring.shown].pts) + ring.interval_us <= now) {
+        /* The next frame is due and the producer has not got it yet */
+        ring.underruns++;
+        ring.stalled = TRUE;
+    }
+    g_mutex_unlock(&ring.lock);
+
+    return rc;
+}
+
+/* Main thread, once the shown frame is on screen */
+static void frame_presented(void)
+{
+    struct ring_slot *slot = &ring.slots[ring.shown];
+    gint64 now, latency;
+
+    if ((!frame_cfg.benchmark && !frame_cfg.live) || slot->read_us == 0)
+        return;
+
+    now = g_get_monotonic_time();
+    latency = now - slot->read_us;
+    live.last_latency_us = latency;
+    g_array_append_val(bench.latency_us, latency);
+    if (bench.latency_us->len == 1)
+        bench.first_us = now;
+    bench.last_us = now;
+    slot->read_us = 0;
+}
+
+static gint compare_gint64(gconstpointer a, gconstpointer b)
+{
+    gint64 x = *(const gint64 *) a, y = *(const gint64 *) b;
+
+    return x < y ? -1 : x > y;
+}
+
+/* Live latency is from the whole chunk arriving to it being painted */
+static void bench_report(void)
+{
+    const char *name = frame_cfg.benchmark ? "Benchmark" : "Live";
+    gint64 *v = (gint64 *) bench.latency_us->data;
+    guint n = bench.latency_us->len;
+
+    if (n == 0) {
+        printf("%s: no frames presented\n", name);
+        return;
+    }
+
+    g_array_sort(bench.latency_us, compare_gint64);
+
+    printf("%s: %u frames in %.3f s, %.1f fps, latency p50 %.3f ms, "
+           "p99 %.3f ms, max %.3f ms\n",
+           name, n, (bench.last_us - bench.first_us) / 1e6,
+           n > 1 && bench.last_us > bench.first_us ?
+               (n - 1) * 1e6 / (bench.last_us - bench.first_us) : 0,
+           v[(n - 1) * 50 / 100] / 1e3, v[(n - 1) * 99 / 100] / 1e3,
+           v[n - 1] / 1e3);
+}
+
+/* PSNR from the errors summed over every frame shown, SSIM averaged */
+static void compare_report(void)
+{
+    if (compare.frames == 0) {
+        printf("Compare: no frames compared\n");
+        return;
+    }
+
+    printf("Compare: %" G_GUINT64_FORMAT " frames, PSNR Y %.2f U %.2f V %.2f dB, "
+           "SSIM Y %.4f U %.4f V %.4f\n", compare.frames,
+           yuv_psnr(compare.sse[YUV_PLANE_Y], compare.samples[YUV_PLANE_Y]),
+           yuv_psnr(compare.sse[YUV_PLANE_U], compare.samples[YUV_PLANE_U]),
+           yuv_psnr(compare.sse[YUV_PLANE_V], compare.samples[YUV_PLANE_V]),
+           compare.ssim[YUV_PLANE_Y] / compare.frames,
+           compare.ssim[YUV_PLANE_U] / compare.frames,
+           compare.ssim[YUV_PLANE_V] / compare.frames);
+}
+
+/* Next thumbnail to make, called with the strip lock held */
+static gint filmstrip_next(void)
+{
+    gint i, end = MIN(strip.first + THUMB_AHEAD, frame_cfg.index.count);
+
+    for (i = strip.first; i < end; i++) {
+        if (strip.state[i] == THUMB_EMPTY)
+            return i;
+    }
+
+    return -1;
+}
+
+static gpointer filmstrip_main(gpointer data)
+{
+    int fd = frame_cfg.fd;
+    struct yuv_chunk chunk;
+    uint8_t *buf = NULL;
+    size_t buf_size = 0;
+    uint32_t *rgb;
+    gint i;
+
+    /* Behind playback: Linux nice values are per thread */
+    setpriority(PRIO_PROCESS, syscall(SYS_gettid), THUMB_NICE);
+
+    g_mutex_lock(&strip.lock);
+    while (!strip.quit) {
+        i = filmstrip_next();
+        if (i < 0) {
+            g_cond_wait(&strip.cond, &strip.lock);
+            continue;
+        }
+        strip.state[i] = THUMB_BUSY;
+        g_mutex_unlock(&strip.lock);
+
+        /* pread leaves the producer's file position alone */
+        rgb = malloc((size_t) strip.width * strip.height * sizeof(uint32_t));
+        if (rgb == NULL) {
+            perror("Memory thumbnail malloc fail");
+        }
+        else if (yuv_chunk_pread(fd, frame_cfg.index.offsets[i], &chunk,
+                                 &buf, &buf_size) < 0) {
+            free(rgb);
+            rgb = NULL;
+        }
+        else {
+            yuv_rgb_conversion_scaled(NULL, rgb, strip.width * sizeof(uint32_t),
+                                      strip.width, strip.height, buf,
+                                      chunk.format, frame_cfg.coefs,
+                                      chunk.width, chunk.height, YUV_SCALE_BOX);
+        }
+
+        g_mutex_lock(&strip.lock);
+        strip.rgb[i] = rgb;
+        strip.state[i] = rgb ? THUMB_DONE : THUMB_FAILED;
+        strip.pending++;
+        if (rgb)
+            strip.made++;
+    }
+    g_mutex_unlock(&strip.lock);
+
+    free(buf);
+
+    return NULL;
+}
+
+static int filmstrip_start(gint threads)
+{
+    gint count = frame_cfg.index.count;
+    gint i;
+
+    strip.height = THUMB_HEIGHT;
+    strip.width = MAX(1, frame_cfg.width * THUMB_HEIGHT / frame_cfg.height);
+    strip.state = calloc(count, sizeof(*strip.state));
+    strip.rgb = calloc(count, sizeof(*strip.rgb));
+    strip.threads = calloc(threads, sizeof(*strip.threads));
+    if (strip.state == NULL || strip.rgb == NULL || strip.threads == NULL) {
+        perror("Memory filmstrip calloc fail");
+        free(strip.state);
+        free(strip.rgb);
+        free(strip.threads);
+        return -1;
+    }
+
+    g_mutex_init(&strip.lock);
+    g_cond_init(&strip.cond);
+    for (i = 0; i < threads; i++)
+        strip.threads[i] = g_thread_new("thumbnail", filmstrip_main, NULL);
+    strip.thread_count = threads;
+
+    return 0;
+}
+
+static void filmstrip_stop(void)
+{
+    gint i;
+
+    if (strip.threads == NULL)
+        return;
+
+    g_mutex_lock(&strip.lock);
+    strip.quit = TRUE;
+    g_cond_broadcast(&strip.cond);
+    g_mutex_unlock(&strip.lock);
+    for (i = 0; i < strip.thread_count; i++)
+        g_thread_join(strip.threads[i]);
+
+    printf("Thumbnails: %" G_GUINT64_FORMAT " made on %d threads\n",
+           strip.made, strip.thread_count);
+
+    for (i = 0; i < frame_cfg.index.count; i++)
+        free(strip.rgb[i]);
+    free(strip.rgb);
+    free(strip.state);
+    free(strip.threads);
+    strip.threads = NULL;
+    g_cond_clear(&strip.cond);
+    g_mutex_clear(&strip.lock);
+}
+
+/* Main thread, each tick: redraw once new thumbnails are in */
+static void filmstrip_tick(gboolean new_frame)
+{
+    gboolean dirty;
+
+    if (strip.area == NULL)
+        return;
+
+    g_mutex_lock(&strip.lock);
+    dirty = strip.pending > 0;
+    strip.pending = 0;
+    g_mutex_unlock(&strip.lock);
+
+    if (dirty || new_frame)
+        gtk_widget_queue_draw(strip.area);
+}
+
+static void filmstrip_scrolled(GtkAdjustment *adjustment, gpointer data)
+{
+    g_mutex_lock(&strip.lock);
+    strip.first = (gint) gtk_adjustment_get_value(adjustment) /
+                  (strip.width + THUMB_GAP);
+    g_cond_broadcast(&strip.cond);
+    g_mutex_unlock(&strip.lock);
+
+    gtk_widget_queue_draw(strip.area);
+}
+
+/* The area is only as wide as the window, the scrollbar pages by that */
+static void filmstrip_resized(GtkWidget *widget, GtkAllocation *allocation,
+                              gpointer data)
+{
+    gtk_adjustment_configure(strip.adjustment,
+                             gtk_adjustment_get_value(strip.adjustment), 0,
+                             frame_cfg.index.count * (strip.width + THUMB_GAP),
+                             strip.width + THUMB_GAP, allocation->width,
+                             allocation->width);
+}
+
+static gboolean filmstrip_draw(GtkWidget *widget, cairo_t *cr, gpointer data)
+{
+    gint cell = strip.width + THUMB_GAP;
+    gint offset = (gint) gtk_adjustment_get_value(strip.adjustment);
+    gint last = (offset + gtk_widget_get_allocated_width(widget)) / cell;
+    gint current = ring.shown >= 0 ? ring.slots[ring.shown].frame : -1;
+    cairo_surface_t *surface;
+    gint i, x;
+
+    cairo_set_source_rgb(cr, 0.1, 0.1, 0.1);
+    cairo_paint(cr);
+
+    last = MIN(last, frame_cfg.index.count - 1);
+
+    /* Finished thumbnails are not touched again until filmstrip_stop() */
+    g_mutex_lock(&strip.lock);
+    for (i = offset / cell; i <= last; i++) {
+        x = i * cell - offset;
+
+        if (strip.state[i] == THUMB_DONE) {
+            surface = cairo_image_surface_create_for_data(
+                        (unsigned char *) strip.rgb[i], CAIRO_FORMAT_RGB24,
+                        strip.width, strip.height,
+                        strip.width * sizeof(uint32_t));
+            cairo_set_source_surface(cr, surface, x, 0);
+            cairo_surface_destroy(surface);
+        }
+        else {
+            cairo_set_source_rgb(cr, 0.3, 0.3, 0.3);
+        }
+        cairo_rectangle(cr, x, 0, strip.width, strip.height);
+        cairo_fill(cr);
+
+        if (i == current) {
+            cairo_set_source_rgb(cr, 1, 0.8, 0);
+            cairo_set_line_width(cr, 2);
+            cairo_rectangle(cr, x + 1, 1, strip.width - 2, strip.height - 2);
+            cairo_stroke(cr);
+        }
+    }
+    g_mutex_unlock(&strip.lock);
+
+    return FALSE;
+}
+
+/* A click seeks to the thumbnail's frame */
+static gboolean filmstrip_button(GtkWidget *widget, GdkEventButton *event,
+                                 gpointer data)
+{
+    gint x = (gint) (event->x + gtk_adjustment_get_value(strip.adjustment));
+
+    if (event->button != 1 || x % (strip.width + THUMB_GAP) >= strip.width)
+        return FALSE;
+
+    ring_seek(x / (strip.width + THUMB_GAP));
+
+    return TRUE;
+}
+
+/* The wheel scrolls the strip */
+static gboolean filmstrip_wheel(GtkWidget *widget, GdkEventScroll *event,
+                                gpointer data)
+{
+    gdouble step = gtk_adjustment_get_step_increment(strip.adjustment);
+    gdouble value = gtk_adjustment_get_value(strip.adjustment);
+
+    if (event->direction == GDK_SCROLL_UP || event->direction == GDK_SCROLL_LEFT)
+        value -= step;
+    else if (event->direction == GDK_SCROLL_DOWN ||
+             event->direction == GDK_SCROLL_RIGHT)
+        value += step;
+    else if (event->direction == GDK_SCROLL_SMOOTH)
+        value += (event->delta_x + event->delta_y) * step;
+
+    gtk_adjustment_set_value(strip.adjustment, value);
+
+    return TRUE;
+}
+
+static void filmstrip_create(GtkWidget *vbox)
+{
+    GtkWidget *scrollbar;
+
+    if (filmstrip_start(frame_cfg.thumb_threads) < 0)
+        return;
+
+    strip.adjustment = gtk_adjustment_new(0, 0, frame_cfg.index.count *
+                                          (strip.width + THUMB_GAP),
+                                          strip.width + THUMB_GAP, 1, 1);
+    g_signal_connect(strip.adjustment, "value-changed",
+                     G_CALLBACK(filmstrip_scrolled), NULL);
+
+    strip.area = gtk_drawing_area_new();
+    gtk_widget_set_size_request(strip.area, -1, strip.height);
+    gtk_widget_add_events(strip.area, GDK_BUTTON_PRESS_MASK | GDK_SCROLL_MASK);
+    g_signal_connect(strip.area, "draw", G_CALLBACK(filmstrip_draw), NULL);
+    g_signal_connect(strip.area, "size-allocate",
+                     G_CALLBACK(filmstrip_resized), NULL);
+    g_signal_connect(strip.area, "button-press-event",
+                     G_CALLBACK(filmstrip_button), NULL);
+    g_signal_connect(strip.area, "scroll-event",
+                     G_CALLBACK(filmstrip_wheel), NULL);
+    gtk_box_pack_start(GTK_BOX(vbox), strip.area, FALSE, FALSE, 0);
+
+    scrollbar = gtk_scrollbar_new(GTK_ORIENTATION_HORIZONTAL, strip.adjustment);
+    gtk_box_pack_start(GTK_BOX(vbox), scrollbar, FALSE, FALSE, 0);
+}
+
+/*
+ * "-" is stdin; a FIFO is opened, a UNIX socket connected to. Returns
+ * the fd, or -1 for anything else (a file to index) or on error.
+ */
+static int live_open(const char *fn)
+{
+    struct sockaddr_un addr;
+    struct stat st;
+    int fd;
+
+    if (!strcmp(fn, "-"))
+        return STDIN_FILENO;
+
+    if (stat(fn, &st) < 0 || !(S_ISFIFO(st.st_mode) || S_ISSOCK(st.st_mode)))
+        return -1;
+
+    if (S_ISFIFO(st.st_mode)) {
+        /* Waits for the writer */
+        fd = open(fn, O_RDONLY);
+        if (fd < 0)
+            perror("FIFO open fail");
+        return fd;
+    }
+
+    if (strlen(fn) >= sizeof(addr.sun_path)) {
+        printf("Socket path too long\n");
+        return -1;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, fn);
+
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, (struct sockaddr *) &addr, sizeof(addr)) < 0) {
+        perror("Socket connect fail");
+        if (fd >= 0)
+            close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+/* Reads toward need bytes of the part: 1 once complete, 0 for no data yet */
+static int live_fill(void *dst)
+{
+    static uint8_t scratch[65536];
+    size_t want = live.need - live.got;
+    ssize_t n;
+
+    while (want) {
+        if (dst)
+            n = read(live.fd, (uint8_t *) dst + live.got, want);
+        else
+            n = read(live.fd, scratch, MIN(want, sizeof(scratch)));
+
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            return 0;
+        if (n <= 0) {
+            if (n < 0)
+                perror("Live read fail");
+            else if (live.part != LIVE_HEADER || live.got)
+                printf("Live input ended mid-chunk\n");
+            return -1;
+        }
+
+        live.got += n;
+        want -= n;
+    }
+
+    return 1;
+}
+
+/* Slot for the payload, NULL if the main thread is behind on all of them */
+static struct ring_slot *live_slot(void)
+{
+    struct ring_slot *slot = &ring.slots[ring.head];
+    gboolean free_slot;
+
+    g_mutex_lock(&ring.lock);
+    free_slot = slot->state == SLOT_FREE;
+    if (!free_slot)
+        ring.dropped++;
+    g_mutex_unlock(&ring.lock);
+
+    if (!free_slot)
+        return NULL;
+
+    if (slot->buf == NULL || slot->size < live.chunk.size) {
+        free(slot->buf);
+        slot->buf = malloc(live.chunk.size);
+        if (slot->buf == NULL) {
+            perror("Memory live malloc fail");
+            slot->size = 0;
+            return NULL;
+        }
+        slot->size = live.chunk.size;
+    }
+
+    return slot;
+}
+
+static void live_part(enum live_part part, size_t need)
+{
+    live.part = part;
+    live.need = need;
+    live.got = 0;
+}
+
+/* A header of len bytes is in: on to what follows it */
+static int live_header_done(int len)
+{
+    if (len < 0 || yuv_chunk_verify_header(&live.chunk) < 0) {
+        printf("Live input out of sync, stopping\n");
+        return -1;
+    }
+
+    live.skip = len - live.got;
+    if (live.skip) {
+        live_part(LIVE_SKIP, live.skip);
+        return 0;
+    }
+
+    live.slot = live_slot();
+    live_part(live.slot ? LIVE_PAYLOAD : LIVE_SKIP, live.chunk.size);
+
+    return 0;
+}
+
+/* The payload is in: convert it and queue it for the next tick */
+static void live_frame_done(void)
+{
+    struct ring_slot *slot = live.slot;
+    gint64 now = g_get_monotonic_time();
+
+    slot->width = live.chunk.width;
+    slot->height = live.chunk.height;
+    slot->format = live.chunk.format;
+    slot->timestamp_us = live.chunk.timestamp_us;
+    slot->frame = ring.next_frame++;
+    slot->pts = now;
+    slot->read_us = now;
+    slot->src = slot->buf;
+
+    if (frame_cfg.check_crc && yuv_chunk_check_crc(&live.chunk, slot->buf) < 0) {
+        printf("CRC mismatch in frame %" G_GUINT64_FORMAT "\n", live.chunk.frame);
+        g_mutex_lock(&ring.lock);
+        ring.crc_errors++;
+        g_mutex_unlock(&ring.lock);
+    }
+
+    if (slot_convert(slot) < 0)
+        return;
+
+    g_mutex_lock(&ring.lock);
+    slot->state = SLOT_READY;
+    ring.head = (ring.head + 1) % ring.depth;
+    ring.ready++;
+    ring.produced++;
+    g_mutex_unlock(&ring.lock);
+}
+
+/*
+ * Takes whatever the fd has, returns the number of frames completed or
+ * -1 once the input has ended.
+ */
+static int live_read(void)
+{
+    int frames = 0;
+    int len, rc;
+
+    if (ring.eof)
+        return -1;
+
+    for (;;) {
+        switch (live.part) {
+        case LIVE_HEADER:
+            rc = live_fill(&live.hdr);
+            if (rc <= 0)
+                break;
+            /* A whole file piped in ends with its index */
+            if (live.hdr.magic == YUV_CHUNK_INDEX_MAGIC) {
+                rc = -1;
+                break;
+            }
+            len = yuv_chunk_decode(&live.hdr, live.got, &live.chunk);
+            if (len > (int) live.got) {
+                /* v2: the rest of the header, as much of it as we know */
+                live.part = LIVE_HEADER_V2;
+                live.need = sizeof(live.hdr);
+                continue;
+            }
+            rc = live_header_done(len);
+            break;
+        case LIVE_HEADER_V2:
+            rc = live_fill(&live.hdr);
+            if (rc <= 0)
+                break;
+            rc = live_header_done(yuv_chunk_decode(&live.hdr, live.got,
+                                                   &live.chunk));
+            break;
+        case LIVE_SKIP:
+            rc = live_fill(NULL);
+            if (rc <= 0)
+                break;
+            /* Past the header extension the payload follows */
+            if (live.skip) {
+                live.skip = 0;
+                live.slot = live_slot();
+                live_part(live.slot ? LIVE_PAYLOAD : LIVE_SKIP, live.chunk.size);
+            }
+            else {
+                live_part(LIVE_HEADER, sizeof(struct yuv_info));
+            }
+            continue;
+        case LIVE_PAYLOAD:
+            rc = live_fill(live.slot->buf);
+            if (rc <= 0)
+                break;
+            live_frame_done();
+            frames++;
+            live_part(LIVE_HEADER, sizeof(struct yuv_info));
+            continue;
+        }
 
-struct viewer_cfg frame_cfg;
-int *rgb_buf = NULL;
-static int read_chunk();
+        if (rc < 0) {
+            g_mutex_lock(&ring.lock);
+            ring.eof = TRUE;
+            g_mutex_unlock(&ring.lock);
+            return -1;
+        }
+        if (rc == 0)
+            return frames;
+    }
+}
 
-static int open_file(char *fn)
+static int live_start(int fd)
 {
-    frame_cfg.fp = fopen(fn, "r");
+    live.fd = fd;
+    live_part(LIVE_HEADER, sizeof(struct yuv_info));
 
-    if (!frame_cfg.fp) {
-        perror("File open fail!");
+    if (fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK) < 0) {
+        perror("Live fcntl fail");
         return -1;
     }
 
     return 0;
 }
 
+/* Without a main loop: block until the fd has data, then take it */
+static int live_poll(void)
+{
+    struct pollfd pfd = { live.fd, POLLIN, 0 };
+
+    if (poll(&pfd, 1, -1) < 0 && errno != EINTR) {
+        perror("Live poll fail");
+        return -1;
+    }
+
+    return live_read();
+}
+
+/* Blocks until the first frame is in, FALSE if the input has none */
+static gboolean live_wait_first(void)
+{
+    while (ring.ready == 0) {
+        if (live_poll() < 0)
+            return FALSE;
+    }
+
+    return TRUE;
+}
+
+/* Main loop: the fd is readable, or closed */
+static gboolean live_callback(GIOChannel *channel, GIOCondition condition,
+                              gpointer data)
+{
+    if (live_read() < 0) {
+        printf("Live input closed\n");
+        return G_SOURCE_REMOVE;
+    }
+
+    return G_SOURCE_CONTINUE;
+}
+
+static void timeline_changed(GtkWidget *range, gpointer data)
+{
+    ring_seek((gint) gtk_range_get_value(GTK_RANGE(range)) - 1);
+}
+
+static void update_timeline(void)
+{
+    if (frame_cfg.timeline == NULL || ring.shown < 0)
+        return;
+
+    g_signal_handler_block(frame_cfg.timeline, frame_cfg.timeline_handler);
+    gtk_range_set_value(GTK_RANGE(frame_cfg.timeline),
+                        ring.slots[ring.shown].frame + 1);
+    g_signal_handler_unblock(frame_cfg.timeline, frame_cfg.timeline_handler);
+}
+
+static void update_title(void)
+{
+    gchar *title;
+
+    g_mutex_lock(&ring.lock);
+    if (frame_cfg.live)
+        title = g_strdup_printf("%s  live  dropped %" G_GUINT64_FORMAT
+                                "  latency %.1f ms", frame_cfg.fn, ring.dropped,
+                                live.last_latency_us / 1e3);
+    else
+        title = g_strdup_printf("%s%s%s%s  ring %d/%d  dropped %" G_GUINT64_FORMAT
+                                "  late %" G_GUINT64_FORMAT
+                                "  underruns %" G_GUINT64_FORMAT,
+                                frame_cfg.fn, frame_cfg.cmp_fn ? " | " : "",
+                                frame_cfg.cmp_fn ? frame_cfg.cmp_fn : "",
+                                ring.paused ? "  paused" : "",
+                                ring.ready, ring.depth,
+                                ring.dropped, ring.late, ring.underruns);
+    g_mutex_unlock(&ring.lock);
+
+    gtk_window_set_title(GTK_WINDOW(frame_cfg.window), title);
+    g_free(title);
+}
 
 /* Surface to store current scribbles */
 static void close_window(void)
 {
-    if (frame_cfg.buf) {
-        free(frame_cfg.buf);
+    gtk_main_quit();
+}
+
+/* Stage timings in the top left corner, and how the cache is doing */
+static void draw_stats(cairo_t *cr)
+{
+    char text[640];
+    char *line, *next;
+    struct yuv_cache_stats cache;
+    double y = 16;
+    gint len, lines = STAGE_COUNT + 1;
+
+    len = yuv_stage_format(text, sizeof(text), stages, STAGE_COUNT);
+
+    if (frame_cfg.cache) {
+        g_mutex_lock(&ring.lock);
+        cache = ring.cache;
+        g_mutex_unlock(&ring.lock);
+        snprintf(text + len, sizeof(text) - len,
+                 "\ncache    %d frames, %zu MB\n         %" G_GUINT64_FORMAT
+                 " hits, %" G_GUINT64_FORMAT " misses", cache.frames,
+                 cache.bytes >> 20, cache.hits, cache.misses);
+        lines += 2;
     }
 
-    gtk_main_quit();
+    cairo_set_source_rgba(cr, 0, 0, 0, 0.6);
+    cairo_rectangle(cr, 0, 0, 280, 8 + 14 * lines);
+    cairo_fill(cr);
+
+    cairo_select_font_face(cr, "monospace", CAIRO_FONT_SLANT_NORMAL,
+                           CAIRO_FONT_WEIGHT_NORMAL);
+    cairo_set_font_size(cr, 12);
+    cairo_set_source_rgb(cr, 1, 1, 1);
+    cairo_move_to(cr, 6, y);
+    cairo_show_text(cr, "stage       last     avg     max");
+
+    for (line = text; line; line = next) {
+        next = strchr(line, '\n');
+        if (next)
+            *next++ = '\0';
+        y += 14;
+        cairo_move_to(cr, 6, y);
+        cairo_show_text(cr, line);
+    }
 }
 
-void yuv_rgb_conversion(int *rgb, guchar *yuv420sp, int width, int height)
+/* Width of the picture the current view makes of the shown frame */
+static unsigned int view_width(void)
 {
-    int frameSize = width * height;
-    int i, j, yp;
+    if (frame_cfg.cmp_fn && frame_cfg.view == VIEW_SIDE_BY_SIDE)
+        return frame_cfg.width * 2;
 
-    for (j = 0, yp = 0; j < height; j++) {
-        int uvp = frameSize + (j >> 1) * width, u = 0, v = 0;
-        for (i = 0; i < width; i++, yp++) {
-            int y = (0xff & ((int) yuv420sp[yp])) - 16;
-            if (y < 0) y = 0;
-            if ((i & 1) == 0) {
-                v = (0xff & yuv420sp[uvp++]) - 128;
-                u = (0xff & yuv420sp[uvp++]) - 128;
-            }
+    return frame_cfg.width;
+}
+
+/* Main thread: |a - b| of the slot's frames for the difference view */
+static int compare_difference(struct ring_slot *slot)
+{
+    unsigned int j;
 
-            int y1192 = 1192 * y;
-            int r = (y1192 + 1634 * v);
-            int g = (y1192 - 833 * v - 400 * u);
-            int b = (y1192 + 2066 * u);
+    if (slot_reserve(slot, &frame_cfg.diff_rgb) < 0)
+        return -1;
 
-            if (r < 0) r = 0;
-            else if (r > 262143) r = 262143;
-            if (g < 0) g = 0;
-            else if (g > 262143) g = 262143;
-            if (b < 0) b = 0;
-            else if (b > 262143) b = 262143;
+    cairo_surface_flush(frame_cfg.diff_rgb);
+    for (j = 0; j < slot->height; j++)
+        yuv_rgb_difference(surface_row(frame_cfg.diff_rgb, j),
+                           surface_row(slot->rgb, j),
+                           surface_row(slot->cmp_rgb, j),
+                           slot->width, frame_cfg.diff_shift);
+    cairo_surface_mark_dirty(frame_cfg.diff_rgb);
 
-            rgb[yp] = 0xff000000 | ((r << 6) & 0xff0000) | ((g >> 2) & 0xff00) | ((b >> 10) & 0xff);
-        }
-    }
+    return 0;
+}
+
+/*
+ * Columns [x0, x1) of a frame with its left edge at x, in frame pixels;
+ * the user space of cr is scaled to them.
+ */
+static void paint_frame(cairo_t *cr, cairo_surface_t *rgb, double x,
+                        double x0, double x1)
+{
+    cairo_pattern_t *pattern;
+
+    cairo_set_source_surface(cr, rgb, x, 0);
+    pattern = cairo_get_source(cr);
+    cairo_pattern_set_filter(pattern, CAIRO_FILTER_BILINEAR);
+    /* Keeps the edges from fading into the transparent outside */
+    cairo_pattern_set_extend(pattern, CAIRO_EXTEND_PAD);
+    cairo_rectangle(cr, x + x0, 0, x1 - x0, cairo_image_surface_get_height(rgb));
+    cairo_fill(cr);
 }
 
-static void rgb_buf_create()
+/* PSNR and SSIM of the shown frame in the bottom left corner */
+static void draw_metrics(cairo_t *cr, struct ring_slot *slot, gint height)
 {
-    printf("Buffer create %dx%d ch:%d\n", 
-            frame_cfg.width, frame_cfg.height, frame_cfg.channel);
-    rgb_buf = calloc(1, frame_cfg.width * frame_cfg.height * frame_cfg.channel);
+    static const char *planes[YUV_PLANE_COUNT] = { "Y", "U", "V" };
+    char text[128];
+    double top = height - 8 - 14 * (YUV_PLANE_COUNT + 1), y = top + 16;
+    gint p;
 
-    if (rgb_buf == NULL) {
-        perror("Memory rgb calloc fail");
+    cairo_set_source_rgba(cr, 0, 0, 0, 0.6);
+    cairo_rectangle(cr, 0, top, 280, height - top);
+    cairo_fill(cr);
+
+    cairo_select_font_face(cr, "monospace", CAIRO_FONT_SLANT_NORMAL,
+                           CAIRO_FONT_WEIGHT_NORMAL);
+    cairo_set_font_size(cr, 12);
+    cairo_set_source_rgb(cr, 1, 1, 1);
+
+    if (frame_cfg.view == VIEW_DIFFERENCE)
+        snprintf(text, sizeof(text), "frame %d  %s x%d", slot->frame + 1,
+                 view_names[frame_cfg.view], 1 << frame_cfg.diff_shift);
+    else
+        snprintf(text, sizeof(text), "frame %d  %s", slot->frame + 1,
+                 view_names[frame_cfg.view]);
+    cairo_move_to(cr, 6, y);
+    cairo_show_text(cr, text);
+
+    if (!slot->compared) {
+        cairo_move_to(cr, 6, y + 14);
+        cairo_show_text(cr, "layouts differ, not compared");
         return;
     }
 
-    yuv_rgb_conversion(rgb_buf, frame_cfg.buf, frame_cfg.width, frame_cfg.height);
-
-    return;
+    for (p = 0; p < YUV_PLANE_COUNT; p++) {
+        snprintf(text, sizeof(text), "%s  PSNR %6.2f dB  SSIM %.4f",
+                 planes[p], slot->metrics.psnr[p], slot->metrics.ssim[p]);
+        y += 14;
+        cairo_move_to(cr, 6, y);
+        cairo_show_text(cr, text);
+    }
 }
 
-gboolean expose_event_callback(GtkWidget *widget,
-                                 GdkEventExpose *event,
-                                 gpointer data)
+/*
+ * Paints the converted surfaces as they are, the scale to the allocation
+ * is cairo's transform, so nothing is allocated or copied per draw
+ */
+static gboolean expose_event_callback(GtkWidget *widget, cairo_t *cr,
+                                      gpointer data)
 {
-    GdkPixbuf *pixbuf;
-    guchar *pixel;
+    struct ring_slot *slot;
+    gint64 start;
+    gint width, height;
+    double split;
 
-    pixbuf = gdk_pixbuf_new(GDK_COLORSPACE_RGB, 
-            TRUE, 8, frame_cfg.width, frame_cfg.height);
-    g_assert(gdk_pixbuf_get_colorspace (pixbuf) == GDK_COLORSPACE_RGB);
+    if (ring.shown < 0)
+        return FALSE;
+    slot = &ring.slots[ring.shown];
 
-    frame_cfg.channel = gdk_pixbuf_get_n_channels(pixbuf);
+    width = gtk_widget_get_allocated_width(widget);
+    height = gtk_widget_get_allocated_height(widget);
 
-    pixel = gdk_pixbuf_get_pixels(pixbuf);
+    start = yuv_time_ns();
 
-    rgb_buf_create();
-    if (rgb_buf == NULL)
-        return FALSE;
+    if (slot->compared && frame_cfg.view == VIEW_DIFFERENCE) {
+        if (compare_difference(slot) < 0)
+            return FALSE;
+        start = yuv_stage_end(&stages[STAGE_COMPOSE], slot->frame, start);
+    }
+
+    cairo_save(cr);
+    cairo_scale(cr, (double) width /
+                    (slot->compared ? view_width() : slot->width),
+                (double) height / slot->height);
+
+    if (!slot->compared) {
+        paint_frame(cr, slot->rgb, 0, 0, slot->width);
+    }
+    else {
+        switch (frame_cfg.view) {
+        case VIEW_SIDE_BY_SIDE:
+            paint_frame(cr, slot->rgb, 0, 0, slot->width);
+            paint_frame(cr, slot->cmp_rgb, slot->width, 0, slot->width);
+            break;
+        case VIEW_WIPE:
+            split = (gint) (frame_cfg.wipe * width) * (double) slot->width / width;
+            paint_frame(cr, slot->rgb, 0, 0, split);
+            paint_frame(cr, slot->cmp_rgb, 0, split, slot->width);
+            break;
+        default:
+            paint_frame(cr, frame_cfg.diff_rgb, 0, 0, slot->width);
+            break;
+        }
+    }
+
+    cairo_restore(cr);
+    yuv_stage_end(&stages[STAGE_PAINT], slot->frame, start);
+    frame_presented();
+
+    /* The split line of the wipe */
+    if (slot->compared && frame_cfg.view == VIEW_WIPE) {
+        cairo_set_source_rgb(cr, 1, 1, 1);
+        cairo_set_line_width(cr, 1);
+        cairo_move_to(cr, (gint) (frame_cfg.wipe * width) + 0.5, 0);
+        cairo_line_to(cr, (gint) (frame_cfg.wipe * width) + 0.5, height);
+        cairo_stroke(cr);
+    }
 
-    memcpy(pixel, rgb_buf, 
-            (frame_cfg.width * frame_cfg.height * frame_cfg.channel));
+    if (frame_cfg.stats)
+        draw_stats(cr);
+    if (frame_cfg.cmp_fn)
+        draw_metrics(cr, slot, height);
 
-    GtkAllocation *allocation = g_new0(GtkAllocation, 1);
-    gtk_widget_get_allocation(GTK_WIDGET(widget), allocation);
+    return FALSE;
+}
 
-    pixbuf = gdk_pixbuf_scale_simple(pixbuf, allocation->width,
-                                     allocation->height, GDK_INTERP_BILINEAR);
-    g_free(allocation);
+/* Luma level l on the waveform, two levels to a row */
+static double scope_wave_y(gint l)
+{
+    return YUV_SCOPE_WAVE_TOP + (255 - l) / 2 + 0.5;
+}
 
-    cairo_t *cr;
-    cr = gdk_cairo_create(gtk_widget_get_window(widget));
-    gdk_cairo_set_source_pixbuf(cr, pixbuf, 0, 0);
+/*
+ * Scopes of the shown frame, from the producer, with the graticules on
+ * top: nominal black and white on the histogram and waveform, the
+ * neutral axes and 75% saturation circle on the vectorscope.
+ */
+static gboolean scope_draw(GtkWidget *widget, cairo_t *cr, gpointer data)
+{
+    struct ring_slot *slot;
+    static const double dash[] = { 2, 2 };
+    gdouble c = YUV_SCOPE_VECTOR_SIZE / 2.0;
 
-    g_object_unref(pixbuf);
+    if (ring.shown < 0 || !ring.slots[ring.shown].scoped)
+        return FALSE;
+    slot = &ring.slots[ring.shown];
 
+    cairo_set_source_surface(cr, slot->scope_rgb, 0, 0);
     cairo_paint(cr);
-    cairo_destroy(cr);
-    free(rgb_buf);
+
+    cairo_set_line_width(cr, 1);
+    cairo_set_source_rgba(cr, 0.9, 0.6, 0.2, 0.7);
+    cairo_set_dash(cr, dash, 2, 0);
+
+    cairo_move_to(cr, 16.5, 0);
+    cairo_line_to(cr, 16.5, YUV_SCOPE_HIST_HEIGHT);
+    cairo_move_to(cr, 235.5, 0);
+    cairo_line_to(cr, 235.5, YUV_SCOPE_HIST_HEIGHT);
+
+    cairo_move_to(cr, 0, scope_wave_y(235));
+    cairo_line_to(cr, YUV_SCOPE_WIDTH, scope_wave_y(235));
+    cairo_move_to(cr, 0, scope_wave_y(16));
+    cairo_line_to(cr, YUV_SCOPE_WIDTH, scope_wave_y(16));
+    cairo_stroke(cr);
+
+    cairo_set_dash(cr, NULL, 0, 0);
+    cairo_move_to(cr, c, YUV_SCOPE_VECTOR_TOP);
+    cairo_line_to(cr, c, YUV_SCOPE_VECTOR_TOP + YUV_SCOPE_VECTOR_SIZE);
+    cairo_move_to(cr, 0, YUV_SCOPE_VECTOR_TOP + c);
+    cairo_line_to(cr, YUV_SCOPE_VECTOR_SIZE, YUV_SCOPE_VECTOR_TOP + c);
+    cairo_stroke(cr);
+    cairo_arc(cr, c, YUV_SCOPE_VECTOR_TOP + c, 0.75 * 112, 0, 2 * G_PI);
+    cairo_stroke(cr);
 
     return FALSE;
 }
 
+/* The window follows the view, side by side is twice as wide */
+static void view_resize(void)
+{
+    gtk_widget_set_size_request(frame_cfg.draw_area, view_width(),
+                                frame_cfg.height);
+    gtk_window_resize(GTK_WINDOW(frame_cfg.window), 1, 1);
+}
+
+/* Moves the wipe split to x in the drawing area */
+static gboolean wipe_move(GtkWidget *widget, gdouble x)
+{
+    if (frame_cfg.view != VIEW_WIPE)
+        return FALSE;
+
+    frame_cfg.wipe = CLAMP(x / gtk_widget_get_allocated_width(widget), 0, 1);
+    gtk_widget_queue_draw(widget);
+
+    return TRUE;
+}
+
+/* Button 1 puts the split under the pointer, dragging moves it */
+static gboolean wipe_button_callback(GtkWidget *widget, GdkEventButton *event,
+                                     gpointer data)
+{
+    if (event->type != GDK_BUTTON_PRESS || event->button != 1)
+        return FALSE;
+
+    return wipe_move(widget, event->x);
+}
+
+static gboolean wipe_motion_callback(GtkWidget *widget, GdkEventMotion *event,
+                                     gpointer data)
+{
+    return wipe_move(widget, event->x);
+}
+
+/*
+ * s toggles the stage timings, w the scopes. Space pauses, the left and
+ * right arrows step a frame back or on. Comparing, v cycles the view and g the
+ * difference gain; both redraw the frame on screen without a re-read.
+ */
+static gboolean key_press_callback(GtkWidget *widget, GdkEventKey *event,
+                                   gpointer data)
+{
+    switch (event->keyval) {
+    case GDK_KEY_s:
+        frame_cfg.stats = !frame_cfg.stats;
+        break;
+    case GDK_KEY_space:
+        if (frame_cfg.live)
+            return FALSE;
+        ring_pause(!ring.paused);
+        update_title();
+        break;
+    case GDK_KEY_Left:
+    case GDK_KEY_Right:
+        if (frame_cfg.live)
+            return FALSE;
+        ring_step(event->keyval == GDK_KEY_Left ? -1 : 1);
+        update_title();
+        break;
+    case GDK_KEY_w:
+        if (frame_cfg.scope_area == NULL)
+            return FALSE;
+        g_atomic_int_set(&frame_cfg.scopes_shown,
+                         !g_atomic_int_get(&frame_cfg.scopes_shown));
+        gtk_widget_set_visible(frame_cfg.scope_area,
+                               g_atomic_int_get(&frame_cfg.scopes_shown));
+        break;
+    case GDK_KEY_v:
+        if (frame_cfg.cmp_fn == NULL)
+            return FALSE;
+        frame_cfg.view = (frame_cfg.view + 1) % VIEW_COUNT;
+        view_resize();
+        break;
+    case GDK_KEY_g:
+        if (frame_cfg.cmp_fn == NULL)
+            return FALSE;
+        frame_cfg.diff_shift = (frame_cfg.diff_shift + 1) % (MAX_DIFF_SHIFT + 1);
+        break;
+    default:
+        return FALSE;
+    }
+
+    gtk_widget_queue_draw(widget);
+
+    return TRUE;
+}
+
 gboolean draw_callback(GtkWidget *widget, cairo_t *cr, gpointer data)
 {
     /* Draw circle example */
@@ -165,144 +1994,284 @@ gboolean draw_callback(GtkWidget *widget, cairo_t *cr, gpointer data)
     return FALSE;
 }
 
-static gboolean
-time_handler(GtkWidget *widget)
+/* Paced by the GDK frame clock, presents whatever is due this tick */
+static gboolean tick_callback(GtkWidget *widget, GdkFrameClock *clock,
+                              gpointer data)
 {
-#if 0
-    time_t curtime;
-    struct tm *loctime;
+    static gboolean at_end = FALSE;
+    gint64 now, refresh_us;
+    int rc;
 
-    curtime = time(NULL);
-    loctime = localtime(&curtime);
-    strftime(buffer, 256, "%T", loctime);
-#endif
-    if (read_chunk() < 0) {
-        printf("Read file fail. %d\n");
-        return FALSE;
-    }
+    now = gdk_frame_clock_get_frame_time(clock);
+    gdk_frame_clock_get_refresh_info(clock, now, &refresh_us, NULL);
 
-    gtk_widget_queue_draw(widget);
+    rc = ring_present(now, refresh_us);
 
-    return TRUE;
+    /* Keep ticking at the end, the timeline can seek back */
+    if (rc < 0 && !at_end) {
+        printf("End of stream\n");
+        if (frame_cfg.benchmark)
+            gtk_main_quit();
+    }
+    at_end = rc < 0;
+
+    if (rc > 0) {
+        update_title();
+        update_timeline();
+        gtk_widget_queue_draw(widget);
+        if (frame_cfg.scope_area)
+            gtk_widget_queue_draw(frame_cfg.scope_area);
+    }
+    filmstrip_tick(rc > 0);
+
+    return G_SOURCE_CONTINUE;
 }
 
 static void print_help()
 {
     printf("Usage:\n");
-    printf("\tviewer file \n");
+    printf("\tviewer [-j threads] [-t threads] [-b ring_depth] [-r fps] [-m matrix] [-R range] [-C]\n"
+           "\t       [-S] [-T trace.json] [-c file] [-V step] [-M MB] [--backend gtk|null]\n"
+           "\t       [--benchmark] file|-\n");
+    printf("\tfile can also be - for stdin, a FIFO or a UNIX socket to show live,\n"
+           "\tframes go up as they arrive; shm:name attaches to a shared memory ring\n"
+           "\t(see yuv_shm_replay) and converts straight out of it\n");
+    printf("\t-r plays at fps instead of the stream timestamps (default %d without them)\n",
+           DEFAULT_FPS);
+    printf("\t-C verifies the payload CRC of v2 chunks\n");
+    printf("\t-M caps the cache of read and converted frames (default %d MB, 0 turns\n"
+           "\tit off); space pauses, the arrows step back and on through it\n",
+           DEFAULT_CACHE_MB);
+    printf("\t-c compares with another chunk stream frame by frame, showing PSNR and\n"
+           "\tSSIM per plane; v cycles side by side, wipe (drag the split) and\n"
+           "\tdifference, g cycles the difference gain. yuv_compare does it headless\n");
+    printf("\t-V shows a luma histogram, waveform and vectorscope of the YUV samples\n"
+           "\tnext to the picture (w toggles), counting every step-th sample and row\n");
+    printf("\t-t sets the filmstrip thumbnail threads (default one per CPU), 0 hides it\n");
+    printf("\t-S shows stage timings (s toggles), -T writes them as Chrome trace events\n");
+    printf("\t--backend gtk|null presents in a window (default) or nowhere\n");
+    printf("\t--benchmark plays every frame as fast as possible, by default on the\n"
+           "\tnull backend, and reports fps and read to present latency\n");
+    printf("\tmatrix: bt601 (default), bt709, bt2020; range: limited (default), full\n");
 }
 
-static void frame_cfg_init(int argc, char **argv)
+/*
+ * Producer thread: the newest frame in the shared ring, converted in
+ * place. Older ones still there are released unseen, unless benchmarking.
+ */
+static int read_shm(struct ring_slot *slot)
 {
-    frame_cfg.width = atoi(argv[2]);
-    frame_cfg.height = atoi(argv[3]);
+    const uint8_t *data;
+    struct yuv_chunk info;
+    uint64_t available;
+    gboolean quit;
+    int len, rc;
+
+    for (;;) {
+        /* Wake up now and then to notice ring_stop() */
+        rc = yuv_shm_wait(frame_cfg.shm, 100);
+        if (rc < 0) {
+            printf("Shared ring closed by the producer\n");
+            return -1;
+        }
+        if (rc == 0) {
+            g_mutex_lock(&ring.lock);
+            quit = ring.quit;
+            g_mutex_unlock(&ring.lock);
+            if (quit)
+                return -1;
+            continue;
+        }
+
+        /* A benchmark takes every frame */
+        while ((data = yuv_shm_peek(frame_cfg.shm, &available)) &&
+               available > 1 && !frame_cfg.benchmark) {
+            yuv_shm_release(frame_cfg.shm);
+            g_mutex_lock(&ring.lock);
+            ring.dropped++;
+            g_mutex_unlock(&ring.lock);
+        }
+
+        len = yuv_chunk_decode(data, yuv_shm_slot_size(frame_cfg.shm), &info);
+        if (len >= 0 && yuv_chunk_verify_header(&info) == 0 &&
+            len + (size_t) info.size <= yuv_shm_slot_size(frame_cfg.shm))
+            break;
+
+        printf("Bad chunk in the shared ring, skipped\n");
+        yuv_shm_release(frame_cfg.shm);
+    }
+
+    slot->width = info.width;
+    slot->height = info.height;
+    slot->format = info.format;
+    slot->timestamp_us = info.timestamp_us;
+    slot->src = data + len;
+    slot->read_us = g_get_monotonic_time();
+
+    if (frame_cfg.check_crc && yuv_chunk_check_crc(&info, slot->src) < 0) {
+        printf("CRC mismatch in frame %" G_GUINT64_FORMAT "\n", info.frame);
+        g_mutex_lock(&ring.lock);
+        ring.crc_errors++;
+        g_mutex_unlock(&ring.lock);
+    }
+
+    return 0;
 }
 
-static int verify_header(struct yuv_info *p)
+/* Producer thread: the same frame of the compared stream */
+static int read_compared(struct ring_slot *slot, gint frame)
 {
-    if (p->magic != 0x1234CCCC)
-        return -1;
+    struct yuv_chunk info;
 
-    if (p->size != (p->width * p->height * 3 / 2)) {
+    if (yuv_chunk_pread(frame_cfg.cmp_fd, frame_cfg.cmp_index.offsets[frame],
+                        &info, &slot->cmp_buf, &slot->cmp_size) < 0)
         return -1;
-    }
+
+    /* A frame that cannot be lined up is still shown, on its own */
+    slot->compared = info.width == slot->width &&
+                     info.height == slot->height &&
+                     info.format == slot->format;
+    if (!slot->compared)
+        printf("Frame %d: %ux%u %s against %ux%u %s, not compared\n",
+               frame + 1, slot->width, slot->height,
+               yuv_format_name(slot->format), info.width, info.height,
+               yuv_format_name(info.format));
+
     return 0;
 }
 
-static int read_chunk()
+/* Producer thread: reads chunk ring.next_frame into slot */
+static int read_chunk(struct ring_slot *slot)
 {
-    struct yuv_info info;
+    struct yuv_chunk info;
+    gint64 start = yuv_time_ns();
+    /* next_frame only changes on this thread */
+    gint frame = ring.next_frame;
     int rc = 0;
 
-    rc = fread(&info, 1, sizeof(info), frame_cfg.fp);
-    if (rc != sizeof(info)) {
-        if (feof(frame_cfg.fp)) {
-            printf("End of file\n");
-            return -1;
-        }
-        if (ferror(frame_cfg.fp)) {
-            printf("Error of file\n");
-            return -1;
-        }
-        perror("Read header error!");
-        printf("Error: rc=%d\n", rc);
-        return -1;
-    }
+    if (frame_cfg.shm)
+        return read_shm(slot);
 
-    if (verify_header(&info) < 0) {
-        printf("Header info error!\n");
+    if (frame >= frame_cfg.index.count) {
+        printf("End of file\n");
         return -1;
     }
 
-    frame_cfg.width = info.width;
-    frame_cfg.height = info.height;
+    if (yuv_chunk_pread(frame_cfg.fd, frame_cfg.index.offsets[frame], &info,
+                        &slot->buf, &slot->size) < 0)
+        return -1;
 
-    if (frame_cfg.buf == NULL) {
-        frame_cfg.buf = calloc(1, info.size);
-        if (frame_cfg.buf == NULL) {
-            perror("Memory calloc fail");
-            return -1;
-        }
-    }
-    else {
-        if (info.size != frame_cfg.size) {
-            frame_cfg.buf = realloc(frame_cfg.buf, info.size);
-            if (frame_cfg.buf == NULL) {
-                perror("Memory calloc fail");
-                return -1;
-            }
-            frame_cfg.size = info.size;
-        }
-    }
+    slot->width = info.width;
+    slot->height = info.height;
+    slot->format = info.format;
+    slot->timestamp_us = info.timestamp_us;
+    slot->src = slot->buf;
 
-    rc = fread(frame_cfg.buf, 1, info.size, frame_cfg.fp);
-    if (rc != info.size) {
-        printf("Header info error!\n");
+    if (frame_cfg.cmp_fn && read_compared(slot, frame) < 0)
         return -1;
+
+    start = yuv_stage_end(&stages[STAGE_READ], frame, start);
+
+    if (!frame_cfg.check_crc)
+        return 0;
+
+    /* Corrupt frames are still shown, just counted */
+    rc = yuv_chunk_check_crc(&info, slot->buf);
+    yuv_stage_end(&stages[STAGE_CRC], frame, start);
+    if (rc < 0) {
+        printf("CRC mismatch in frame %" G_GUINT64_FORMAT "\n", info.frame);
+        g_mutex_lock(&ring.lock);
+        ring.crc_errors++;
+        g_mutex_unlock(&ring.lock);
     }
+
     return 0;
 }
 
-int main(int argc, char *argv[])
+/*
+ * Presenters for the frames ring_present() hands out. init() runs once
+ * the first frame is ready, run() returns when playback is over.
+ */
+struct present_backend {
+    const char *name;
+    gboolean (*init)(int *argc, char ***argv);
+    void (*run)(void);
+};
+
+static gboolean gtk_backend_init(int *argc, char ***argv)
 {
     GtkWidget *window;
     GtkWidget *draw_area;
     GtkWidget *frame;
+    GtkWidget *vbox;
+    GtkWidget *hbox;
 
-    if (argc != 2) {
-        print_help();
-        return 0;
-    }
-
-    memset(&frame_cfg, 0, sizeof(frame_cfg));
-
-    if (open_file(argv[1]) < 0) {
-        printf("Open file fail.\n");
-        return 0;
-    }
-
-    if (read_chunk() < 0) {
-        printf("Read file fail.\n");
-        return 0;
+    if (!gtk_init_check(argc, argv)) {
+        printf("Cannot open display, try --backend null\n");
+        return FALSE;
     }
 
-    /* Below are GTK */
-    gtk_init(&argc, &argv);
-
     window = gtk_window_new(GTK_WINDOW_TOPLEVEL);
-    gtk_window_set_title(GTK_WINDOW (window), "Window");
+    frame_cfg.window = window;
+    update_title();
 
     /* Destroy */
     g_signal_connect(window, "destroy", G_CALLBACK(close_window), NULL);
+    g_signal_connect(window, "key-press-event",
+                     G_CALLBACK(key_press_callback), NULL);
 
     gtk_container_set_border_width(GTK_CONTAINER(window), 10);
 
+    vbox = gtk_box_new(GTK_ORIENTATION_VERTICAL, 5);
+    gtk_container_add(GTK_CONTAINER(window), vbox);
+
+    hbox = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 5);
+    gtk_box_pack_start(GTK_BOX(vbox), hbox, TRUE, TRUE, 0);
+
     frame = gtk_frame_new(NULL);
     gtk_frame_set_shadow_type(GTK_FRAME(frame), GTK_SHADOW_IN);
-    gtk_container_add(GTK_CONTAINER(window), frame);
+    gtk_box_pack_start(GTK_BOX(hbox), frame, TRUE, TRUE, 0);
+
+    /* Histogram, waveform and vectorscope right of the picture */
+    if (frame_cfg.scopes) {
+        frame_cfg.scope_area = gtk_drawing_area_new();
+        gtk_widget_set_size_request(frame_cfg.scope_area, YUV_SCOPE_WIDTH,
+                                    YUV_SCOPE_HEIGHT);
+        gtk_widget_set_valign(frame_cfg.scope_area, GTK_ALIGN_START);
+        gtk_box_pack_start(GTK_BOX(hbox), frame_cfg.scope_area, FALSE, FALSE, 0);
+        g_signal_connect(frame_cfg.scope_area, "draw", G_CALLBACK(scope_draw),
+                         NULL);
+    }
+
+    /* Timeline over the chunk index, seeks the producer */
+    if (frame_cfg.index.count > 1) {
+        frame_cfg.timeline = gtk_scale_new_with_range(GTK_ORIENTATION_HORIZONTAL,
+                                                      1, frame_cfg.index.count, 1);
+        gtk_scale_set_digits(GTK_SCALE(frame_cfg.timeline), 0);
+        gtk_box_pack_start(GTK_BOX(vbox), frame_cfg.timeline, FALSE, FALSE, 0);
+        frame_cfg.timeline_handler = g_signal_connect(frame_cfg.timeline,
+                                                      "value-changed",
+                                                      G_CALLBACK(timeline_changed),
+                                                      NULL);
+    }
+
+    /* Thumbnails of the whole stream under the timeline */
+    if (frame_cfg.index.count > 1 && frame_cfg.thumb_threads > 0)
+        filmstrip_create(vbox);
 
     draw_area = gtk_drawing_area_new();
-    gtk_widget_set_size_request(draw_area, frame_cfg.width / 1, frame_cfg.height / 1);
+    frame_cfg.draw_area = draw_area;
+    gtk_widget_add_tick_callback(draw_area, tick_callback, NULL, NULL);
+    gtk_widget_set_size_request(draw_area, view_width(), frame_cfg.height / 1);
+
+    if (frame_cfg.cmp_fn) {
+        gtk_widget_add_events(draw_area, GDK_BUTTON_PRESS_MASK |
+                                         GDK_BUTTON1_MOTION_MASK);
+        g_signal_connect(draw_area, "button-press-event",
+                         G_CALLBACK(wipe_button_callback), NULL);
+        g_signal_connect(draw_area, "motion-notify-event",
+                         G_CALLBACK(wipe_motion_callback), NULL);
+    }
 
     gtk_container_add(GTK_CONTAINER(frame), draw_area);
 
@@ -315,11 +2284,292 @@ int main(int argc, char *argv[])
                      G_CALLBACK(draw_callback), NULL);
 #endif
 
-    g_timeout_add(100, (GSourceFunc) time_handler, (gpointer) window);
     gtk_widget_show_all(window);
-    time_handler(window);
 
+    /* Frames are read as they arrive and go up on the next tick */
+    if (frame_cfg.live && !frame_cfg.shm) {
+        live.channel = g_io_channel_unix_new(live.fd);
+        g_io_add_watch(live.channel, G_IO_IN | G_IO_HUP | G_IO_ERR,
+                       live_callback, NULL);
+    }
+
+    return TRUE;
+}
+
+static void gtk_backend_run(void)
+{
     gtk_main();
+}
+
+static gboolean null_backend_init(int *argc, char ***argv)
+{
+    return TRUE;
+}
+
+/*
+ * No display: frames count as shown as soon as ring_present() swaps them
+ * in. Paced playback ticks every NULL_REFRESH_US, a benchmark waits on
+ * the producer only and live input on the fd.
+ */
+static void null_backend_run(void)
+{
+    int rc;
+
+    for (;;) {
+        if (frame_cfg.live && !frame_cfg.shm)
+            live_poll();
+        else if (frame_cfg.benchmark || frame_cfg.shm)
+            ring_wait_ready();
+
+        rc = ring_present(g_get_monotonic_time(), NULL_REFRESH_US);
+        if (rc < 0)
+            break;
+        if (rc > 0)
+            frame_presented();
+
+        if (!frame_cfg.benchmark && !frame_cfg.live)
+            g_usleep(NULL_REFRESH_US);
+    }
+    printf("End of stream\n");
+}
+
+static const struct present_backend backends[] = {
+    { "gtk", gtk_backend_init, gtk_backend_run },
+    { "null", null_backend_init, null_backend_run },
+};
+
+#define BACKEND_COUNT (int) (sizeof(backends) / sizeof(backends[0]))
+
+static const struct present_backend *backend_find(const char *name)
+{
+    int i;
+
+    for (i = 0; i < BACKEND_COUNT; i++) {
+        if (!strcmp(backends[i].name, name))
+            return &backends[i];
+    }
+
+    return NULL;
+}
+
+static const struct option long_options[] = {
+    { "backend", required_argument, NULL, 'O' },
+    { "benchmark", no_argument, NULL, 'B' },
+    { NULL, 0, NULL, 0 }
+};
+
+int main(int argc, char *argv[])
+{
+    const struct present_backend *backend = NULL;
+    int opt, matrix = YUV_MATRIX_BT601, range = YUV_RANGE_LIMITED;
+    char *trace_fn = NULL;
+    gint cache_mb = DEFAULT_CACHE_MB;
+
+    memset(&frame_cfg, 0, sizeof(frame_cfg));
+    frame_cfg.ring_depth = DEFAULT_RING_DEPTH;
+    frame_cfg.thumb_threads = yuv_cpu_count();
+    frame_cfg.wipe = 0.5;
+    frame_cfg.diff_shift = 2;
+
+    while ((opt = getopt_long(argc, argv, "j:t:b:r:m:R:CST:c:V:M:", long_options,
+                              NULL)) != -1) {
+        switch (opt) {
+        case 'O':
+            backend = backend_find(optarg);
+            if (backend == NULL) {
+                print_help();
+                return 0;
+            }
+            break;
+        case 'B':
+            frame_cfg.benchmark = TRUE;
+            break;
+        case 'S':
+            frame_cfg.stats = TRUE;
+            break;
+        case 'T':
+            trace_fn = optarg;
+            break;
+        case 'm':
+            matrix = yuv_matrix_parse(optarg);
+            if (matrix < 0) {
+                print_help();
+                return 0;
+            }
+            break;
+        case 'R':
+            range = yuv_range_parse(optarg);
+            if (range < 0) {
+                print_help();
+                return 0;
+            }
+            break;
+        case 'r':
+            frame_cfg.fps = g_ascii_strtod(optarg, NULL);
+            if (frame_cfg.fps <= 0) {
+                print_help();
+                return 0;
+            }
+            break;
+        case 'C':
+            frame_cfg.check_crc = TRUE;
+            break;
+        case 'c':
+            frame_cfg.cmp_fn = optarg;
+            break;
+        case 'M':
+            cache_mb = atoi(optarg);
+            if (cache_mb < 0) {
+                print_help();
+                return 0;
+            }
+            break;
+        case 'V':
+            frame_cfg.scope_step = atoi(optarg);
+            if (frame_cfg.scope_step < 1) {
+                print_help();
+                return 0;
+            }
+            break;
+        case 'j':
+            frame_cfg.threads = atoi(optarg);
+            break;
+        case 't':
+            frame_cfg.thumb_threads = atoi(optarg);
+            break;
+        case 'b':
+            frame_cfg.ring_depth = atoi(optarg);
+            break;
+        default:
+            print_help();
+            return 0;
+        }
+    }
+
+    /* One slot is always on screen */
+    if (argc - optind != 1 || frame_cfg.ring_depth < 2) {
+        print_help();
+        return 0;
+    }
+
+    if (trace_fn && yuv_trace_open(trace_fn) < 0)
+        return 0;
+
+    /* Benchmarks run headless unless a backend is asked for */
+    if (backend == NULL)
+        backend = backend_find(frame_cfg.benchmark ? "null" : "gtk");
+
+    frame_cfg.fn = argv[optind];
+    if (!strncmp(frame_cfg.fn, "shm:", 4)) {
+        frame_cfg.shm = yuv_shm_open(frame_cfg.fn + 4);
+        if (frame_cfg.shm == NULL) {
+            printf("Attach shared ring fail, is the producer running?\n");
+            return 0;
+        }
+        frame_cfg.live = TRUE;
+    }
+    else {
+        live.fd = live_open(frame_cfg.fn);
+        frame_cfg.live = live.fd >= 0;
+    }
+
+    /* Lockstep needs both streams indexed */
+    if (frame_cfg.cmp_fn && frame_cfg.live) {
+        printf("Compare needs two chunk files, not live input\n");
+        return 0;
+    }
+
+    if (frame_cfg.benchmark || frame_cfg.live)
+        bench.latency_us = g_array_new(FALSE, FALSE, sizeof(gint64));
+
+    frame_cfg.coefs = yuv_coefs_get(matrix, range);
+    frame_cfg.pool = yuv_pool_create(frame_cfg.threads);
+    /* Live frames are never read twice */
+    if (cache_mb > 0 && !frame_cfg.live) {
+        frame_cfg.cache = yuv_cache_create((size_t) cache_mb << 20);
+        if (frame_cfg.cache == NULL)
+            return 0;
+    }
+    if (frame_cfg.scope_step) {
+        frame_cfg.scopes = yuv_scopes_create();
+        if (frame_cfg.scopes == NULL)
+            return 0;
+        frame_cfg.scopes_shown = TRUE;
+    }
+    printf("Conversion kernel: %s, %d threads, %s %s range\n",
+           yuv_kernel_select()->name, yuv_pool_threads(frame_cfg.pool),
+           yuv_matrix_name(matrix), yuv_range_name(range));
+
+    if (frame_cfg.shm) {
+        if (ring_start(frame_cfg.ring_depth) < 0 || !ring_wait_first()) {
+            printf("Read shared ring fail.\n");
+            return 0;
+        }
+    }
+    else if (frame_cfg.live) {
+        if (live_start(live.fd) < 0 || ring_start(frame_cfg.ring_depth) < 0 ||
+            !live_wait_first()) {
+            printf("Read live input fail.\n");
+            return 0;
+        }
+    }
+    else {
+        if (open_file(frame_cfg.fn) < 0) {
+            printf("Open file fail.\n");
+            return 0;
+        }
+
+        /* v1 streams carry no timestamps */
+        if (frame_cfg.fps == 0 && frame_cfg.index.timestamps == NULL)
+            frame_cfg.fps = DEFAULT_FPS;
+
+        if (ring_start(frame_cfg.ring_depth) < 0 || !ring_wait_first()) {
+            printf("Read file fail.\n");
+            return 0;
+        }
+    }
+
+    /* The first frame goes up on the first tick, size the window for it */
+    frame_cfg.width = ring.slots[ring.tail].width;
+    frame_cfg.height = ring.slots[ring.tail].height;
+
+    if (!backend->init(&argc, &argv))
+        return 0;
+
+    backend->run();
+
+    filmstrip_stop();
+    ring_stop();
+    if (bench.latency_us)
+        bench_report();
+    if (frame_cfg.cmp_fn)
+        compare_report();
+    yuv_stage_print(stages, STAGE_COUNT);
+    yuv_trace_close();
+    yuv_index_free(&frame_cfg.index);
+    if (frame_cfg.cmp_fn) {
+        yuv_index_free(&frame_cfg.cmp_index);
+        close(frame_cfg.cmp_fd);
+    }
+    if (live.channel)
+        g_io_channel_unref(live.channel);
+    if (frame_cfg.shm)
+        yuv_shm_close(frame_cfg.shm);
+    else
+        close(frame_cfg.live ? live.fd : frame_cfg.fd);
+    if (frame_cfg.cache) {
+        struct yuv_cache_stats cache;
+
+        yuv_cache_get_stats(frame_cfg.cache, &cache);
+        printf("Cache: %" G_GUINT64_FORMAT " hits, %" G_GUINT64_FORMAT
+               " misses\n", cache.hits, cache.misses);
+        yuv_cache_destroy(frame_cfg.cache);
+    }
+    yuv_scopes_destroy(frame_cfg.scopes);
+    cairo_surface_destroy(frame_cfg.diff_rgb);
+    yuv_pool_destroy(frame_cfg.pool);
+    if (bench.latency_us)
+        g_array_free(bench.latency_us, TRUE);
 
     return 0;
 }
@@ -5,146 +5,687 @@
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
+#include <limits.h>
+#include <stdint.h>
+#include <math.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
 #include <unistd.h>
 
+#include "yuv_convert.h"
+#include "yuv_pool.h"
+#include "yuv_trace.h"
+
 struct viewer_cfg {
     int width;
     int height;
-    gint channel;
+    enum yuv_format format;
+    const struct yuv_coefs *coefs;
+    gint threads;
+    enum yuv_scale_filter filter;
+    gboolean stats;     /* stage timings drawn over the frame */
+    int frame_id;
+    int frames;
+    size_t frame_size;
+    guchar *map;
+    size_t map_size;
+    char *fn;
+    GtkWidget *window;
+    GtkWidget *draw_area;
+    struct yuv_pool *pool;
+};
+
+/* Frames past the current one that are hinted to the kernel */
+#define PREFETCH_FRAMES 4
+
+enum viewer_stage {
+    STAGE_CONVERT,      /* scaled conversion into the cached surface */
+    STAGE_PAINT,
+    STAGE_COUNT
+};
+
+static struct yuv_stage stages[STAGE_COUNT] = {
+    { "convert" }, { "paint" },
+};
+
+/*
+ * Zoomed view: the frame is a canvas scaled by view_zoom(level), cut in
+ * TILE_SIZE tiles that are converted when first visible and kept in an
+ * LRU cache. Tile conversion cost follows what is on screen, not the
+ * frame size. Not zoomed, the frame is fit to the window as a whole.
+ */
+#define TILE_SIZE 256
+#define TILE_CACHE_MIN 96       /* 24 MB, grown to what the window shows */
+#define ZOOM_STEPS 4            /* levels per doubling */
+#define ZOOM_MIN (-4 * ZOOM_STEPS)
+#define ZOOM_MAX (5 * ZOOM_STEPS)
+
+struct tile {
+    cairo_surface_t *surface;
+    int frame_id;
+    int level;
+    enum yuv_scale_filter filter;
+    int tx;
+    int ty;
+    unsigned int used;      /* LRU clock, 0 for a free slot */
+};
+
+struct viewport {
+    gboolean zoomed;
+    int level;
+    int x;                  /* canvas position of the widget's top left */
+    int y;
+    gboolean dragging;
+    double drag_x;
+    double drag_y;
+    struct tile *tiles;
+    int tile_count;
+    unsigned int clock;
+    guint64 hits;
+    guint64 misses;
 };
 
 struct viewer_cfg frame_cfg;
-guchar *input_buf = NULL;
-int *rgb_buf = NULL;
+const guchar *input_buf = NULL;
+static struct viewport view;
 
 static int open_file(char *fn)
 {
-    FILE *fp = NULL;
     struct stat st;
-    unsigned int tsize = (frame_cfg.width * frame_cfg.height * 3 / 2);
+    int fd;
+
+    frame_cfg.frame_size = yuv_format_frame_size(frame_cfg.format,
+                                                 frame_cfg.width, frame_cfg.height);
+
+    fd = open(fn, O_RDONLY);
+    if (fd < 0) {
+        perror("File open fail!");
+        return -1;
+    }
 
-    if (stat(fn, &st) < 0) {
+    if (fstat(fd, &st) < 0) {
         perror("check_file_size");
+        close(fd);
         return -1;
     }
 
-    if (st.st_size != tsize) {
+    if (frame_cfg.frame_size == 0 || (uint64_t) st.st_size < frame_cfg.frame_size) {
         printf("File size is not match resolution setting!\n");
+        close(fd);
         return -1;
     }
 
-    fp = fopen(fn, "r");
+    /* The whole file is mapped, which needs a 64-bit build for big captures */
+    if ((uint64_t) st.st_size > SIZE_MAX ||
+        (uint64_t) st.st_size / frame_cfg.frame_size > INT_MAX) {
+        printf("File is too large to map on this system\n");
+        close(fd);
+        return -1;
+    }
 
-    if (!fp) {
-        perror("File open fail!");
+    /* Raw captures are frames back to back */
+    frame_cfg.frames = st.st_size / frame_cfg.frame_size;
+    frame_cfg.map_size = (size_t) frame_cfg.frames * frame_cfg.frame_size;
+    if ((size_t) st.st_size != frame_cfg.map_size)
+        printf("Ignoring %zu trailing bytes\n",
+               (size_t) st.st_size - frame_cfg.map_size);
+
+    frame_cfg.map = mmap(NULL, frame_cfg.map_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if (frame_cfg.map == MAP_FAILED) {
+        perror("File mmap fail");
+        frame_cfg.map = NULL;
         return -1;
     }
 
-    fread(input_buf, tsize, 1, fp);
+    /* Access jumps around, read ahead is hinted per frame in set_frame() */
+    madvise(frame_cfg.map, frame_cfg.map_size, MADV_RANDOM);
 
-    fclose(fp);
+    printf("%s: %d frames of %dx%d\n", fn, frame_cfg.frames,
+           frame_cfg.width, frame_cfg.height);
     return 0;
 }
 
+static double view_zoom(int level)
+{
+    return pow(2.0, (double) level / ZOOM_STEPS);
+}
 
-/* Surface to store current scribbles */
-static void close_window(void)
+static void update_title(void)
+{
+    gchar *title;
+
+    if (frame_cfg.window == NULL)
+        return;
+
+    if (view.zoomed)
+        title = g_strdup_printf("%s [%d/%d] %.0f%%", frame_cfg.fn,
+                                frame_cfg.frame_id + 1, frame_cfg.frames,
+                                view_zoom(view.level) * 100);
+    else
+        title = g_strdup_printf("%s [%d/%d]", frame_cfg.fn,
+                                frame_cfg.frame_id + 1, frame_cfg.frames);
+    gtk_window_set_title(GTK_WINDOW(frame_cfg.window), title);
+    g_free(title);
+}
+
+static void set_frame(int id)
+{
+    size_t page = sysconf(_SC_PAGESIZE);
+    size_t start, end;
+
+    if (id >= frame_cfg.frames)
+        id = frame_cfg.frames - 1;
+    if (id < 0)
+        id = 0;
+
+    frame_cfg.frame_id = id;
+    input_buf = frame_cfg.map + (size_t) id * frame_cfg.frame_size;
+
+    /* This frame and the next few, page aligned */
+    start = (size_t) id * frame_cfg.frame_size;
+    end = start + (PREFETCH_FRAMES + 1) * frame_cfg.frame_size;
+    if (end > frame_cfg.map_size)
+        end = frame_cfg.map_size;
+    start &= ~(page - 1);
+    madvise(frame_cfg.map + start, end - start, MADV_WILLNEED);
+
+    update_title();
+}
+
+/*
+ * Last converted frame. Redraws with the same key are a plain paint of
+ * this surface; a new frame at the same size reuses the surface memory.
+ */
+struct frame_cache {
+    cairo_surface_t *surface;
+    int frame_id;
+    int width;
+    int height;
+    enum yuv_scale_filter filter;
+};
+
+static struct frame_cache cache = { NULL, -1, 0, 0, 0 };
+
+static void frame_cache_release(void)
 {
-    if (input_buf) {
-        free(input_buf);
+    if (cache.surface)
+        cairo_surface_destroy(cache.surface);
+    cache.surface = NULL;
+    cache.frame_id = -1;
+}
+
+static cairo_surface_t *frame_cache_get(int width, int height)
+{
+    int64_t start;
+
+    if (cache.surface && cache.frame_id == frame_cfg.frame_id &&
+        cache.width == width && cache.height == height &&
+        cache.filter == frame_cfg.filter)
+        return cache.surface;
+
+    if (cache.surface == NULL || cache.width != width || cache.height != height) {
+        frame_cache_release();
+
+        /* RGB24 is the same packed 0xXXRRGGBB the converter writes */
+        cache.surface = cairo_image_surface_create(CAIRO_FORMAT_RGB24,
+                                                   width, height);
+        if (cairo_surface_status(cache.surface) != CAIRO_STATUS_SUCCESS) {
+            printf("Surface create %dx%d fail\n", width, height);
+            frame_cache_release();
+            return NULL;
+        }
+        cache.width = width;
+        cache.height = height;
     }
 
-    gtk_main_quit();
+    start = yuv_time_ns();
+    cairo_surface_flush(cache.surface);
+    yuv_rgb_conversion_scaled(frame_cfg.pool,
+                              (uint32_t *) cairo_image_surface_get_data(cache.surface),
+                              cairo_image_surface_get_stride(cache.surface),
+                              width, height, input_buf, frame_cfg.format,
+                              frame_cfg.coefs, frame_cfg.width, frame_cfg.height,
+                              frame_cfg.filter);
+    cairo_surface_mark_dirty(cache.surface);
+    yuv_stage_end(&stages[STAGE_CONVERT], frame_cfg.frame_id, start);
+
+    cache.frame_id = frame_cfg.frame_id;
+    cache.filter = frame_cfg.filter;
+
+    return cache.surface;
 }
 
-void yuv_rgb_conversion(int *rgb, guchar *yuv420sp, int width, int height)
+static void canvas_size(int level, int *width, int *height)
 {
-    int frameSize = width * height;
-    int i, j, yp;
-
-    for (j = 0, yp = 0; j < height; j++) {
-        int uvp = frameSize + (j >> 1) * width, u = 0, v = 0;
-        for (i = 0; i < width; i++, yp++) {
-            int y = (0xff & ((int) yuv420sp[yp])) - 16;
-            if (y < 0) y = 0;
-            if ((i & 1) == 0) {
-                v = (0xff & yuv420sp[uvp++]) - 128;
-                u = (0xff & yuv420sp[uvp++]) - 128;
-            }
+    double zoom = view_zoom(level);
+
+    *width = MAX(1, (int) (frame_cfg.width * zoom + 0.5));
+    *height = MAX(1, (int) (frame_cfg.height * zoom + 0.5));
+}
+
+/* Keeps the canvas on screen, centered on an axis where it is smaller */
+static void view_clamp(int width, int height)
+{
+    int cw, ch;
+
+    canvas_size(view.level, &cw, &ch);
+
+    if (cw <= width)
+        view.x = -(width - cw) / 2;
+    else
+        view.x = CLAMP(view.x, 0, cw - width);
+
+    if (ch <= height)
+        view.y = -(height - ch) / 2;
+    else
+        view.y = CLAMP(view.y, 0, ch - height);
+}
 
-            int y1192 = 1192 * y;
-            int r = (y1192 + 1634 * v);
-            int g = (y1192 - 833 * v - 400 * u);
-            int b = (y1192 + 2066 * u);
+/* Largest level that still fits the whole frame in width x height */
+static int view_fit_level(int width, int height)
+{
+    int level;
 
-            if (r < 0) r = 0;
-            else if (r > 262143) r = 262143;
-            if (g < 0) g = 0;
-            else if (g > 262143) g = 262143;
-            if (b < 0) b = 0;
-            else if (b > 262143) b = 262143;
+    for (level = ZOOM_MAX; level > ZOOM_MIN; level--) {
+        if (frame_cfg.width * view_zoom(level) <= width &&
+            frame_cfg.height * view_zoom(level) <= height)
+            break;
+    }
 
-            rgb[yp] = 0xff000000 | ((r << 6) & 0xff0000) | ((g >> 2) & 0xff00) | ((b >> 10) & 0xff);
+    return level;
+}
+
+/*
+ * Zooms to level keeping the frame pixel under px, py in place. Zooming
+ * out to the fit level or below goes back to the fit view.
+ */
+static void view_zoom_at(double px, double py, int level)
+{
+    int width = gtk_widget_get_allocated_width(frame_cfg.draw_area);
+    int height = gtk_widget_get_allocated_height(frame_cfg.draw_area);
+    double sx, sy, zoom;
+
+    if (level <= view_fit_level(width, height)) {
+        view.zoomed = FALSE;
+        update_title();
+        gtk_widget_queue_draw(frame_cfg.draw_area);
+        return;
+    }
+
+    /* Frame position under the pointer */
+    if (view.zoomed) {
+        zoom = view_zoom(view.level);
+        sx = (view.x + px) / zoom;
+        sy = (view.y + py) / zoom;
+    }
+    else {
+        sx = px * frame_cfg.width / width;
+        sy = py * frame_cfg.height / height;
+    }
+
+    view.zoomed = TRUE;
+    view.level = MIN(level, ZOOM_MAX);
+    zoom = view_zoom(view.level);
+    view.x = (int) (sx * zoom - px);
+    view.y = (int) (sy * zoom - py);
+    view_clamp(width, height);
+
+    update_title();
+    gtk_widget_queue_draw(frame_cfg.draw_area);
+}
+
+static void view_zoom_step(double px, double py, int step)
+{
+    int width = gtk_widget_get_allocated_width(frame_cfg.draw_area);
+    int height = gtk_widget_get_allocated_height(frame_cfg.draw_area);
+    int level = view.zoomed ? view.level : view_fit_level(width, height);
+
+    view_zoom_at(px, py, level + step);
+}
+
+static void tile_cache_release(void)
+{
+    int i;
+
+    for (i = 0; i < view.tile_count; i++) {
+        if (view.tiles[i].surface)
+            cairo_surface_destroy(view.tiles[i].surface);
+        view.tiles[i].surface = NULL;
+        view.tiles[i].used = 0;
+    }
+}
+
+/*
+ * Room for every tile a width x height widget can show at any scroll
+ * position, plus a ring around it for panning. With fewer slots each
+ * draw would evict the tiles it needs next and nothing would be reused.
+ */
+static int tile_cache_reserve(int width, int height)
+{
+    int nx = (width + TILE_SIZE - 1) / TILE_SIZE + 3;
+    int ny = (height + TILE_SIZE - 1) / TILE_SIZE + 3;
+    int count = MAX(nx * ny, TILE_CACHE_MIN);
+    struct tile *tiles;
+
+    if (count <= view.tile_count)
+        return 0;
+
+    tiles = realloc(view.tiles, count * sizeof(*tiles));
+    if (tiles == NULL) {
+        perror("Memory tile cache realloc fail");
+        return -1;
+    }
+    memset(tiles + view.tile_count, 0,
+           (count - view.tile_count) * sizeof(*tiles));
+    view.tiles = tiles;
+    view.tile_count = count;
+
+    return 0;
+}
+
+/*
+ * Tile tx, ty of the canvas at the current level, converted on a miss
+ * into the least recently used slot. Magnified tiles sample nearest so
+ * single pixels stay sharp.
+ */
+static cairo_surface_t *tile_get(int tx, int ty)
+{
+    enum yuv_scale_filter filter = view.level > 0 ? YUV_SCALE_NEAREST :
+                                                    frame_cfg.filter;
+    struct tile *t, *victim = &view.tiles[0];
+    int cw, ch, x, y, i;
+    int64_t start;
+
+    view.clock++;
+    for (i = 0; i < view.tile_count; i++) {
+        t = &view.tiles[i];
+        if (t->used && t->frame_id == frame_cfg.frame_id &&
+            t->level == view.level && t->filter == filter &&
+            t->tx == tx && t->ty == ty) {
+            t->used = view.clock;
+            view.hits++;
+            return t->surface;
         }
+        if (t->used < victim->used)
+            victim = t;
     }
+
+    t = victim;
+    t->used = 0;
+    if (t->surface == NULL) {
+        t->surface = cairo_image_surface_create(CAIRO_FORMAT_RGB24,
+                                                TILE_SIZE, TILE_SIZE);
+        if (cairo_surface_status(t->surface) != CAIRO_STATUS_SUCCESS) {
+            printf("Tile surface create fail\n");
+            cairo_surface_destroy(t->surface);
+            t->surface = NULL;
+            return NULL;
+        }
+    }
+
+    canvas_size(view.level, &cw, &ch);
+    x = tx * TILE_SIZE;
+    y = ty * TILE_SIZE;
+
+    start = yuv_time_ns();
+    cairo_surface_flush(t->surface);
+    yuv_rgb_conversion_scaled_rect(frame_cfg.pool,
+                                   (uint32_t *) cairo_image_surface_get_data(t->surface),
+                                   cairo_image_surface_get_stride(t->surface),
+                                   cw, ch, x, y, MIN(TILE_SIZE, cw - x),
+                                   MIN(TILE_SIZE, ch - y), input_buf,
+                                   frame_cfg.format, frame_cfg.coefs,
+                                   frame_cfg.width, frame_cfg.height, filter);
+    cairo_surface_mark_dirty(t->surface);
+    yuv_stage_end(&stages[STAGE_CONVERT], frame_cfg.frame_id, start);
+
+    t->frame_id = frame_cfg.frame_id;
+    t->level = view.level;
+    t->filter = filter;
+    t->tx = tx;
+    t->ty = ty;
+    t->used = view.clock;
+    view.misses++;
+
+    return t->surface;
 }
 
-static void rgb_buf_create()
+/* Only the tiles that intersect the widget are looked up */
+static void draw_zoomed(cairo_t *cr, int width, int height)
 {
-    printf("Buffer create %dx%d ch:%d\n", 
-            frame_cfg.width, frame_cfg.height, frame_cfg.channel);
-    rgb_buf = calloc(1, frame_cfg.width * frame_cfg.height * frame_cfg.channel);
+    cairo_surface_t *surface;
+    int cw, ch, tx, ty, tx0, tx1, ty0, ty1, x, y;
+
+    view_clamp(width, height);
+    canvas_size(view.level, &cw, &ch);
 
-    if (rgb_buf == NULL) {
-        perror("Memory rgb calloc fail");
+    cairo_set_source_rgb(cr, 0.2, 0.2, 0.2);
+    cairo_paint(cr);
+
+    if (tile_cache_reserve(width, height) < 0 && view.tile_count == 0)
         return;
+
+    tx0 = MAX(view.x, 0) / TILE_SIZE;
+    ty0 = MAX(view.y, 0) / TILE_SIZE;
+    tx1 = (MIN(view.x + width, cw) - 1) / TILE_SIZE;
+    ty1 = (MIN(view.y + height, ch) - 1) / TILE_SIZE;
+
+    for (ty = ty0; ty <= ty1; ty++) {
+        for (tx = tx0; tx <= tx1; tx++) {
+            surface = tile_get(tx, ty);
+            if (surface == NULL)
+                continue;
+
+            x = tx * TILE_SIZE - view.x;
+            y = ty * TILE_SIZE - view.y;
+            cairo_set_source_surface(cr, surface, x, y);
+            cairo_rectangle(cr, x, y, MIN(TILE_SIZE, cw - tx * TILE_SIZE),
+                            MIN(TILE_SIZE, ch - ty * TILE_SIZE));
+            cairo_fill(cr);
+        }
     }
+}
 
-    yuv_rgb_conversion(rgb_buf, input_buf, frame_cfg.width, frame_cfg.height);
+/* Surface to store current scribbles */
+static void close_window(void)
+{
+    if (frame_cfg.map) {
+        munmap(frame_cfg.map, frame_cfg.map_size);
+    }
 
-    return;
+    if (view.hits + view.misses)
+        printf("Tiles: %" G_GUINT64_FORMAT " converted, %" G_GUINT64_FORMAT
+               " reused\n", view.misses, view.hits);
+    tile_cache_release();
+    free(view.tiles);
+    frame_cache_release();
+    yuv_pool_destroy(frame_cfg.pool);
+    yuv_stage_print(stages, STAGE_COUNT);
+    yuv_trace_close();
+    gtk_main_quit();
 }
 
-gboolean expose_event_callback(GtkWidget *widget,
-                                 GdkEventExpose *event,
-                                 gpointer data)
+/* Stage timings in the top left corner */
+static void draw_stats(cairo_t *cr)
 {
-    GdkPixbuf *pixbuf;
-    guchar *pixel;
+    char text[256];
+    char *line, *next;
+    double y = 16;
 
-    pixbuf = gdk_pixbuf_new(GDK_COLORSPACE_RGB, 
-            TRUE, 8, frame_cfg.width, frame_cfg.height);
-    g_assert(gdk_pixbuf_get_colorspace (pixbuf) == GDK_COLORSPACE_RGB);
+    yuv_stage_format(text, sizeof(text), stages, STAGE_COUNT);
 
-    frame_cfg.channel = gdk_pixbuf_get_n_channels(pixbuf);
+    cairo_set_source_rgba(cr, 0, 0, 0, 0.6);
+    cairo_rectangle(cr, 0, 0, 280, 8 + 14 * (STAGE_COUNT + 1));
+    cairo_fill(cr);
 
-    pixel = gdk_pixbuf_get_pixels(pixbuf);
+    cairo_select_font_face(cr, "monospace", CAIRO_FONT_SLANT_NORMAL,
+                           CAIRO_FONT_WEIGHT_NORMAL);
+    cairo_set_font_size(cr, 12);
+    cairo_set_source_rgb(cr, 1, 1, 1);
+    cairo_move_to(cr, 6, y);
+    cairo_show_text(cr, "stage       last     avg     max");
+
+    for (line = text; line; line = next) {
+        next = strchr(line, '\n');
+        if (next)
+            *next++ = '\0';
+        y += 14;
+        cairo_move_to(cr, 6, y);
+        cairo_show_text(cr, line);
+    }
+}
+
+gboolean expose_event_callback(GtkWidget *widget, cairo_t *cr, gpointer data)
+{
+    cairo_surface_t *surface;
+    int width = gtk_widget_get_allocated_width(widget);
+    int height = gtk_widget_get_allocated_height(widget);
+    int64_t start;
+
+    if (view.zoomed) {
+        /* Tile conversions are timed on their own, paint includes them */
+        start = yuv_time_ns();
+        draw_zoomed(cr, width, height);
+        yuv_stage_end(&stages[STAGE_PAINT], frame_cfg.frame_id, start);
+    }
+    else {
+        surface = frame_cache_get(width, height);
+        if (surface == NULL)
+            return FALSE;
+
+        start = yuv_time_ns();
+        cairo_set_source_surface(cr, surface, 0, 0);
+        cairo_paint(cr);
+        yuv_stage_end(&stages[STAGE_PAINT], frame_cfg.frame_id, start);
+    }
+
+    if (frame_cfg.stats)
+        draw_stats(cr);
+
+    return FALSE;
+}
+
+/*
+ * Left/Right step one frame, Page Up/Down ten, Home/End jump to the ends.
+ * Typing a frame number and Enter jumps straight to it. s toggles the
+ * stage timings, +/- zoom around the center and f fits the frame again.
+ */
+static gboolean key_press_callback(GtkWidget *widget, GdkEventKey *event,
+                                   gpointer data)
+{
+    static int goto_number = -1;
+    int id = frame_cfg.frame_id;
+
+    if (event->keyval >= GDK_KEY_0 && event->keyval <= GDK_KEY_9) {
+        if (goto_number < 0)
+            goto_number = 0;
+        if (goto_number < frame_cfg.frames)
+            goto_number = goto_number * 10 + (event->keyval - GDK_KEY_0);
+        return TRUE;
+    }
 
-    rgb_buf_create();
-    if (rgb_buf == NULL)
+    switch (event->keyval) {
+    case GDK_KEY_Return:
+    case GDK_KEY_KP_Enter:
+        if (goto_number < 0)
+            return FALSE;
+        id = goto_number - 1;
+        break;
+    case GDK_KEY_Right:
+    case GDK_KEY_space:
+        id++;
+        break;
+    case GDK_KEY_Left:
+        id--;
+        break;
+    case GDK_KEY_Page_Down:
+        id += 10;
+        break;
+    case GDK_KEY_Page_Up:
+        id -= 10;
+        break;
+    case GDK_KEY_Home:
+        id = 0;
+        break;
+    case GDK_KEY_End:
+        id = frame_cfg.frames - 1;
+        break;
+    case GDK_KEY_s:
+        frame_cfg.stats = !frame_cfg.stats;
+        break;
+    case GDK_KEY_plus:
+    case GDK_KEY_equal:
+    case GDK_KEY_KP_Add:
+    case GDK_KEY_minus:
+    case GDK_KEY_KP_Subtract:
+        view_zoom_step(gtk_widget_get_allocated_width(frame_cfg.draw_area) / 2.0,
+                       gtk_widget_get_allocated_height(frame_cfg.draw_area) / 2.0,
+                       event->keyval == GDK_KEY_minus ||
+                       event->keyval == GDK_KEY_KP_Subtract ? -1 : 1);
+        break;
+    case GDK_KEY_f:
+        view.zoomed = FALSE;
+        update_title();
+        break;
+    default:
+        goto_number = -1;
         return FALSE;
+    }
 
-    memcpy(pixel, rgb_buf, 
-            (frame_cfg.width * frame_cfg.height * frame_cfg.channel));
+    goto_number = -1;
+    set_frame(id);
+    gtk_widget_queue_draw(frame_cfg.draw_area);
 
-    GtkAllocation *allocation = g_new0(GtkAllocation, 1);
-    gtk_widget_get_allocation(GTK_WIDGET(widget), allocation);
+    return TRUE;
+}
 
-    pixbuf = gdk_pixbuf_scale_simple(pixbuf, allocation->width,
-                                     allocation->height, GDK_INTERP_BILINEAR);
-    g_free(allocation);
+/* The wheel zooms around the pointer */
+static gboolean scroll_callback(GtkWidget *widget, GdkEventScroll *event,
+                                gpointer data)
+{
+    if (event->direction == GDK_SCROLL_UP)
+        view_zoom_step(event->x, event->y, 1);
+    else if (event->direction == GDK_SCROLL_DOWN)
+        view_zoom_step(event->x, event->y, -1);
+    else if (event->direction == GDK_SCROLL_SMOOTH && event->delta_y != 0)
+        view_zoom_step(event->x, event->y, event->delta_y < 0 ? 1 : -1);
+
+    return TRUE;
+}
 
-    cairo_t *cr;
-    cr = gdk_cairo_create(gtk_widget_get_window(widget));
-    gdk_cairo_set_source_pixbuf(cr, pixbuf, 0, 0);
+/* Dragging with the first button pans a zoomed view */
+static gboolean button_callback(GtkWidget *widget, GdkEventButton *event,
+                                gpointer data)
+{
+    if (event->button != 1)
+        return FALSE;
 
-    g_object_unref(pixbuf);
+    view.dragging = event->type == GDK_BUTTON_PRESS;
+    view.drag_x = event->x;
+    view.drag_y = event->y;
 
-    cairo_paint(cr);
-    cairo_destroy(cr);
-    free(rgb_buf);
+    return TRUE;
+}
+
+static gboolean motion_callback(GtkWidget *widget, GdkEventMotion *event,
+                                gpointer data)
+{
+    if (!view.dragging || !view.zoomed)
+        return FALSE;
+
+    view.x -= (int) (event->x - view.drag_x);
+    view.y -= (int) (event->y - view.drag_y);
+    view.drag_x = event->x;
+    view.drag_y = event->y;
+    view_clamp(gtk_widget_get_allocated_width(widget),
+               gtk_widget_get_allocated_height(widget));
+    gtk_widget_queue_draw(widget);
+
+    return TRUE;
 }
 
 gboolean draw_callback(GtkWidget *widget, cairo_t *cr, gpointer data)
@@ -170,33 +711,22 @@ gboolean draw_callback(GtkWidget *widget, cairo_t *cr, gpointer data)
     return FALSE;
 }
 
-static int input_buffer_init(char *fn)
-{
-    input_buf = calloc(1, frame_cfg.width * frame_cfg.height * 3 / 2);
-
-    if (input_buf == NULL) {
-        perror("Memory calloc fail");
-        return -1;
-    }
-
-    if (open_file(fn) < 0) {
-        printf("Open file error!\n");
-        return -1;
-    }
-
-    return 0;
-}
-
 static void print_help()
 {
     printf("Usage:\n");
-    printf("\tviewer file width height\n");
+    printf("\tviewer [-j threads] [-s nearest|bilinear|box] [-f frame] [-F format]\n"
+           "\t       [-m matrix] [-R range] [-S] [-T trace.json] file width height\n");
+    printf("\tformat: nv21 (default), nv12, i420, yv12, yuyv, uyvy, i422, i444\n");
+    printf("\tmatrix: bt601 (default), bt709, bt2020; range: limited (default), full\n");
+    printf("\t-S shows stage timings (s toggles), -T writes them as Chrome trace events\n");
+    printf("\tLeft/Right/PgUp/PgDn/Home/End step, <number> Enter jumps to a frame\n");
+    printf("\tWheel or +/- zoom, drag pans, f fits the frame to the window\n");
 }
 
 static void frame_cfg_init(int argc, char **argv)
 {
-    frame_cfg.width = atoi(argv[2]);
-    frame_cfg.height = atoi(argv[3]);
+    frame_cfg.width = atoi(argv[optind + 1]);
+    frame_cfg.height = atoi(argv[optind + 2]);
 }
 
 int main(int argc, char *argv[])
@@ -204,18 +734,84 @@ int main(int argc, char *argv[])
     GtkWidget *window;
     GtkWidget *draw_area;
     GtkWidget *frame;
+    int opt, filter, format, start_frame = 1;
+    int matrix = YUV_MATRIX_BT601, range = YUV_RANGE_LIMITED;
+    char *trace_fn = NULL;
 
-    if (argc != 4) {
+    memset(&frame_cfg, 0, sizeof(frame_cfg));
+    frame_cfg.filter = YUV_SCALE_BILINEAR;
+
+    while ((opt = getopt(argc, argv, "j:s:f:F:m:R:ST:")) != -1) {
+        switch (opt) {
+        case 'S':
+            frame_cfg.stats = TRUE;
+            break;
+        case 'T':
+            trace_fn = optarg;
+            break;
+        case 'm':
+            matrix = yuv_matrix_parse(optarg);
+            if (matrix < 0) {
+                print_help();
+                return 0;
+            }
+            break;
+        case 'R':
+            range = yuv_range_parse(optarg);
+            if (range < 0) {
+                print_help();
+                return 0;
+            }
+            break;
+        case 'F':
+            format = yuv_format_parse(optarg);
+            if (format < 0) {
+                print_help();
+                return 0;
+            }
+            frame_cfg.format = format;
+            break;
+        case 'f':
+            start_frame = atoi(optarg);
+            break;
+        case 'j':
+            frame_cfg.threads = atoi(optarg);
+            break;
+        case 's':
+            filter = yuv_scale_filter_parse(optarg);
+            if (filter < 0) {
+                print_help();
+                return 0;
+            }
+            frame_cfg.filter = filter;
+            break;
+        default:
+            print_help();
+            return 0;
+        }
+    }
+
+    if (argc - optind != 3) {
         print_help();
         return 0;
     }
 
-    memset(&frame_cfg, 0, sizeof(frame_cfg));
+    if (trace_fn && yuv_trace_open(trace_fn) < 0)
+        return 0;
 
     frame_cfg_init(argc, argv);
+    frame_cfg.coefs = yuv_coefs_get(matrix, range);
+
+    frame_cfg.pool = yuv_pool_create(frame_cfg.threads);
+    printf("Conversion kernel: %s, %d threads, %s scaling, %s %s %s input\n",
+           yuv_kernel_select()->name, yuv_pool_threads(frame_cfg.pool),
+           yuv_scale_filter_name(frame_cfg.filter),
+           yuv_format_name(frame_cfg.format), yuv_matrix_name(matrix),
+           yuv_range_name(range));
 
-    if (input_buffer_init(argv[1]) < 0) {
-        printf("Buffer initial fail.\n");
+    frame_cfg.fn = argv[optind];
+    if (open_file(frame_cfg.fn) < 0) {
+        printf("Open file error!\n");
         return 0;
     }
 
@@ -223,10 +819,13 @@ int main(int argc, char *argv[])
     gtk_init(&argc, &argv);
 
     window = gtk_window_new(GTK_WINDOW_TOPLEVEL);
-    gtk_window_set_title(GTK_WINDOW (window), "Window");
+    frame_cfg.window = window;
+    set_frame(start_frame - 1);
 
     /* Destroy */
     g_signal_connect(window, "destroy", G_CALLBACK(close_window), NULL);
+    g_signal_connect(window, "key-press-event",
+                     G_CALLBACK(key_press_callback), NULL);
 
     gtk_container_set_border_width(GTK_CONTAINER(window), 10);
 
@@ -235,10 +834,22 @@ int main(int argc, char *argv[])
     gtk_container_add(GTK_CONTAINER(window), frame);
 
     draw_area = gtk_drawing_area_new();
+    frame_cfg.draw_area = draw_area;
     gtk_widget_set_size_request(draw_area, frame_cfg.width / 4, frame_cfg.height / 4);
 
     gtk_container_add(GTK_CONTAINER(frame), draw_area);
 
+    gtk_widget_add_events(draw_area, GDK_SCROLL_MASK | GDK_BUTTON_PRESS_MASK |
+                          GDK_BUTTON_RELEASE_MASK | GDK_BUTTON1_MOTION_MASK);
+    g_signal_connect(draw_area, "scroll-event",
+                     G_CALLBACK(scroll_callback), NULL);
+    g_signal_connect(draw_area, "button-press-event",
+                     G_CALLBACK(button_callback), NULL);
+    g_signal_connect(draw_area, "button-release-event",
+                     G_CALLBACK(button_callback), NULL);
+    g_signal_connect(draw_area, "motion-notify-event",
+                     G_CALLBACK(motion_callback), NULL);
+
 #if 1
     g_signal_connect(draw_area, "draw",
                      G_CALLBACK(expose_event_callback), NULL);
@@ -2,15 +2,18 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
+#include <getopt.h>
 #include <errno.h>
 #include <sys/types.h>
 #include <sys/stat.h>
-#include <sys/time.h>
 
 #include <va/va.h>
 #include <va/va_x11.h>
 #include <X11/Xlib.h>
 
+#include "yuv_trace.h"
+#include "yuv_copy.h"
+
 #define SWAP_UINT(a, b) do { \
         uint32_t v = a;         \
         a = b;               \
@@ -38,14 +41,40 @@ struct frame_info {
     void *buf;
 };
 
-static uint32_t get_tick_count(void)
-{
-    struct timeval tv;
+enum va_stage {
+    STAGE_LOAD,
+    STAGE_UPLOAD,       /* into the backend's image, vaPutImage included */
+    STAGE_PRESENT,
+    STAGE_COUNT
+};
 
-    if (gettimeofday(&tv, NULL))
-        return 0;
+static struct yuv_stage stages[STAGE_COUNT] = {
+    { "load" }, { "upload" }, { "present" },
+};
 
-    return tv.tv_usec / 1000 + tv.tv_sec * 1000;
+#define DEFAULT_BENCH_FRAMES 1000
+
+/*
+ * Stage timings over the top left corner. vaPutSurface can land after
+ * this, so the text may flicker; it is a debugging aid.
+ */
+static void draw_stats(struct display_s *dpy, GC gc)
+{
+    char text[512];
+    char *line, *next;
+    int y = 14;
+
+    yuv_stage_format(text, sizeof(text), stages, STAGE_COUNT);
+
+    for (line = text; line; line = next) {
+        next = strchr(line, '\n');
+        if (next)
+            *next++ = '\0';
+        XDrawImageString(dpy->native_dpy, dpy->x11_win.win, gc, 4, y,
+                         line, strlen(line));
+        y += 14;
+    }
+    XFlush(dpy->native_dpy);
 }
 
 static int open_file(char *fn, uint8_t *buf, size_t size)
@@ -58,7 +87,7 @@ static int open_file(char *fn, uint8_t *buf, size_t size)
         return -1;
     }
 
-    if (st.st_size != size) {
+    if ((uint64_t) st.st_size != size) {
         printf("File size is not match resolution setting!\n");
         return -1;
     }
@@ -194,7 +223,12 @@ lookup_image_format(struct display_s *b_dpy)
 static void print_help()
 {
     printf("Usage:\n");
-    printf("\tviewer [file] [width] [height]\n");
+    printf("\tviewer [-S] [-T trace.json] [--backend va|null] [--benchmark] [-n frames]\n"
+           "\t       [file] [width] [height]\n");
+    printf("\t-S shows stage timings, -T writes them as Chrome trace events\n");
+    printf("\t--benchmark uploads and presents the frame -n times (default %d),\n"
+           "\tby default on the null backend, and reports fps and latency\n",
+           DEFAULT_BENCH_FRAMES);
 }
 
 static void x11_create_simple_win(struct display_s *dpy,
@@ -233,164 +267,392 @@ static void x11_create_simple_win(struct display_s *dpy,
     XSync(dpy->native_dpy, False);
 }
 
-int main(int argc, char *argv[])
-{
-    struct display_s base_dpy;
-    struct frame_info frame;
-    uint32_t quit = 0, buf_size;
-    VAStatus status;
-    int major_version, minor_version;
-    VASurfaceID surfaces_id[2];
+/*
+ * Presents the frame. upload() copies it into the backend's image and
+ * present() puts that on screen; poll() returns nonzero once the user
+ * asked to quit.
+ */
+struct va_backend {
+    const char *name;
+    int (*init)(struct frame_info *frame);
+    int (*upload)(struct frame_info *frame);
+    int (*present)(struct frame_info *frame);
+    int (*poll)(void);
+    void (*shutdown)(void);
+};
 
-    if (argc != 4) {
-        print_help();
-        return 0;
-    }
+struct va_state {
+    struct display_s dpy;
+    VASurfaceID surfaces_id[2];
+    VAImage image;
+    GC gc;              /* stage timings, only with -S */
+    uint32_t quit;
+};
 
-    memset(&frame, 0, sizeof(frame));
-    frame.width = atoi(argv[2]);
-    frame.height = atoi(argv[3]);
-    buf_size = frame.width * frame.height * 3 / 2;
+static struct va_state va;
+static int show_stats;
 
-    if ((frame.buf = input_buffer_init(argv[1], buf_size)) == NULL) {
-        printf("Buffer initial fail.\n");
-        return 0;
-    }
+static int va_backend_init(struct frame_info *frame)
+{
+    VAStatus status;
+    int major_version, minor_version;
+    int32_t i;
 
-    base_dpy.native_dpy = XOpenDisplay(NULL);
+    va.dpy.native_dpy = XOpenDisplay(NULL);
 
-    if (!base_dpy.native_dpy) {
-        printf("failed to open display\n");
-        return 0;
+    if (!va.dpy.native_dpy) {
+        printf("failed to open display, try --backend null\n");
+        return -1;
     }
 
-    x11_create_simple_win(&base_dpy, &frame);
+    x11_create_simple_win(&va.dpy, frame);
 
     /* Intel libva */
-    base_dpy.va_dpy = vaGetDisplay(base_dpy.native_dpy);
+    va.dpy.va_dpy = vaGetDisplay(va.dpy.native_dpy);
 
-    if (base_dpy.va_dpy == NULL) {
+    if (va.dpy.va_dpy == NULL) {
         printf("failed to get VA display\n");
-        return 0;
+        return -1;
     }
 
-    status = vaInitialize(base_dpy.va_dpy, &major_version, &minor_version);
+    status = vaInitialize(va.dpy.va_dpy, &major_version, &minor_version);
 
     if (vaapi_check_status(status, "vaInitialize")) {
-        return 0;
+        return -1;
     }
 
-    memset(surfaces_id, 0xff, sizeof(surfaces_id));
-    surfaces_id[1] = DEAD_SURFACE_ID;
-    status = vaCreateSurfaces(base_dpy.va_dpy, VA_RT_FORMAT_YUV420,
-                              frame.width, frame.height, surfaces_id, 1, NULL, 0);
+    memset(va.surfaces_id, 0xff, sizeof(va.surfaces_id));
+    va.surfaces_id[1] = DEAD_SURFACE_ID;
+    status = vaCreateSurfaces(va.dpy.va_dpy, VA_RT_FORMAT_YUV420,
+                              frame->width, frame->height, va.surfaces_id, 1, NULL, 0);
 
     if (vaapi_check_status(status, "vaCreateSurfaces")) {
-        return 0;
+        return -1;
     }
 
-    const VAImageFormat *va_format = lookup_image_format(&base_dpy);
+    const VAImageFormat *va_format = lookup_image_format(&va.dpy);
 
     if (!va_format) {
         printf("Invalid va format\n");
-        return 0;
+        return -1;
     }
 
-    VAImage va_image;
-    status = vaCreateImage(base_dpy.va_dpy,
+    status = vaCreateImage(va.dpy.va_dpy,
                            (VAImageFormat *)va_format,
-                           frame.width,
-                           frame.height,
-                           &va_image
+                           frame->width,
+                           frame->height,
+                           &va.image
                           );
 
     if (vaapi_check_status(status, "vaCreateImage")) {
-        return 0;
+        return -1;
     }
 
-    VAImageID image_id = va_image.image_id;
-    va_image.format = *va_format;
+    va.image.format = *va_format;
 
-    uint8_t *image_data = NULL;
-    status = vaMapBuffer(base_dpy.va_dpy,
-                         va_image.buf, (void **)&image_data);
+    for (i = 0; i < va.image.num_planes; i++) {
+        printf("stride[%d] = %d, offset[%d] = %d data_size = %u\n", i,
+               va.image.pitches[i], i, va.image.offsets[i], va.image.data_size);
+    }
 
-    if (vaapi_check_status(status, "vaMapBuffer")) {
-        return 0;
+    if (show_stats) {
+        va.gc = XCreateGC(va.dpy.native_dpy, va.dpy.x11_win.win, 0, NULL);
+        XSetForeground(va.dpy.native_dpy, va.gc, WhitePixel(va.dpy.native_dpy, 0));
+        XSetBackground(va.dpy.native_dpy, va.gc, BlackPixel(va.dpy.native_dpy, 0));
     }
 
+    return 0;
+}
+
+static int va_backend_upload(struct frame_info *frame)
+{
+    VAStatus status;
+    uint8_t *image_data = NULL;
     uint8_t *pixels[3];
-    uint32_t stride[3];
     int32_t i;
 
-    for (i = 0; i < va_image.num_planes; i++) {
-        pixels[i] = image_data + va_image.offsets[i];
-        stride[i] = va_image.pitches[i];
-        printf("stride[%d] = %d, offset[%d] = %d data_size = %u\n", i, stride[i], i,
-               va_image.offsets[i], va_image.data_size);
+    status = vaMapBuffer(va.dpy.va_dpy,
+                         va.image.buf, (void **)&image_data);
+
+    if (vaapi_check_status(status, "vaMapBuffer")) {
+        return -1;
     }
 
-    /* Need better copy */
-    memcpy(pixels[0], frame.buf, frame.width * frame.height);
-    memcpy(pixels[1], frame.buf + frame.width * frame.height,
-           frame.width * frame.height / 2);
+    for (i = 0; i < va.image.num_planes; i++)
+        pixels[i] = image_data + va.image.offsets[i];
 
-    status = vaUnmapBuffer(base_dpy.va_dpy, va_image.buf);
+    /*
+     * NV12: Y then interleaved chroma at half height, each plane at the
+     * driver's pitch. The mapping is usually write combined, stream it.
+     */
+    yuv_plane_copy(pixels[0], va.image.pitches[0], frame->buf, frame->width,
+                   frame->width, frame->height, 1);
+    yuv_plane_copy(pixels[1], va.image.pitches[1],
+                   (uint8_t *) frame->buf + (size_t) frame->width * frame->height,
+                   frame->width,
+                   frame->width, frame->height / 2, 1);
+
+    status = vaUnmapBuffer(va.dpy.va_dpy, va.image.buf);
 
     if (vaapi_check_status(status, "vaUnmapBuffer")) {
-        return 0;
+        return -1;
     }
 
-    status = vaPutImage(base_dpy.va_dpy, surfaces_id[0],
-                        image_id, 0, 0, frame.width, frame.height,
-                        0, 0, frame.width, frame.height);
+    status = vaPutImage(va.dpy.va_dpy, va.surfaces_id[0],
+                        va.image.image_id, 0, 0, frame->width, frame->height,
+                        0, 0, frame->width, frame->height);
 
     if (vaapi_check_status(status, "vaPutImage")) {
-        return 0;
+        return -1;
+    }
+
+    return 0;
+}
+
+static int va_backend_present(struct frame_info *frame)
+{
+    VAStatus status;
+
+    status = vaPutSurface(va.dpy.va_dpy, va.surfaces_id[0],
+                          va.dpy.x11_win.win, 0, 0, frame->width, frame->height, 0, 0,
+                          va.dpy.x11_win.width, va.dpy.x11_win.height, NULL, 0, VA_FRAME_PICTURE);
+
+    if (vaapi_check_status(status, "vaPutSurface")) {
+        return -1;
     }
 
-    uint32_t start_time, putsurface_time, frame_num = 0;
+    if (va.gc)
+        draw_stats(&va.dpy, va.gc);
 
-    while (!quit) {
-        start_time = get_tick_count();
-        status = vaPutSurface(base_dpy.va_dpy, surfaces_id[0],
-                              base_dpy.x11_win.win, 0, 0, frame.width, frame.height, 0, 0,
-                              base_dpy.x11_win.width, base_dpy.x11_win.height, NULL, 0, VA_FRAME_PICTURE);
+    return 0;
+}
 
-        if (vaapi_check_status(status, "vaPutSurface")) {
-            return 0;
-        }
+static int va_backend_poll(void)
+{
+    check_window_event(va.dpy.native_dpy, (void *)va.dpy.x11_win.win, &va.dpy.x11_win.width,
+                       &va.dpy.x11_win.height, &va.quit);
+
+    return va.quit;
+}
 
-        putsurface_time += (get_tick_count() - start_time);
+static void va_backend_shutdown(void)
+{
+    VAStatus status;
 
-        if ((frame_num % 0xff) == 0) {
-            printf("%.2f FPS\n", 256000.0 / (float)putsurface_time);
-            putsurface_time = 0;
-        }
+    status = vaDestroyImage(va.dpy.va_dpy, va.image.image_id);
+    vaapi_check_status(status, "vaDestroyImage");
 
-        check_window_event(base_dpy.native_dpy, (void *)base_dpy.x11_win.win, &base_dpy.x11_win.width,
-                           &base_dpy.x11_win.height, &quit);
-        frame_num++;
+    status = vaDestroySurfaces(va.dpy.va_dpy, va.surfaces_id, 1);
+    vaapi_check_status(status, "vaDestroySurfaces");
+
+    if (va.gc)
+        XFreeGC(va.dpy.native_dpy, va.gc);
+    free(va_image_formats);
+    vaTerminate(va.dpy.va_dpy);
+    XUnmapWindow(va.dpy.native_dpy, va.dpy.x11_win.win);
+    XDestroyWindow(va.dpy.native_dpy, va.dpy.x11_win.win);
+    XCloseDisplay(va.dpy.native_dpy);
+}
+
+/* No display: uploads go to an NV12 buffer in memory, present is a no-op */
+static uint8_t *null_image;
+
+static int null_backend_init(struct frame_info *frame)
+{
+    null_image = malloc((size_t) frame->width * frame->height * 3 / 2);
+    if (null_image == NULL) {
+        perror("Memory null image malloc fail");
+        return -1;
+    }
+
+    return 0;
+}
+
+static int null_backend_upload(struct frame_info *frame)
+{
+    /* Same copy as the VA upload, with no padding */
+    yuv_plane_copy(null_image, frame->width, frame->buf, frame->width,
+                   frame->width, frame->height * 3 / 2, 1);
+
+    return 0;
+}
+
+static int null_backend_present(struct frame_info *frame)
+{
+    return 0;
+}
+
+static int null_backend_poll(void)
+{
+    return 0;
+}
+
+static void null_backend_shutdown(void)
+{
+    free(null_image);
+}
+
+static const struct va_backend backends[] = {
+    { "va", va_backend_init, va_backend_upload, va_backend_present,
+      va_backend_poll, va_backend_shutdown },
+    { "null", null_backend_init, null_backend_upload, null_backend_present,
+      null_backend_poll, null_backend_shutdown },
+};
+
+static const struct va_backend *backend_find(const char *name)
+{
+    unsigned int i;
+
+    for (i = 0; i < sizeof(backends) / sizeof(backends[0]); i++) {
+        if (!strcmp(backends[i].name, name))
+            return &backends[i];
     }
 
-    status = vaDestroyImage(base_dpy.va_dpy, va_image.image_id);
+    return NULL;
+}
+
+static int compare_int64(const void *a, const void *b)
+{
+    int64_t x = *(const int64_t *) a, y = *(const int64_t *) b;
+
+    return x < y ? -1 : x > y;
+}
+
+/* latency holds the upload to present time of each frame, in ns */
+static void bench_report(int64_t *latency, uint32_t frames, int64_t elapsed_ns)
+{
+    if (frames == 0)
+        return;
+
+    qsort(latency, frames, sizeof(*latency), compare_int64);
+
+    printf("Benchmark: %u frames in %.3f s, %.1f fps, latency p50 %.3f ms, "
+           "p99 %.3f ms, max %.3f ms\n",
+           frames, elapsed_ns / 1e9, frames * 1e9 / elapsed_ns,
+           latency[(frames - 1) * 50 / 100] / 1e6,
+           latency[(frames - 1) * 99 / 100] / 1e6,
+           latency[frames - 1] / 1e6);
+}
+
+static const struct option long_options[] = {
+    { "backend", required_argument, NULL, 'O' },
+    { "benchmark", no_argument, NULL, 'B' },
+    { NULL, 0, NULL, 0 }
+};
+
+int main(int argc, char *argv[])
+{
+    const struct va_backend *backend = NULL;
+    struct frame_info frame;
+    uint32_t quit = 0;
+    size_t buf_size;
+    uint32_t frame_num = 0, bench_frames = DEFAULT_BENCH_FRAMES;
+    int opt, benchmark = 0;
+    int64_t start, present_start, now, fps_start, bench_start;
+    int64_t *latency = NULL;
+
+    while ((opt = getopt_long(argc, argv, "ST:n:", long_options, NULL)) != -1) {
+        switch (opt) {
+        case 'O':
+            backend = backend_find(optarg);
+            if (backend == NULL) {
+                print_help();
+                return 0;
+            }
+            break;
+        case 'B':
+            benchmark = 1;
+            break;
+        case 'n':
+            bench_frames = atoi(optarg);
+            break;
+        case 'S':
+            show_stats = 1;
+            break;
+        case 'T':
+            if (yuv_trace_open(optarg) < 0)
+                return 0;
+            break;
+        default:
+            print_help();
+            return 0;
+        }
+    }
 
-    if (vaapi_check_status(status, "vaDestroyImage")) {
+    if (argc - optind != 3 || bench_frames == 0) {
+        print_help();
         return 0;
     }
 
-    status = vaDestroySurfaces(base_dpy.va_dpy, surfaces_id, 1);
+    /* Benchmarks run headless unless a backend is asked for */
+    if (backend == NULL)
+        backend = backend_find(benchmark ? "null" : "va");
+
+    memset(&frame, 0, sizeof(frame));
+    frame.width = atoi(argv[optind + 1]);
+    frame.height = atoi(argv[optind + 2]);
+    buf_size = (size_t) frame.width * frame.height * 3 / 2;
 
-    if (vaapi_check_status(status, "vaDestroySurfaces")) {
+    start = yuv_time_ns();
+    if ((frame.buf = input_buffer_init(argv[optind], buf_size)) == NULL) {
+        printf("Buffer initial fail.\n");
         return 0;
     }
+    yuv_stage_end(&stages[STAGE_LOAD], 0, start);
 
-    free(va_image_formats);
+    if (backend->init(&frame) < 0)
+        return 0;
+
+    if (benchmark) {
+        latency = malloc(bench_frames * sizeof(*latency));
+        if (latency == NULL) {
+            perror("Memory latency malloc fail");
+            return 0;
+        }
+    }
+
+    bench_start = fps_start = yuv_time_ns();
+
+    while (!quit) {
+        /* A still image is uploaded once, a benchmark treats each frame as new */
+        start = yuv_time_ns();
+        if (frame_num == 0 || benchmark) {
+            if (backend->upload(&frame) < 0)
+                return 0;
+            yuv_stage_end(&stages[STAGE_UPLOAD], frame_num, start);
+        }
+
+        present_start = yuv_time_ns();
+        if (backend->present(&frame) < 0)
+            return 0;
+        now = yuv_stage_end(&stages[STAGE_PRESENT], frame_num, present_start);
+
+        if (benchmark)
+            latency[frame_num] = now - start;
+
+        if (frame_num % 256 == 255) {
+            printf("%.2f FPS, present %.3f ms\n", 256e9 / (now - fps_start),
+                   stages[STAGE_PRESENT].last_ns / 1e6);
+            fps_start = now;
+        }
+
+        quit = backend->poll();
+        frame_num++;
+
+        if (benchmark && frame_num == bench_frames)
+            break;
+    }
+
+    if (benchmark)
+        bench_report(latency, frame_num, yuv_time_ns() - bench_start);
+
+    backend->shutdown();
+
+    yuv_stage_print(stages, STAGE_COUNT);
+    yuv_trace_close();
+
+    free(latency);
     free(frame.buf);
-    vaTerminate(base_dpy.va_dpy);
-    XUnmapWindow(base_dpy.native_dpy, base_dpy.x11_win.win);
-    XDestroyWindow(base_dpy.native_dpy, base_dpy.x11_win.win);
-    XCloseDisplay(base_dpy.native_dpy);
 
     return 0;
 }
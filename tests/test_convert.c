@@ -0,0 +1,169 @@
+/*
+ * Every kernel against the original scalar converter: both sample files
+ * and every Y/U/V combination, bit for bit. Run from the top directory.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "yuv_convert.h"
+#include "yuv_pool.h"
+
+static const struct {
+    const char *path;
+    int width;
+    int height;
+} samples[] = {
+    { "yuv420sp/event_2012_07_12_10_34_53_001_1920x1088.yuv420sp", 1920, 1088 },
+    { "yuv420sp/event_2013_08_12_14_46_20_002_256x192.yuv420sp", 256, 192 },
+};
+
+/* The converter gtk_viewer.c and gtk_player.c started out with */
+static void reference(uint32_t *rgb, const uint8_t *yuv420sp, int width,
+                      int height)
+{
+    int frameSize = width * height;
+    int i, j, yp;
+
+    for (j = 0, yp = 0; j < height; j++) {
+        int uvp = frameSize + (j >> 1) * width, u = 0, v = 0;
+        for (i = 0; i < width; i++, yp++) {
+            int y = (0xff & ((int) yuv420sp[yp])) - 16;
+            if (y < 0) y = 0;
+            if ((i & 1) == 0) {
+                v = (0xff & yuv420sp[uvp++]) - 128;
+                u = (0xff & yuv420sp[uvp++]) - 128;
+            }
+
+            int y1192 = 1192 * y;
+            int r = (y1192 + 1634 * v);
+            int g = (y1192 - 833 * v - 400 * u);
+            int b = (y1192 + 2066 * u);
+
+            if (r < 0) r = 0; else if (r > 262143) r = 262143;
+            if (g < 0) g = 0; else if (g > 262143) g = 262143;
+            if (b < 0) b = 0; else if (b > 262143) b = 262143;
+
+            rgb[yp] = 0xff000000 | ((r << 6) & 0xff0000) |
+                      ((g >> 2) & 0xff00) | ((b >> 10) & 0xff);
+        }
+    }
+}
+
+static int compare(const char *what, const char *kernel, const uint32_t *rgb,
+                   const uint32_t *ref, int width, int height)
+{
+    size_t i, n = (size_t) width * height;
+
+    for (i = 0; i < n; i++) {
+        if (rgb[i] != ref[i]) {
+            printf("FAIL %s %s: pixel %d,%d is %08x, want %08x\n", what,
+                   kernel, (int) (i % width), (int) (i / width), rgb[i],
+                   ref[i]);
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+static uint8_t *load(const char *path, size_t size)
+{
+    uint8_t *buf = malloc(size);
+    FILE *fp = fopen(path, "rb");
+
+    if (buf == NULL || fp == NULL || fread(buf, size, 1, fp) != 1) {
+        perror(path);
+        free(buf);
+        buf = NULL;
+    }
+    if (fp)
+        fclose(fp);
+
+    return buf;
+}
+
+/*
+ * A 512x512 NV21 frame with Y = row / 2, V = column / 2 and U fixed, so
+ * 256 of them give every combination, odd and even pixels alike
+ */
+static void sweep_frame(uint8_t *yuv, int u)
+{
+    uint8_t *c = yuv + 512 * 512;
+    int i, j;
+
+    for (j = 0; j < 512; j++)
+        memset(yuv + j * 512, j / 2, 512);
+    for (j = 0; j < 256; j++) {
+        for (i = 0; i < 256; i++) {
+            c[j * 512 + 2 * i] = i;
+            c[j * 512 + 2 * i + 1] = u;
+        }
+    }
+}
+
+int main(void)
+{
+    const struct yuv_kernel *kernels;
+    struct yuv_pool *pool = yuv_pool_create(4);
+    uint32_t *rgb, *ref;
+    uint8_t *yuv;
+    int count, i, k, u, failed = 0;
+
+    kernels = yuv_kernel_list(&count);
+    rgb = malloc(1920 * 1088 * sizeof(uint32_t));
+    ref = malloc(1920 * 1088 * sizeof(uint32_t));
+    if (pool == NULL || rgb == NULL || ref == NULL) {
+        perror("Memory test alloc fail");
+        return 1;
+    }
+
+    for (i = 0; i < (int) (sizeof(samples) / sizeof(samples[0])); i++) {
+        int w = samples[i].width, h = samples[i].height;
+
+        yuv = load(samples[i].path, (size_t) w * h * 3 / 2);
+        if (yuv == NULL)
+            return 1;
+        reference(ref, yuv, w, h);
+
+        for (k = 0; k < count; k++) {
+            if (kernels[k].supported && !kernels[k].supported())
+                continue;
+            memset(rgb, 0, (size_t) w * h * sizeof(uint32_t));
+            yuv_rgb_conversion_kernel(&kernels[k], rgb, yuv, YUV_FORMAT_NV21,
+                                      NULL, w, h);
+            failed |= compare(samples[i].path, kernels[k].name, rgb, ref,
+                              w, h);
+
+            memset(rgb, 0, (size_t) w * h * sizeof(uint32_t));
+            yuv_rgb_conversion_mt(pool, &kernels[k], rgb, yuv,
+                                  YUV_FORMAT_NV21, NULL, w, h);
+            failed |= compare("banded", kernels[k].name, rgb, ref, w, h);
+        }
+        free(yuv);
+    }
+
+    yuv = malloc(512 * 512 * 3 / 2);
+    for (u = 0; u < 256 && !failed; u++) {
+        sweep_frame(yuv, u);
+        reference(ref, yuv, 512, 512);
+        for (k = 0; k < count; k++) {
+            if (kernels[k].supported && !kernels[k].supported())
+                continue;
+            yuv_rgb_conversion_kernel(&kernels[k], rgb, yuv, YUV_FORMAT_NV21,
+                                      NULL, 512, 512);
+            failed |= compare("sweep", kernels[k].name, rgb, ref, 512, 512);
+        }
+    }
+
+    free(yuv);
+    free(rgb);
+    free(ref);
+    yuv_pool_destroy(pool);
+
+    if (!failed)
+        printf("test_convert: ok\n");
+
+    return failed;
+}
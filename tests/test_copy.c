@@ -0,0 +1,106 @@
+/*
+ * Plane copies between padded layouts, cached and streamed: every row
+ * must arrive and the padding of dst must stay untouched.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "yuv_copy.h"
+
+#define GUARD 0xa5
+
+static uint32_t seed = 1;
+
+static uint32_t next_rand(void)
+{
+    seed = seed * 1103515245 + 12345;
+    return seed >> 8;
+}
+
+static int check_copy(size_t width, int height, size_t src_pitch,
+                      size_t dst_pitch, size_t dst_misalign, int stream)
+{
+    size_t src_size = src_pitch * height;
+    size_t dst_size = dst_pitch * height + dst_misalign;
+    uint8_t *src = malloc(src_size);
+    uint8_t *dst = malloc(dst_size);
+    uint8_t *d = dst + dst_misalign;
+    size_t i;
+    int j, failed = 0;
+
+    if (src == NULL || dst == NULL) {
+        perror("Memory test malloc fail");
+        free(src);
+        free(dst);
+        return 1;
+    }
+
+    for (i = 0; i < src_size; i++)
+        src[i] = next_rand();
+    memset(dst, GUARD, dst_size);
+
+    yuv_plane_copy(d, dst_pitch, src, src_pitch, width, height, stream);
+
+    for (j = 0; j < height && !failed; j++) {
+        if (memcmp(d + j * dst_pitch, src + j * src_pitch, width)) {
+            printf("FAIL %zux%d pitches %zu/%zu%s: row %d differs\n", width,
+                   height, src_pitch, dst_pitch, stream ? " streamed" : "",
+                   j);
+            failed = 1;
+        }
+        for (i = width; i < dst_pitch && !failed; i++) {
+            if (d[j * dst_pitch + i] != GUARD) {
+                printf("FAIL %zux%d pitches %zu/%zu%s: padding of row %d "
+                       "written\n", width, height, src_pitch, dst_pitch,
+                       stream ? " streamed" : "", j);
+                failed = 1;
+            }
+        }
+    }
+    for (i = 0; i < dst_misalign && !failed; i++) {
+        if (dst[i] != GUARD) {
+            printf("FAIL %zux%d: written before dst\n", width, height);
+            failed = 1;
+        }
+    }
+
+    free(src);
+    free(dst);
+    return failed;
+}
+
+int main(void)
+{
+    int n, failed = 0;
+
+    /* A 1920x1080 NV12 frame into a VA image padded to 2048 */
+    failed |= check_copy(1920, 1080, 1920, 2048, 0, 1);
+    failed |= check_copy(1920, 540, 1920, 2048, 0, 1);
+    failed |= check_copy(1920, 1080, 1920, 2048, 0, 0);
+
+    /* Unpadded on both sides goes as one block */
+    failed |= check_copy(1280, 720, 1280, 1280, 0, 1);
+    failed |= check_copy(1280, 720, 1280, 1280, 3, 1);
+
+    /* Padded source, narrow rows, odd sizes and a misaligned dst */
+    failed |= check_copy(7, 5, 64, 9, 1, 1);
+    failed |= check_copy(1, 1, 1, 1, 0, 1);
+    failed |= check_copy(1000, 700, 1024, 1001, 5, 1);
+
+    for (n = 0; n < 200 && !failed; n++) {
+        size_t width = 1 + next_rand() % 3000;
+        int height = 1 + next_rand() % 300;
+        size_t src_pitch = width + next_rand() % 3 * (next_rand() % 80);
+        size_t dst_pitch = width + next_rand() % 3 * (next_rand() % 80);
+
+        failed |= check_copy(width, height, src_pitch, dst_pitch,
+                             next_rand() % 16, next_rand() & 1);
+    }
+
+    if (!failed)
+        printf("test_copy: ok\n");
+
+    return failed;
+}
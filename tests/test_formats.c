@@ -0,0 +1,223 @@
+/*
+ * Every input format against a per pixel reference, for every kernel
+ * this CPU supports, at an odd size so the scalar tails run too. The
+ * output checksums are pinned so a change in any format shows up.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "yuv_convert.h"
+#include "yuv_chunk.h"
+
+#define WIDTH 133
+#define HEIGHT 37
+
+/* CRC-32 of the BT.601 limited output for the frame below, little endian */
+static const uint32_t golden[YUV_FORMAT_COUNT] = {
+    [YUV_FORMAT_NV21] = 0xa7db4ae6,
+    [YUV_FORMAT_NV12] = 0x85ce378a,
+    [YUV_FORMAT_I420] = 0xdb44a996,
+    [YUV_FORMAT_YV12] = 0xb2194009,
+    [YUV_FORMAT_YUYV] = 0xa9643fcf,
+    [YUV_FORMAT_UYVY] = 0x5784689f,
+    [YUV_FORMAT_I422] = 0x0d43c9d4,
+    [YUV_FORMAT_I444] = 0xc8cca501,
+};
+
+/* Unpacked planes, chroma at its own resolution */
+struct picture {
+    uint8_t y[HEIGHT][WIDTH];
+    uint8_t u[HEIGHT][WIDTH];
+    uint8_t v[HEIGHT][WIDTH];
+    int hshift;
+    int vshift;
+};
+
+static uint32_t seed = 1;
+
+static uint8_t next_byte(void)
+{
+    seed = seed * 1103515245 + 12345;
+    return seed >> 16;
+}
+
+static void picture_init(struct picture *p, enum yuv_format format)
+{
+    int i, j;
+
+    p->hshift = format != YUV_FORMAT_I444;
+    p->vshift = format <= YUV_FORMAT_YV12;
+
+    for (j = 0; j < HEIGHT; j++) {
+        for (i = 0; i < WIDTH; i++) {
+            p->y[j][i] = next_byte();
+            p->u[j][i] = next_byte();
+            p->v[j][i] = next_byte();
+        }
+    }
+}
+
+/* Written out per format, independent of yuv_format_planes() */
+static void pack(const struct picture *p, enum yuv_format format, uint8_t *out)
+{
+    int cw = (WIDTH + 1) / 2, ch = (HEIGHT + 1) / 2;
+    uint8_t *c = out + WIDTH * HEIGHT;
+    int i, j;
+
+    if (format != YUV_FORMAT_YUYV && format != YUV_FORMAT_UYVY) {
+        for (j = 0; j < HEIGHT; j++)
+            memcpy(out + j * WIDTH, p->y[j], WIDTH);
+    }
+
+    switch (format) {
+    case YUV_FORMAT_NV21:
+    case YUV_FORMAT_NV12:
+        for (j = 0; j < ch; j++) {
+            for (i = 0; i < cw; i++) {
+                c[j * 2 * cw + 2 * i] =
+                    format == YUV_FORMAT_NV21 ? p->v[j][i] : p->u[j][i];
+                c[j * 2 * cw + 2 * i + 1] =
+                    format == YUV_FORMAT_NV21 ? p->u[j][i] : p->v[j][i];
+            }
+        }
+        break;
+    case YUV_FORMAT_I420:
+    case YUV_FORMAT_YV12:
+        for (j = 0; j < ch; j++) {
+            for (i = 0; i < cw; i++) {
+                c[j * cw + i] =
+                    format == YUV_FORMAT_I420 ? p->u[j][i] : p->v[j][i];
+                c[cw * ch + j * cw + i] =
+                    format == YUV_FORMAT_I420 ? p->v[j][i] : p->u[j][i];
+            }
+        }
+        break;
+    case YUV_FORMAT_YUYV:
+    case YUV_FORMAT_UYVY:
+        for (j = 0; j < HEIGHT; j++) {
+            for (i = 0; i < cw; i++) {
+                uint8_t *q = out + j * 4 * cw + 4 * i;
+                uint8_t y1 = 2 * i + 1 < WIDTH ? p->y[j][2 * i + 1] : 0;
+
+                if (format == YUV_FORMAT_YUYV) {
+                    q[0] = p->y[j][2 * i];
+                    q[1] = p->u[j][i];
+                    q[2] = y1;
+                    q[3] = p->v[j][i];
+                }
+                else {
+                    q[0] = p->u[j][i];
+                    q[1] = p->y[j][2 * i];
+                    q[2] = p->v[j][i];
+                    q[3] = y1;
+                }
+            }
+        }
+        break;
+    case YUV_FORMAT_I422:
+        for (j = 0; j < HEIGHT; j++) {
+            for (i = 0; i < cw; i++) {
+                c[j * cw + i] = p->u[j][i];
+                c[cw * HEIGHT + j * cw + i] = p->v[j][i];
+            }
+        }
+        break;
+    default:
+        for (j = 0; j < HEIGHT; j++) {
+            memcpy(c + j * WIDTH, p->u[j], WIDTH);
+            memcpy(c + WIDTH * HEIGHT + j * WIDTH, p->v[j], WIDTH);
+        }
+        break;
+    }
+}
+
+static uint32_t reference_pixel(int y, int u, int v)
+{
+    y -= 16;
+    if (y < 0) y = 0;
+    u -= 128;
+    v -= 128;
+
+    int r = 1192 * y + 1634 * v;
+    int g = 1192 * y - 833 * v - 400 * u;
+    int b = 1192 * y + 2066 * u;
+
+    if (r < 0) r = 0; else if (r > 262143) r = 262143;
+    if (g < 0) g = 0; else if (g > 262143) g = 262143;
+    if (b < 0) b = 0; else if (b > 262143) b = 262143;
+
+    return 0xff000000 | ((r << 6) & 0xff0000) | ((g >> 2) & 0xff00) |
+           ((b >> 10) & 0xff);
+}
+
+static void reference(const struct picture *p, uint32_t *rgb)
+{
+    int i, j;
+
+    for (j = 0; j < HEIGHT; j++) {
+        for (i = 0; i < WIDTH; i++) {
+            int ci = i >> p->hshift, cj = j >> p->vshift;
+
+            rgb[j * WIDTH + i] = reference_pixel(p->y[j][i], p->u[cj][ci],
+                                                 p->v[cj][ci]);
+        }
+    }
+}
+
+int main(void)
+{
+    static struct picture pic;
+    static uint32_t rgb[WIDTH * HEIGHT], ref[WIDTH * HEIGHT];
+    const struct yuv_kernel *kernels;
+    uint8_t *yuv;
+    int count, f, k, i, failed = 0;
+
+    kernels = yuv_kernel_list(&count);
+    yuv = malloc(3 * WIDTH * HEIGHT);
+    if (yuv == NULL) {
+        perror("Memory test malloc fail");
+        return 1;
+    }
+
+    for (f = 0; f < YUV_FORMAT_COUNT; f++) {
+        uint32_t crc;
+
+        picture_init(&pic, f);
+        memset(yuv, 0, 3 * WIDTH * HEIGHT);
+        pack(&pic, f, yuv);
+        reference(&pic, ref);
+
+        for (k = 0; k < count; k++) {
+            if (kernels[k].supported && !kernels[k].supported())
+                continue;
+            memset(rgb, 0, sizeof(rgb));
+            yuv_rgb_conversion_kernel(&kernels[k], rgb, yuv, f, NULL,
+                                      WIDTH, HEIGHT);
+            for (i = 0; i < WIDTH * HEIGHT; i++) {
+                if (rgb[i] != ref[i]) {
+                    printf("FAIL %s %s: pixel %d,%d is %08x, want %08x\n",
+                           yuv_format_name(f), kernels[k].name, i % WIDTH,
+                           i / WIDTH, rgb[i], ref[i]);
+                    failed = 1;
+                    break;
+                }
+            }
+
+            crc = yuv_crc32(0, rgb, sizeof(rgb));
+            if (crc != golden[f]) {
+                printf("FAIL %s %s: output checksum %08x, want %08x\n",
+                       yuv_format_name(f), kernels[k].name, crc, golden[f]);
+                failed = 1;
+            }
+        }
+    }
+
+    free(yuv);
+
+    if (!failed)
+        printf("test_formats: ok\n");
+
+    return failed;
+}
@@ -0,0 +1,149 @@
+/*
+ * A sparse chunk stream past 4 GB: 1500 1080p v2 frames whose payloads
+ * are holes except the last one. The last frame must be found by a
+ * header scan and by the index block, and pread back intact. The file
+ * goes in $TMPDIR (or /tmp), which has to support sparse files.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+
+#include "yuv_chunk.h"
+#include "yuv_format.h"
+
+#define WIDTH 1920
+#define HEIGHT 1080
+#define FRAMES 1500
+
+static int check_last(int fd, const char *how, int64_t last,
+                      const uint8_t *payload, size_t size)
+{
+    struct yuv_index index;
+    struct yuv_chunk chunk;
+    uint8_t *buf = NULL;
+    size_t buf_size = 0;
+    int failed = 1;
+
+    if (yuv_index_build(fd, &index) < 0) {
+        printf("FAIL %s: no index\n", how);
+        return 1;
+    }
+
+    if (index.count != FRAMES || index.offsets[FRAMES - 1] != last)
+        printf("FAIL %s: %d frames, want %d, the last at %lld\n", how,
+               index.count, FRAMES, (long long) last);
+    else if (index.timestamps == NULL ||
+             index.timestamps[FRAMES - 1] != (FRAMES - 1) * 40000ull)
+        printf("FAIL %s: last timestamp wrong\n", how);
+    else if (yuv_chunk_pread(fd, last, &chunk, &buf, &buf_size) < 0)
+        printf("FAIL %s: pread of the last frame\n", how);
+    else if (chunk.size != size || chunk.frame != FRAMES - 1 ||
+             memcmp(buf, payload, size) ||
+             yuv_chunk_check_crc(&chunk, buf) < 0)
+        printf("FAIL %s: last frame differs\n", how);
+    else
+        failed = 0;
+
+    free(buf);
+    yuv_index_free(&index);
+    return failed;
+}
+
+int main(void)
+{
+    size_t size = yuv_format_frame_size(YUV_FORMAT_NV21, WIDTH, HEIGHT);
+    int64_t stride = sizeof(struct yuv_info_v2) + size;
+    int64_t last = (FRAMES - 1) * stride;
+    struct yuv_index index;
+    struct yuv_info_v2 hdr;
+    const char *dir = getenv("TMPDIR");
+    char name[4096];
+    uint8_t *payload;
+    uint32_t zero_crc;
+    FILE *fp;
+    size_t i;
+    int fd, failed = 1;
+
+    snprintf(name, sizeof(name), "%s/yuv_largefile_XXXXXX", dir ? dir : "/tmp");
+    fd = mkstemp(name);
+    if (fd < 0) {
+        perror("Test file create fail");
+        return 1;
+    }
+    unlink(name);
+
+    payload = calloc(1, size);
+    if (payload == NULL) {
+        perror("Memory test calloc fail");
+        close(fd);
+        return 1;
+    }
+    zero_crc = yuv_crc32(0, payload, size);
+
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.magic = YUV_CHUNK_MAGIC_V2;
+    hdr.width = WIDTH;
+    hdr.height = HEIGHT;
+    hdr.size = size;
+    hdr.header_size = sizeof(hdr);
+    hdr.format = YUV_FORMAT_NV21;
+
+    /* All holes, then the headers and the last payload go in */
+    if (ftruncate(fd, last + stride) < 0) {
+        perror("Test file truncate fail");
+        goto out;
+    }
+
+    for (i = 0; i < FRAMES - 1; i++) {
+        hdr.timestamp_us = i * 40000;
+        hdr.frame = i;
+        hdr.crc = zero_crc;
+        if (pwrite(fd, &hdr, sizeof(hdr), i * stride) != sizeof(hdr)) {
+            perror("Test file write fail");
+            goto out;
+        }
+    }
+
+    for (i = 0; i < size; i++)
+        payload[i] = i * 7 + (i >> 11);
+    hdr.timestamp_us = (FRAMES - 1) * 40000ull;
+    hdr.frame = FRAMES - 1;
+    hdr.crc = yuv_crc32(0, payload, size);
+    if (pwrite(fd, &hdr, sizeof(hdr), last) != sizeof(hdr) ||
+        pwrite(fd, payload, size, last + sizeof(hdr)) != (ssize_t) size) {
+        perror("Test file write fail");
+        goto out;
+    }
+
+    if (last + stride <= 0x100000000ll) {
+        printf("FAIL stream is only %lld bytes\n", (long long) (last + stride));
+        goto out;
+    }
+
+    /* No index block yet, the headers are scanned */
+    if (check_last(fd, "scan", last, payload, size))
+        goto out;
+
+    /* Then the same from the index block appended to the file */
+    if (yuv_index_build(fd, &index) < 0)
+        goto out;
+    fp = fdopen(dup(fd), "r+");
+    if (fp == NULL || fseeko(fp, 0, SEEK_END) < 0 ||
+        yuv_chunk_write_index(fp, &index) < 0 || fclose(fp) != 0) {
+        perror("Test index write fail");
+        yuv_index_free(&index);
+        goto out;
+    }
+    yuv_index_free(&index);
+
+    failed = check_last(fd, "index block", last, payload, size);
+
+out:
+    if (!failed)
+        printf("test_largefile: ok\n");
+    free(payload);
+    close(fd);
+    return failed;
+}
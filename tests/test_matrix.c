@@ -0,0 +1,140 @@
+/*
+ * Every matrix and range against the floating point equations, over all
+ * legal Y/U/V combinations, for every kernel this CPU supports. The
+ * fixed point result truncates, so it may sit just below the rounded
+ * float value.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+
+#include "yuv_convert.h"
+
+/* Largest error allowed in any channel, and on average over a sweep */
+#define MAX_ERROR 1
+#define MEAN_ERROR 0.5
+
+static const struct {
+    double kr;
+    double kb;
+} matrices[YUV_MATRIX_COUNT] = {
+    [YUV_MATRIX_BT601] = { 0.299, 0.114 },
+    [YUV_MATRIX_BT709] = { 0.2126, 0.0722 },
+    [YUV_MATRIX_BT2020] = { 0.2627, 0.0593 },
+};
+
+static int to_8bit(double x)
+{
+    x = floor(x * 255 + 0.5);
+
+    return x < 0 ? 0 : x > 255 ? 255 : (int) x;
+}
+
+static void reference(enum yuv_matrix m, enum yuv_range range, int y, int u,
+                      int v, int *rgb)
+{
+    double kr = matrices[m].kr, kb = matrices[m].kb;
+    double l, pb, pr, r, g, b;
+
+    if (range == YUV_RANGE_LIMITED) {
+        l = (y - 16) / 219.0;
+        pb = (u - 128) / 224.0;
+        pr = (v - 128) / 224.0;
+    }
+    else {
+        l = y / 255.0;
+        pb = (u - 128) / 255.0;
+        pr = (v - 128) / 255.0;
+    }
+
+    r = l + 2 * (1 - kr) * pr;
+    b = l + 2 * (1 - kb) * pb;
+    g = (l - kr * r - kb * b) / (1 - kr - kb);
+
+    rgb[0] = to_8bit(r);
+    rgb[1] = to_8bit(g);
+    rgb[2] = to_8bit(b);
+}
+
+/* An I444 frame with Y = column and V = row, U fixed */
+static void sweep_frame(uint8_t *yuv, int u)
+{
+    int i, j;
+
+    for (j = 0; j < 256; j++) {
+        for (i = 0; i < 256; i++) {
+            yuv[j * 256 + i] = i;
+            yuv[65536 + j * 256 + i] = u;
+            yuv[2 * 65536 + j * 256 + i] = j;
+        }
+    }
+}
+
+int main(void)
+{
+    const struct yuv_kernel *kernels;
+    static uint8_t yuv[3 * 65536];
+    static uint32_t rgb[65536];
+    int count, k, m, r, u, failed = 0;
+
+    kernels = yuv_kernel_list(&count);
+
+    for (m = 0; m < YUV_MATRIX_COUNT; m++) {
+        for (r = 0; r < YUV_RANGE_COUNT; r++) {
+            const struct yuv_coefs *coefs = yuv_coefs_get(m, r);
+            /* Limited range is only defined between the nominal levels */
+            int lo = r == YUV_RANGE_LIMITED ? 16 : 0;
+            int y_hi = r == YUV_RANGE_LIMITED ? 235 : 255;
+            int c_hi = r == YUV_RANGE_LIMITED ? 240 : 255;
+
+            for (k = 0; k < count; k++) {
+                double sum = 0;
+                long samples = 0;
+                int worst = 0;
+
+                if (kernels[k].supported && !kernels[k].supported())
+                    continue;
+
+                for (u = lo; u <= c_hi; u++) {
+                    int y, v, c, want[3];
+
+                    sweep_frame(yuv, u);
+                    yuv_rgb_conversion_kernel(&kernels[k], rgb, yuv,
+                                              YUV_FORMAT_I444, coefs,
+                                              256, 256);
+
+                    for (v = lo; v <= c_hi; v++) {
+                        for (y = lo; y <= y_hi; y++) {
+                            uint32_t px = rgb[v * 256 + y];
+
+                            reference(m, r, y, u, v, want);
+                            for (c = 0; c < 3; c++) {
+                                int e = abs((int) (px >> (16 - 8 * c) & 0xff) -
+                                            want[c]);
+
+                                if (e > worst)
+                                    worst = e;
+                                sum += e;
+                                samples++;
+                            }
+                        }
+                    }
+                }
+
+                if (worst > MAX_ERROR || sum / samples > MEAN_ERROR) {
+                    printf("FAIL %s %s %s: error max %d, mean %.3f\n",
+                           yuv_matrix_name(m), yuv_range_name(r),
+                           kernels[k].name, worst, sum / samples);
+                    failed = 1;
+                }
+            }
+        }
+    }
+
+    if (!failed)
+        printf("test_matrix: ok\n");
+
+    return failed;
+}
@@ -0,0 +1,417 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+#include <time.h>
+
+#include "yuv_convert.h"
+#include "yuv_pool.h"
+
+#define DEFAULT_FILE "yuv420sp/event_2012_07_12_10_34_53_001_1920x1088.yuv420sp"
+
+#define DEFAULT_RUNS 5
+#define DEFAULT_RUN_MS 200  /* suite runs without -n take about this long */
+
+static double now_ms(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+static int load_frame(char *fn, uint8_t *buf, size_t size)
+{
+    FILE *fp = fopen(fn, "r");
+
+    if (!fp) {
+        perror("File open fail!");
+        return -1;
+    }
+
+    if (fread(buf, 1, size, fp) != size) {
+        printf("File size is not match resolution setting!\n");
+        fclose(fp);
+        return -1;
+    }
+
+    fclose(fp);
+    return 0;
+}
+
+struct bench_input {
+    char *name;
+    char *fn;           /* NULL for a synthetic frame */
+    int width;
+    int height;
+    uint8_t *yuv;
+    uint32_t *rgb;
+};
+
+/* The sample captures plus synthetic 4K and 8K frames */
+static struct bench_input suite[] = {
+    { "sample", "yuv420sp/event_2013_08_12_14_46_20_002_256x192.yuv420sp", 256, 192 },
+    { "sample", DEFAULT_FILE, 1920, 1088 },
+    { "4k", NULL, 3840, 2160 },
+    { "8k", NULL, 7680, 4320 },
+};
+
+#define SUITE_INPUTS (int) (sizeof(suite) / sizeof(suite[0]))
+
+/* Gradients plus noise, so chroma varies and nothing clamps uniformly */
+static void synth_frame(uint8_t *buf, size_t size, int width)
+{
+    uint32_t seed = 12345;
+    size_t i;
+
+    for (i = 0; i < size; i++) {
+        seed = seed * 1103515245 + 12345;
+        buf[i] = (i % width) * 128 / width + (i / width) % 64 +
+                 ((seed >> 16) & 63);
+    }
+}
+
+static int input_load(struct bench_input *in, enum yuv_format format)
+{
+    size_t size = yuv_format_frame_size(format, in->width, in->height);
+
+    /* The samples are NV21, only the other 4:2:0 layouts can reuse them */
+    if (in->fn && size != yuv_format_frame_size(YUV_FORMAT_NV21, in->width,
+                                                in->height))
+        return -1;
+
+    in->yuv = malloc(size);
+    in->rgb = malloc((size_t) in->width * in->height * sizeof(uint32_t));
+    if (in->yuv == NULL || in->rgb == NULL) {
+        perror("Memory malloc fail");
+        return -1;
+    }
+
+    if (in->fn == NULL) {
+        synth_frame(in->yuv, size, in->width);
+        return 0;
+    }
+
+    return load_frame(in->fn, in->yuv, size);
+}
+
+static void input_free(struct bench_input *in)
+{
+    free(in->yuv);
+    free(in->rgb);
+    in->yuv = NULL;
+    in->rgb = NULL;
+}
+
+struct bench_case {
+    struct bench_input *in;
+    enum yuv_format format;
+    const struct yuv_coefs *coefs;
+    const struct yuv_kernel *k;     /* NULL for the scaled path */
+    enum yuv_scale_filter filter;
+    struct yuv_pool *pool;
+};
+
+static void bench_once(struct bench_case *c)
+{
+    struct bench_input *in = c->in;
+
+    if (c->k)
+        yuv_rgb_conversion_mt(c->pool, c->k, in->rgb, in->yuv, c->format,
+                              c->coefs, in->width, in->height);
+    else
+        yuv_rgb_conversion_scaled(c->pool, in->rgb, in->width / 2 * 4,
+                                  in->width / 2, in->height / 2, in->yuv,
+                                  c->format, c->coefs, in->width, in->height,
+                                  c->filter);
+}
+
+struct bench_stats {
+    int runs;
+    int iterations;     /* frames per run */
+    double mean_ms;     /* per frame, over the runs */
+    double stddev_ms;
+    double min_ms;
+};
+
+/*
+ * Times runs batches of iterations frames. With iterations <= 0 the count
+ * is picked from a warm-up frame so one batch takes about DEFAULT_RUN_MS.
+ */
+static void bench_measure(struct bench_case *c, int runs, int iterations,
+                          struct bench_stats *st)
+{
+    double start, ms, sum = 0, sq = 0, var;
+    int r, i;
+
+    /* Warm up caches and wake the workers */
+    start = now_ms();
+    bench_once(c);
+    ms = now_ms() - start;
+
+    if (iterations <= 0) {
+        iterations = ms > 0 ? DEFAULT_RUN_MS / ms : 1000;
+        if (iterations < 1)
+            iterations = 1;
+    }
+
+    st->runs = runs;
+    st->iterations = iterations;
+
+    for (r = 0; r < runs; r++) {
+        start = now_ms();
+        for (i = 0; i < iterations; i++)
+            bench_once(c);
+        ms = (now_ms() - start) / iterations;
+
+        sum += ms;
+        sq += ms * ms;
+        if (r == 0 || ms < st->min_ms)
+            st->min_ms = ms;
+    }
+
+    st->mean_ms = sum / runs;
+    var = runs > 1 ? (sq - sum * sum / runs) / (runs - 1) : 0;
+    st->stddev_ms = var > 0 ? sqrt(var) : 0;
+}
+
+static void print_stats(struct bench_case *c, struct bench_stats *st, int csv)
+{
+    struct bench_input *in = c->in;
+    const char *kernel = c->k ? c->k->name : "scaled";
+    const char *filter = c->k ? "none" : yuv_scale_filter_name(c->filter);
+    double pixels = c->k ? (double) in->width * in->height :
+                           (double) (in->width / 2) * (in->height / 2);
+    double mpix = pixels / (st->mean_ms * 1000.0);
+    double ns = st->mean_ms * 1e6 / pixels;
+
+    if (csv) {
+        printf("%s,%d,%d,%s,%s,%s,%d,%d,%d,%.4f,%.4f,%.4f,%.1f,%.3f\n",
+               in->name, in->width, in->height, yuv_format_name(c->format),
+               kernel, filter, yuv_pool_threads(c->pool), st->runs,
+               st->iterations, st->mean_ms, st->stddev_ms, st->min_ms,
+               mpix, ns);
+        return;
+    }
+
+    printf("%-6s %5dx%-5d %-6s %-8s %7d %9.3f %6.1f%% %9.3f %8.1f %8.3f\n",
+           in->name, in->width, in->height, kernel, filter,
+           yuv_pool_threads(c->pool), st->mean_ms,
+           st->stddev_ms * 100.0 / st->mean_ms, st->min_ms, mpix, ns);
+}
+
+/*
+ * Every supported kernel on every suite input, on one thread and on
+ * max_threads, then the half size scaled path with each filter.
+ */
+static int run_suite(enum yuv_format format, const struct yuv_coefs *coefs,
+                     int max_threads, int runs, int iterations, int csv)
+{
+    const struct yuv_kernel *kernels;
+    struct yuv_pool *pools[2];
+    int n, npools, i, k, t, f;
+
+    kernels = yuv_kernel_list(&n);
+    pools[0] = yuv_pool_create(1);
+    pools[1] = yuv_pool_create(max_threads);
+    npools = yuv_pool_threads(pools[1]) > 1 ? 2 : 1;
+
+    if (csv)
+        printf("input,width,height,format,kernel,filter,threads,runs,iterations,"
+               "mean_ms,stddev_ms,min_ms,mpix_s,ns_pixel\n");
+    else
+        printf("input  resolution  kernel filter   threads  ms/frame stddev"
+               "    min ms   Mpix/s ns/pixel\n");
+
+    for (i = 0; i < SUITE_INPUTS; i++) {
+        struct bench_input *in = &suite[i];
+        struct bench_case c;
+        struct bench_stats st;
+
+        if (input_load(in, format) < 0) {
+            fprintf(stderr, "Skipping %s %dx%d\n", in->name, in->width, in->height);
+            input_free(in);
+            continue;
+        }
+
+        memset(&c, 0, sizeof(c));
+        c.in = in;
+        c.format = format;
+        c.coefs = coefs;
+
+        for (k = 0; k < n; k++) {
+            if (kernels[k].supported && !kernels[k].supported())
+                continue;
+            c.k = &kernels[k];
+
+            for (t = 0; t < npools; t++) {
+                c.pool = pools[t];
+                bench_measure(&c, runs, iterations, &st);
+                print_stats(&c, &st, csv);
+            }
+        }
+
+        c.k = NULL;
+        c.pool = pools[npools - 1];
+        for (f = 0; f < YUV_SCALE_FILTER_COUNT; f++) {
+            c.filter = f;
+            bench_measure(&c, runs, iterations, &st);
+            print_stats(&c, &st, csv);
+        }
+
+        input_free(in);
+        fflush(stdout);
+    }
+
+    yuv_pool_destroy(pools[0]);
+    yuv_pool_destroy(pools[1]);
+    return 0;
+}
+
+static void print_help()
+{
+    printf("Usage:\n");
+    printf("\tyuv_bench [-j max_threads] [-n iterations] [-F format] [-m matrix] [-R range]\n"
+           "\t          [file width height]\n");
+    printf("\tyuv_bench -a [-c] [-r runs] [-n iterations] [-j threads] [-F format]\n"
+           "\t          [-m matrix] [-R range]\n");
+    printf("\t-a times every kernel on the samples and synthetic 4K/8K frames,\n"
+           "\t-c prints that as CSV\n");
+    printf("\tformat: nv21 (default), nv12, i420, yv12, yuyv, uyvy, i422, i444\n");
+    printf("\tmatrix: bt601 (default), bt709, bt2020; range: limited (default), full\n");
+}
+
+int main(int argc, char *argv[])
+{
+    char *fn = DEFAULT_FILE;
+    int width = 1920, height = 1088;
+    int max_threads = yuv_cpu_count(), iterations = 0;
+    int runs = DEFAULT_RUNS, suite_mode = 0, csv = 0;
+    int format = YUV_FORMAT_NV21;
+    int matrix = YUV_MATRIX_BT601, range = YUV_RANGE_LIMITED;
+    const struct yuv_coefs *coefs;
+    const struct yuv_kernel *k;
+    size_t size;
+    uint8_t *yuv;
+    uint32_t *rgb;
+    double base = 0;
+    int opt, t, i;
+
+    while ((opt = getopt(argc, argv, "j:n:r:acF:m:R:h")) != -1) {
+        switch (opt) {
+        case 'a':
+            suite_mode = 1;
+            break;
+        case 'c':
+            csv = 1;
+            break;
+        case 'r':
+            runs = atoi(optarg);
+            break;
+        case 'm':
+            matrix = yuv_matrix_parse(optarg);
+            if (matrix < 0) {
+                print_help();
+                return 0;
+            }
+            break;
+        case 'R':
+            range = yuv_range_parse(optarg);
+            if (range < 0) {
+                print_help();
+                return 0;
+            }
+            break;
+        case 'F':
+            format = yuv_format_parse(optarg);
+            if (format < 0) {
+                print_help();
+                return 0;
+            }
+            break;
+        case 'j':
+            max_threads = atoi(optarg);
+            break;
+        case 'n':
+            iterations = atoi(optarg);
+            if (iterations < 1) {
+                print_help();
+                return 0;
+            }
+            break;
+        default:
+            print_help();
+            return 0;
+        }
+    }
+
+    coefs = yuv_coefs_get(matrix, range);
+
+    if (suite_mode) {
+        if (argc != optind || max_threads < 1 || runs < 1) {
+            print_help();
+            return 0;
+        }
+        return run_suite(format, coefs, max_threads, runs, iterations, csv);
+    }
+
+    if (iterations == 0)
+        iterations = 100;
+
+    if (argc - optind == 3) {
+        fn = argv[optind];
+        width = atoi(argv[optind + 1]);
+        height = atoi(argv[optind + 2]);
+    }
+    else if (argc != optind) {
+        print_help();
+        return 0;
+    }
+
+    if (max_threads < 1 || width <= 0 || height <= 0) {
+        print_help();
+        return 0;
+    }
+
+    size = yuv_format_frame_size(format, width, height);
+    yuv = malloc(size);
+    rgb = malloc(width * height * sizeof(uint32_t));
+    if (yuv == NULL || rgb == NULL) {
+        perror("Memory malloc fail");
+        return 1;
+    }
+
+    if (load_frame(fn, yuv, size) < 0)
+        return 1;
+
+    k = yuv_kernel_select();
+    printf("%s %dx%d %s %s %s, kernel %s, %d iterations\n",
+           fn, width, height, yuv_format_name(format), yuv_matrix_name(matrix),
+           yuv_range_name(range), k->name, iterations);
+    printf("threads  ms/frame      fps  speedup\n");
+
+    for (t = 1; t <= max_threads; t++) {
+        struct yuv_pool *pool = yuv_pool_create(t);
+        double start, ms;
+
+        /* Warm up caches and wake the workers */
+        yuv_rgb_conversion_mt(pool, k, rgb, yuv, format, coefs, width, height);
+
+        start = now_ms();
+        for (i = 0; i < iterations; i++)
+            yuv_rgb_conversion_mt(pool, k, rgb, yuv, format, coefs, width, height);
+        ms = (now_ms() - start) / iterations;
+
+        if (t == 1)
+            base = ms;
+
+        printf("%7d %9.3f %8.1f %7.2fx\n", yuv_pool_threads(pool), ms,
+               1000.0 / ms, base / ms);
+        yuv_pool_destroy(pool);
+    }
+
+    free(rgb);
+    free(yuv);
+    return 0;
+}
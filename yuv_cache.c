@@ -0,0 +1,223 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "yuv_cache.h"
+
+#define CACHE_BUCKETS 256   /* power of 2 */
+
+struct cache_entry {
+    int64_t key;
+    struct cache_entry *prev;   /* towards the most recently used */
+    struct cache_entry *next;
+    struct cache_entry *chain;  /* same bucket */
+    size_t capacity;            /* of data */
+    int count;
+    size_t sizes[YUV_CACHE_MAX_PARTS];
+    unsigned char data[];       /* the parts back to back */
+};
+
+struct yuv_cache {
+    size_t budget;
+    size_t bytes;
+    int frames;
+    struct cache_entry *head;   /* most recently used */
+    struct cache_entry *tail;
+    struct cache_entry *buckets[CACHE_BUCKETS];
+    uint64_t hits;
+    uint64_t misses;
+};
+
+static inline unsigned int bucket_of(int64_t key)
+{
+    return (unsigned int) ((uint64_t) key * 0x9e3779b97f4a7c15ull >> 56) &
+           (CACHE_BUCKETS - 1);
+}
+
+static struct cache_entry *lookup(struct yuv_cache *cache, int64_t key)
+{
+    struct cache_entry *e;
+
+    for (e = cache->buckets[bucket_of(key)]; e; e = e->chain) {
+        if (e->key == key)
+            return e;
+    }
+
+    return NULL;
+}
+
+static void link_head(struct yuv_cache *cache, struct cache_entry *e)
+{
+    e->prev = NULL;
+    e->next = cache->head;
+    if (cache->head)
+        cache->head->prev = e;
+    else
+        cache->tail = e;
+    cache->head = e;
+}
+
+static void unlink_list(struct yuv_cache *cache, struct cache_entry *e)
+{
+    if (e->prev)
+        e->prev->next = e->next;
+    else
+        cache->head = e->next;
+    if (e->next)
+        e->next->prev = e->prev;
+    else
+        cache->tail = e->prev;
+}
+
+/* Out of the list and its bucket, no longer counted */
+static void detach(struct yuv_cache *cache, struct cache_entry *e)
+{
+    struct cache_entry **p = &cache->buckets[bucket_of(e->key)];
+
+    while (*p != e)
+        p = &(*p)->chain;
+    *p = e->chain;
+
+    unlink_list(cache, e);
+    cache->bytes -= e->capacity;
+    cache->frames--;
+}
+
+struct yuv_cache *yuv_cache_create(size_t budget)
+{
+    struct yuv_cache *cache = calloc(1, sizeof(*cache));
+
+    if (cache == NULL) {
+        perror("Memory cache calloc fail");
+        return NULL;
+    }
+    cache->budget = budget;
+
+    return cache;
+}
+
+void yuv_cache_destroy(struct yuv_cache *cache)
+{
+    if (cache == NULL)
+        return;
+
+    yuv_cache_clear(cache);
+    free(cache);
+}
+
+void yuv_cache_clear(struct yuv_cache *cache)
+{
+    struct cache_entry *e, *next;
+
+    for (e = cache->head; e; e = next) {
+        next = e->next;
+        free(e);
+    }
+    cache->head = cache->tail = NULL;
+    memset(cache->buckets, 0, sizeof(cache->buckets));
+    cache->bytes = 0;
+    cache->frames = 0;
+}
+
+int yuv_cache_put(struct yuv_cache *cache, int64_t key,
+                  const struct yuv_cache_part *parts, int count)
+{
+    struct cache_entry *e, *victim;
+    size_t total = 0, pos = 0;
+    int i;
+
+    if (count > YUV_CACHE_MAX_PARTS)
+        return 1;
+    for (i = 0; i < count; i++)
+        total += parts[i].size;
+
+    /* The old copy is stale either way, its memory may do for the new */
+    e = lookup(cache, key);
+    if (e)
+        detach(cache, e);
+
+    if (total > cache->budget) {
+        free(e);
+        return 1;
+    }
+
+    /* Steady playback evicts one frame per put and reuses its memory */
+    while (cache->tail &&
+           cache->bytes + (e && e->capacity >= total ? e->capacity : total) >
+           cache->budget) {
+        victim = cache->tail;
+        detach(cache, victim);
+        if (e == NULL && victim->capacity >= total)
+            e = victim;
+        else
+            free(victim);
+    }
+
+    if (e && (e->capacity < total ||
+              cache->bytes + e->capacity > cache->budget)) {
+        free(e);
+        e = NULL;
+    }
+
+    if (e == NULL) {
+        e = malloc(sizeof(*e) + total);
+        if (e == NULL) {
+            perror("Memory cache malloc fail");
+            return -1;
+        }
+        e->capacity = total;
+    }
+
+    e->key = key;
+    e->count = count;
+    for (i = 0; i < count; i++) {
+        e->sizes[i] = parts[i].size;
+        if (parts[i].size)
+            memcpy(e->data + pos, parts[i].data, parts[i].size);
+        pos += parts[i].size;
+    }
+
+    e->chain = cache->buckets[bucket_of(key)];
+    cache->buckets[bucket_of(key)] = e;
+    link_head(cache, e);
+    cache->bytes += e->capacity;
+    cache->frames++;
+
+    return 0;
+}
+
+int yuv_cache_get(struct yuv_cache *cache, int64_t key,
+                  struct yuv_cache_part *parts)
+{
+    struct cache_entry *e = lookup(cache, key);
+    size_t pos = 0;
+    int i;
+
+    if (e == NULL) {
+        cache->misses++;
+        return 0;
+    }
+    cache->hits++;
+
+    if (e != cache->head) {
+        unlink_list(cache, e);
+        link_head(cache, e);
+    }
+
+    for (i = 0; i < e->count; i++) {
+        parts[i].data = e->data + pos;
+        parts[i].size = e->sizes[i];
+        pos += e->sizes[i];
+    }
+
+    return e->count;
+}
+
+void yuv_cache_get_stats(const struct yuv_cache *cache,
+                         struct yuv_cache_stats *stats)
+{
+    stats->hits = cache->hits;
+    stats->misses = cache->misses;
+    stats->bytes = cache->bytes;
+    stats->frames = cache->frames;
+}
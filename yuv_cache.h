@@ -0,0 +1,52 @@
+#ifndef YUV_CACHE_H
+#define YUV_CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define YUV_CACHE_MAX_PARTS 8
+
+/*
+ * Least recently used frames kept under a byte budget. A frame is a few
+ * parts (payload, converted picture, ...) copied into one allocation,
+ * found by its key. Not locked, one thread owns it.
+ */
+struct yuv_cache;
+
+struct yuv_cache_part {
+    const void *data;
+    size_t size;
+};
+
+struct yuv_cache_stats {
+    uint64_t hits;
+    uint64_t misses;
+    size_t bytes;       /* held, at most the budget */
+    int frames;
+};
+
+struct yuv_cache *yuv_cache_create(size_t budget);
+void yuv_cache_destroy(struct yuv_cache *cache);
+
+/*
+ * Copies the parts of frame key in, replacing an older copy and dropping
+ * the least recently used frames until it fits; their memory is reused
+ * when big enough. A frame over the whole budget is not kept. Returns 0
+ * if stored, 1 if too big and -1 if memory runs out.
+ */
+int yuv_cache_put(struct yuv_cache *cache, int64_t key,
+                  const struct yuv_cache_part *parts, int count);
+
+/*
+ * Points parts (YUV_CACHE_MAX_PARTS of them) at the stored parts of
+ * frame key, valid until the next put or clear, and makes it the most
+ * recently used. Returns the part count, 0 on a miss.
+ */
+int yuv_cache_get(struct yuv_cache *cache, int64_t key,
+                  struct yuv_cache_part *parts);
+
+void yuv_cache_clear(struct yuv_cache *cache);
+void yuv_cache_get_stats(const struct yuv_cache *cache,
+                         struct yuv_cache_stats *stats);
+
+#endif
@@ -0,0 +1,568 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "yuv_chunk.h"
+#include "yuv_format.h"
+
+/* Offsets past 2 GB go through pread and fseeko, see the Makefile */
+_Static_assert(sizeof(off_t) == 8, "build with -D_FILE_OFFSET_BITS=64");
+
+#define YUV_INDEX_MAGIC 0x58444959     /* "YIDX" */
+#define YUV_INDEX_VERSION 2
+
+/*
+ * Sidecar layout: this header, count int64 header offsets, then count
+ * uint64 timestamps if has_timestamps.
+ */
+struct index_file_header {
+    uint32_t magic;
+    uint32_t version;
+    int64_t file_size;
+    int64_t file_mtime;
+    int64_t count;
+    int64_t has_timestamps;
+};
+
+int yuv_chunk_decode(const void *buf, size_t len, struct yuv_chunk *chunk)
+{
+    const struct yuv_info *v1 = buf;
+    const struct yuv_info_v2 *v2 = buf;
+
+    if (len < sizeof(struct yuv_info))
+        return sizeof(struct yuv_info);
+
+    memset(chunk, 0, sizeof(*chunk));
+    chunk->width = v1->width;
+    chunk->height = v1->height;
+    chunk->size = v1->size;
+
+    if (v1->magic == YUV_CHUNK_MAGIC) {
+        chunk->version = 1;
+        chunk->header_size = sizeof(struct yuv_info);
+        return chunk->header_size;
+    }
+
+    if (v1->magic != YUV_CHUNK_MAGIC_V2)
+        return -1;
+
+    if (len < sizeof(struct yuv_info_v2))
+        return sizeof(struct yuv_info_v2);
+
+    if (v2->header_size < sizeof(struct yuv_info_v2))
+        return -1;
+
+    chunk->version = 2;
+    chunk->header_size = v2->header_size;
+    chunk->format = v2->format;
+    chunk->timestamp_us = v2->timestamp_us;
+    chunk->frame = v2->frame;
+    chunk->crc = v2->crc;
+
+    return chunk->header_size;
+}
+
+int yuv_chunk_verify_header(const struct yuv_chunk *p)
+{
+    if (p->version != 1 && p->version != 2)
+        return -1;
+
+    /* v1 streams are always NV21, format 0 */
+    if (p->format >= YUV_FORMAT_COUNT)
+        return -1;
+
+    if (p->size != yuv_format_frame_size(p->format, p->width, p->height)) {
+        return -1;
+    }
+    return 0;
+}
+
+int yuv_chunk_read_header(FILE *fp, struct yuv_chunk *chunk)
+{
+    struct yuv_info_v2 hdr;
+    int len;
+
+    if (fread(&hdr, 1, sizeof(struct yuv_info), fp) != sizeof(struct yuv_info))
+        return feof(fp) ? 1 : -1;
+
+    if (hdr.magic == YUV_CHUNK_INDEX_MAGIC)
+        return 1;
+
+    len = yuv_chunk_decode(&hdr, sizeof(struct yuv_info), chunk);
+    if (len > (int) sizeof(struct yuv_info)) {
+        if (fread((uint8_t *) &hdr + sizeof(struct yuv_info), 1,
+                  sizeof(hdr) - sizeof(struct yuv_info), fp) !=
+            sizeof(hdr) - sizeof(struct yuv_info))
+            return -1;
+
+        len = yuv_chunk_decode(&hdr, sizeof(hdr), chunk);
+
+        /* Fields from newer versions */
+        if (len > (int) sizeof(hdr) &&
+            fseeko(fp, len - sizeof(hdr), SEEK_CUR) < 0)
+            return -1;
+    }
+
+    if (len < 0 || yuv_chunk_verify_header(chunk) < 0) {
+        printf("Header info error!\n");
+        return -1;
+    }
+
+    return 0;
+}
+
+static int pread_full(int fd, void *buf, size_t size, int64_t offset)
+{
+    uint8_t *p = buf;
+
+    while (size) {
+        ssize_t rc = pread(fd, p, size, offset);
+
+        if (rc < 0 && errno == EINTR)
+            continue;
+        if (rc <= 0)
+            return -1;
+
+        p += rc;
+        size -= rc;
+        offset += rc;
+    }
+
+    return 0;
+}
+
+int yuv_chunk_pread(int fd, int64_t offset, struct yuv_chunk *chunk,
+                    uint8_t **buf, size_t *buf_size)
+{
+    struct yuv_info_v2 hdr;
+    int len;
+
+    if (pread_full(fd, &hdr, sizeof(struct yuv_info), offset) < 0)
+        return -1;
+
+    len = yuv_chunk_decode(&hdr, sizeof(struct yuv_info), chunk);
+    if (len > (int) sizeof(struct yuv_info)) {
+        if (pread_full(fd, &hdr, sizeof(hdr), offset) < 0)
+            return -1;
+        len = yuv_chunk_decode(&hdr, sizeof(hdr), chunk);
+    }
+
+    if (len < 0 || yuv_chunk_verify_header(chunk) < 0) {
+        printf("Header info error at %lld!\n", (long long) offset);
+        return -1;
+    }
+
+    if (*buf == NULL || *buf_size < chunk->size) {
+        free(*buf);
+        *buf = malloc(chunk->size);
+        if (*buf == NULL) {
+            perror("Memory chunk malloc fail");
+            *buf_size = 0;
+            return -1;
+        }
+        *buf_size = chunk->size;
+    }
+
+    return pread_full(fd, *buf, chunk->size, offset + len);
+}
+
+/* CRC-32 (IEEE 802.3, same as zlib), slice-by-8 */
+static uint32_t crc_table[8][256];
+static pthread_once_t crc_once = PTHREAD_ONCE_INIT;
+
+static void crc_init(void)
+{
+    uint32_t c;
+    int i, j;
+
+    for (i = 0; i < 256; i++) {
+        c = i;
+        for (j = 0; j < 8; j++)
+            c = (c & 1) ? 0xedb88320 ^ (c >> 1) : c >> 1;
+        crc_table[0][i] = c;
+    }
+
+    for (i = 0; i < 256; i++) {
+        c = crc_table[0][i];
+        for (j = 1; j < 8; j++) {
+            c = crc_table[0][c & 0xff] ^ (c >> 8);
+            crc_table[j][i] = c;
+        }
+    }
+}
+
+uint32_t yuv_crc32(uint32_t crc, const void *buf, size_t len)
+{
+    const uint8_t *p = buf;
+
+    pthread_once(&crc_once, crc_init);
+    crc = ~crc;
+
+    while (len && ((uintptr_t) p & 7)) {
+        crc = crc_table[0][(crc ^ *p++) & 0xff] ^ (crc >> 8);
+        len--;
+    }
+
+    while (len >= 8) {
+        uint32_t lo, hi;
+
+        memcpy(&lo, p, 4);
+        memcpy(&hi, p + 4, 4);
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+        lo = __builtin_bswap32(lo);
+        hi = __builtin_bswap32(hi);
+#endif
+        lo ^= crc;
+        crc = crc_table[7][lo & 0xff] ^ crc_table[6][(lo >> 8) & 0xff] ^
+              crc_table[5][(lo >> 16) & 0xff] ^ crc_table[4][lo >> 24] ^
+              crc_table[3][hi & 0xff] ^ crc_table[2][(hi >> 8) & 0xff] ^
+              crc_table[1][(hi >> 16) & 0xff] ^ crc_table[0][hi >> 24];
+        p += 8;
+        len -= 8;
+    }
+
+    while (len--)
+        crc = crc_table[0][(crc ^ *p++) & 0xff] ^ (crc >> 8);
+
+    return ~crc;
+}
+
+int yuv_chunk_check_crc(const struct yuv_chunk *chunk, const void *payload)
+{
+    if (chunk->version < 2)
+        return 0;
+
+    return yuv_crc32(0, payload, chunk->size) == chunk->crc ? 0 : -1;
+}
+
+int yuv_chunk_write_v2(FILE *fp, const struct yuv_chunk *chunk,
+                       const void *payload)
+{
+    struct yuv_info_v2 hdr;
+
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.magic = YUV_CHUNK_MAGIC_V2;
+    hdr.width = chunk->width;
+    hdr.height = chunk->height;
+    hdr.size = chunk->size;
+    hdr.header_size = sizeof(hdr);
+    hdr.format = chunk->format;
+    hdr.timestamp_us = chunk->timestamp_us;
+    hdr.frame = chunk->frame;
+    hdr.crc = yuv_crc32(0, payload, chunk->size);
+
+    if (fwrite(&hdr, 1, sizeof(hdr), fp) != sizeof(hdr) ||
+        fwrite(payload, 1, chunk->size, fp) != chunk->size)
+        return -1;
+
+    return 0;
+}
+
+int yuv_chunk_write_index(FILE *fp, const struct yuv_index *index)
+{
+    struct yuv_index_footer footer;
+    struct yuv_index_entry entry;
+    struct yuv_info marker;
+    int i;
+
+    marker.magic = YUV_CHUNK_INDEX_MAGIC;
+    marker.width = 0;
+    marker.height = 0;
+    marker.size = index->count * sizeof(entry) + sizeof(footer);
+    if (fwrite(&marker, 1, sizeof(marker), fp) != sizeof(marker))
+        return -1;
+
+    memset(&footer, 0, sizeof(footer));
+    footer.magic = YUV_CHUNK_INDEX_MAGIC;
+    footer.version = 1;
+    footer.count = index->count;
+    footer.offset = ftello(fp);
+
+    for (i = 0; i < index->count; i++) {
+        entry.offset = index->offsets[i];
+        entry.timestamp_us = index->timestamps ? index->timestamps[i] : 0;
+        if (fwrite(&entry, 1, sizeof(entry), fp) != sizeof(entry))
+            return -1;
+    }
+
+    if (fwrite(&footer, 1, sizeof(footer), fp) != sizeof(footer))
+        return -1;
+
+    return 0;
+}
+
+static int index_alloc(struct yuv_index *index, int count, int timestamps)
+{
+    index->offsets = malloc(count * sizeof(int64_t));
+    index->timestamps = timestamps ? malloc(count * sizeof(uint64_t)) : NULL;
+
+    if (index->offsets == NULL || (timestamps && index->timestamps == NULL)) {
+        perror("Memory index malloc fail");
+        yuv_index_free(index);
+        return -1;
+    }
+
+    return 0;
+}
+
+/* The v2 index block at the end of the file, -1 if there is none */
+static int index_load_footer(int fd, int64_t file_size, struct yuv_index *index)
+{
+    struct yuv_index_footer footer;
+    struct yuv_index_entry *entries;
+    size_t bytes;
+    uint64_t i;
+
+    if (file_size < (int64_t) sizeof(footer) ||
+        pread_full(fd, &footer, sizeof(footer), file_size - sizeof(footer)) < 0)
+        return -1;
+
+    if (footer.magic != YUV_CHUNK_INDEX_MAGIC || footer.count == 0 ||
+        footer.count > 0x7fffffff || footer.offset < 0 ||
+        footer.offset + footer.count * sizeof(*entries) + sizeof(footer) !=
+        (uint64_t) file_size)
+        return -1;
+
+    bytes = footer.count * sizeof(*entries);
+    entries = malloc(bytes);
+    if (entries == NULL) {
+        perror("Memory index malloc fail");
+        return -1;
+    }
+
+    if (pread_full(fd, entries, bytes, footer.offset) < 0 ||
+        index_alloc(index, (int) footer.count, 1) < 0) {
+        free(entries);
+        return -1;
+    }
+
+    for (i = 0; i < footer.count; i++) {
+        index->offsets[i] = entries[i].offset;
+        index->timestamps[i] = entries[i].timestamp_us;
+    }
+    index->count = (int) footer.count;
+
+    free(entries);
+    return 0;
+}
+
+static int index_scan(int fd, int64_t file_size, struct yuv_index *index)
+{
+    struct yuv_info_v2 hdr;
+    struct yuv_chunk chunk;
+    int64_t offset = 0;
+    int capacity = 0;
+    int all_v2 = 1;
+    int len;
+
+    while (offset + (int64_t) sizeof(struct yuv_info) <= file_size) {
+        size_t want = sizeof(hdr);
+
+        if (offset + (int64_t) want > file_size)
+            want = file_size - offset;
+        if (pread_full(fd, &hdr, want, offset) < 0)
+            break;
+
+        /* Index block of a v2 file whose footer didn't load */
+        if (hdr.magic == YUV_CHUNK_INDEX_MAGIC)
+            break;
+
+        /*
+         * The fixed fields are enough, len may cover extensions from newer
+         * versions, which are skipped with the payload
+         */
+        len = yuv_chunk_decode(&hdr, want, &chunk);
+        if (len >= 0 && chunk.version == 0)
+            break;      /* truncated last header */
+        if (len < 0 || yuv_chunk_verify_header(&chunk) < 0) {
+            printf("Index: bad header at %lld, stopping\n", (long long) offset);
+            break;
+        }
+
+        /* Truncated last chunk */
+        if (offset + len + (int64_t) chunk.size > file_size)
+            break;
+
+        if (index->count == capacity) {
+            int64_t *p;
+            uint64_t *t;
+
+            capacity = capacity ? capacity * 2 : 1024;
+            p = realloc(index->offsets, capacity * sizeof(int64_t));
+            if (p)
+                index->offsets = p;
+            t = realloc(index->timestamps, capacity * sizeof(uint64_t));
+            if (t)
+                index->timestamps = t;
+            if (p == NULL || t == NULL) {
+                perror("Memory index realloc fail");
+                yuv_index_free(index);
+                return -1;
+            }
+        }
+
+        index->offsets[index->count] = offset;
+        index->timestamps[index->count] = chunk.timestamp_us;
+        index->count++;
+        offset += len + chunk.size;
+
+        if (chunk.version < 2)
+            all_v2 = 0;
+    }
+
+    /* v1 chunks have no timestamps */
+    if (!all_v2) {
+        free(index->timestamps);
+        index->timestamps = NULL;
+    }
+
+    return 0;
+}
+
+int yuv_index_build(int fd, struct yuv_index *index)
+{
+    struct stat st;
+
+    memset(index, 0, sizeof(*index));
+
+    if (fstat(fd, &st) < 0) {
+        perror("Index stat fail");
+        return -1;
+    }
+
+    if (index_load_footer(fd, st.st_size, index) == 0)
+        return 0;
+
+    return index_scan(fd, st.st_size, index);
+}
+
+static char *sidecar_name(const char *fn)
+{
+    char *name = malloc(strlen(fn) + 5);
+
+    if (name)
+        sprintf(name, "%s.idx", fn);
+    return name;
+}
+
+static int sidecar_load(const char *name, const struct stat *st,
+                        struct yuv_index *index)
+{
+    struct index_file_header hdr;
+    FILE *fp = fopen(name, "r");
+
+    if (!fp)
+        return -1;
+
+    if (fread(&hdr, 1, sizeof(hdr), fp) != sizeof(hdr) ||
+        hdr.magic != YUV_INDEX_MAGIC || hdr.version != YUV_INDEX_VERSION ||
+        hdr.file_size != st->st_size || hdr.file_mtime != st->st_mtime ||
+        hdr.count <= 0 || hdr.count > 0x7fffffff ||
+        index_alloc(index, (int) hdr.count, hdr.has_timestamps != 0) < 0) {
+        fclose(fp);
+        return -1;
+    }
+
+    if (fread(index->offsets, sizeof(int64_t), hdr.count, fp) != (size_t) hdr.count ||
+        (index->timestamps &&
+         fread(index->timestamps, sizeof(uint64_t), hdr.count, fp) != (size_t) hdr.count)) {
+        yuv_index_free(index);
+        fclose(fp);
+        return -1;
+    }
+
+    index->count = (int) hdr.count;
+    fclose(fp);
+    return 0;
+}
+
+static void sidecar_save(const char *name, const struct stat *st,
+                         const struct yuv_index *index)
+{
+    struct index_file_header hdr;
+    char *tmp = malloc(strlen(name) + 5);
+    FILE *fp;
+    int ok;
+
+    if (tmp == NULL)
+        return;
+    sprintf(tmp, "%s.tmp", name);
+
+    fp = fopen(tmp, "w");
+    if (!fp) {
+        /* Read-only location, just rebuild next time */
+        free(tmp);
+        return;
+    }
+
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.magic = YUV_INDEX_MAGIC;
+    hdr.version = YUV_INDEX_VERSION;
+    hdr.file_size = st->st_size;
+    hdr.file_mtime = st->st_mtime;
+    hdr.count = index->count;
+    hdr.has_timestamps = index->timestamps != NULL;
+
+    ok = fwrite(&hdr, 1, sizeof(hdr), fp) == sizeof(hdr) &&
+         fwrite(index->offsets, sizeof(int64_t), index->count, fp) == (size_t) index->count &&
+         (!index->timestamps ||
+          fwrite(index->timestamps, sizeof(uint64_t), index->count, fp) == (size_t) index->count);
+
+    if (fclose(fp) == 0 && ok)
+        rename(tmp, name);
+    else
+        unlink(tmp);
+    free(tmp);
+}
+
+int yuv_index_open(const char *fn, int fd, struct yuv_index *index)
+{
+    struct stat st;
+    char *name;
+
+    memset(index, 0, sizeof(*index));
+
+    if (fstat(fd, &st) < 0) {
+        perror("Index stat fail");
+        return -1;
+    }
+
+    /* Pipes and sockets can't be indexed */
+    if (!S_ISREG(st.st_mode))
+        return -1;
+
+    /* v2 files carry their own index */
+    if (index_load_footer(fd, st.st_size, index) == 0)
+        return 0;
+
+    name = sidecar_name(fn);
+    if (name && sidecar_load(name, &st, index) == 0) {
+        free(name);
+        return 0;
+    }
+
+    if (index_scan(fd, st.st_size, index) < 0) {
+        free(name);
+        return -1;
+    }
+
+    if (name && index->count > 0)
+        sidecar_save(name, &st, index);
+    free(name);
+
+    return 0;
+}
+
+void yuv_index_free(struct yuv_index *index)
+{
+    free(index->offsets);
+    free(index->timestamps);
+    index->offsets = NULL;
+    index->timestamps = NULL;
+    index->count = 0;
+}
@@ -0,0 +1,120 @@
+#ifndef YUV_CHUNK_H
+#define YUV_CHUNK_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define YUV_CHUNK_MAGIC 0x1234CCCC
+#define YUV_CHUNK_MAGIC_V2 0x1234CCCD
+#define YUV_CHUNK_INDEX_MAGIC 0x32584959    /* "YIX2" */
+
+/* Chunk stream: each frame is a header followed by size bytes of YUV */
+struct yuv_info {
+    unsigned int magic;
+    unsigned int width;
+    unsigned int height;
+    unsigned int size;
+};
+
+/*
+ * Version 2 header. The first 16 bytes keep the v1 layout. header_size
+ * lets later versions append fields that older readers skip.
+ */
+struct yuv_info_v2 {
+    uint32_t magic;
+    uint32_t width;
+    uint32_t height;
+    uint32_t size;
+    uint32_t header_size;
+    uint32_t format;        /* enum yuv_format, 0 is the v1 NV21 layout */
+    uint64_t timestamp_us;  /* capture time */
+    uint64_t frame;         /* capture frame number */
+    uint32_t crc;           /* CRC-32 of the payload */
+    uint32_t reserved;
+};
+
+/*
+ * A v2 file may end with an index block: a struct yuv_info with the
+ * index magic (size covers the rest of the block), count entries, then
+ * the footer as the last bytes of the file.
+ */
+struct yuv_index_entry {
+    int64_t offset;
+    uint64_t timestamp_us;
+};
+
+struct yuv_index_footer {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t count;
+    int64_t offset;         /* of the first entry */
+};
+
+/* A decoded header of either version */
+struct yuv_chunk {
+    int version;
+    unsigned int width;
+    unsigned int height;
+    unsigned int size;
+    unsigned int format;
+    unsigned int header_size;
+    uint64_t timestamp_us;  /* 0 for v1 */
+    uint64_t frame;
+    uint32_t crc;
+};
+
+/*
+ * Decodes the header at buf. Returns its full length, which can be more
+ * than len for v2 (call again with that many bytes), or -1.
+ */
+int yuv_chunk_decode(const void *buf, size_t len, struct yuv_chunk *chunk);
+
+int yuv_chunk_verify_header(const struct yuv_chunk *chunk);
+
+/*
+ * Reads and verifies the next header. Returns 1 at the end of the frames
+ * (EOF or the index block), -1 on a read error or bad header.
+ */
+int yuv_chunk_read_header(FILE *fp, struct yuv_chunk *chunk);
+
+/*
+ * Reads and verifies the chunk at offset, payload included, with pread so
+ * threads can share fd. *buf is grown to fit. 0 on success, -1 on error.
+ */
+int yuv_chunk_pread(int fd, int64_t offset, struct yuv_chunk *chunk,
+                    uint8_t **buf, size_t *buf_size);
+
+uint32_t yuv_crc32(uint32_t crc, const void *buf, size_t len);
+
+/* 0 if the payload matches the header's CRC (always for v1) */
+int yuv_chunk_check_crc(const struct yuv_chunk *chunk, const void *payload);
+
+int yuv_chunk_write_v2(FILE *fp, const struct yuv_chunk *chunk,
+                       const void *payload);
+
+/* Offset of every chunk header in a stream, plus v2 timestamps */
+struct yuv_index {
+    int64_t *offsets;
+    uint64_t *timestamps;   /* NULL for v1 streams */
+    int count;
+};
+
+/* Appends the index block for a v2 file written from offset 0 */
+int yuv_chunk_write_index(FILE *fp, const struct yuv_index *index);
+
+/*
+ * Uses the v2 index block if the file has one, otherwise scans the
+ * headers, skipping payloads. A scan stops at the first bad chunk.
+ */
+int yuv_index_build(int fd, struct yuv_index *index);
+
+/*
+ * Like yuv_index_build(), but a scan result is cached in the sidecar
+ * <fn>.idx and reused while it still matches the file.
+ */
+int yuv_index_open(const char *fn, int fd, struct yuv_index *index);
+
+void yuv_index_free(struct yuv_index *index);
+
+#endif
@@ -0,0 +1,346 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include "yuv_metrics.h"
+#include "yuv_pool.h"
+#include "yuv_chunk.h"
+
+/* One side of the comparison, raw frames or a chunk stream */
+struct compare_input {
+    const char *fn;
+    int frames;
+
+    /* Raw input: frames back to back in the mapping */
+    uint8_t *map;
+    size_t map_size;
+    size_t frame_size;
+
+    /* Chunk input */
+    int fd;
+    struct yuv_index index;
+    uint8_t *buf;
+    size_t buf_size;
+};
+
+/* A frame as read, with the layout it came in */
+struct compare_frame {
+    const uint8_t *yuv;
+    enum yuv_format format;
+    int width;
+    int height;
+};
+
+/* Worst frame per plane, 1 based */
+struct compare_worst {
+    double psnr;
+    int psnr_frame;
+    double ssim;
+    int ssim_frame;
+};
+
+static const char *plane_names[YUV_PLANE_COUNT] = { "Y", "U", "V" };
+
+static double now_sec(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int open_raw(struct compare_input *in, enum yuv_format format,
+                    int width, int height)
+{
+    struct stat st;
+    int fd;
+
+    in->frame_size = yuv_format_frame_size(format, width, height);
+
+    fd = open(in->fn, O_RDONLY);
+    if (fd < 0) {
+        perror(in->fn);
+        return -1;
+    }
+
+    if (fstat(fd, &st) < 0 || in->frame_size == 0 ||
+        (uint64_t) st.st_size < in->frame_size) {
+        printf("%s: file size is not match resolution setting!\n", in->fn);
+        close(fd);
+        return -1;
+    }
+
+    if ((uint64_t) st.st_size > SIZE_MAX ||
+        (uint64_t) st.st_size / in->frame_size > INT_MAX) {
+        printf("%s: file is too large to map on this system\n", in->fn);
+        close(fd);
+        return -1;
+    }
+
+    in->map_size = st.st_size / in->frame_size * in->frame_size;
+    in->map = mmap(NULL, in->map_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if (in->map == MAP_FAILED) {
+        perror("File mmap fail");
+        in->map = NULL;
+        return -1;
+    }
+
+    /* Each frame is read once, in order */
+    madvise(in->map, in->map_size, MADV_SEQUENTIAL);
+    in->frames = in->map_size / in->frame_size;
+
+    return 0;
+}
+
+static int open_chunks(struct compare_input *in)
+{
+    in->fd = open(in->fn, O_RDONLY);
+    if (in->fd < 0) {
+        perror(in->fn);
+        return -1;
+    }
+
+    if (yuv_index_open(in->fn, in->fd, &in->index) < 0)
+        return -1;
+
+    posix_fadvise(in->fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    in->frames = in->index.count;
+
+    return 0;
+}
+
+static int read_frame(struct compare_input *in, int id, enum yuv_format format,
+                      int width, int height, struct compare_frame *f)
+{
+    struct yuv_chunk chunk;
+
+    if (in->map) {
+        f->yuv = in->map + (size_t) id * in->frame_size;
+        f->format = format;
+        f->width = width;
+        f->height = height;
+        return 0;
+    }
+
+    if (yuv_chunk_pread(in->fd, in->index.offsets[id], &chunk, &in->buf,
+                        &in->buf_size) < 0) {
+        fprintf(stderr, "%s: read frame %d fail\n", in->fn, id + 1);
+        return -1;
+    }
+
+    f->yuv = in->buf;
+    f->format = chunk.format;
+    f->width = chunk.width;
+    f->height = chunk.height;
+
+    return 0;
+}
+
+static void close_input(struct compare_input *in)
+{
+    if (in->map)
+        munmap(in->map, in->map_size);
+    if (in->fd >= 0)
+        close(in->fd);
+    yuv_index_free(&in->index);
+    free(in->buf);
+}
+
+static void print_help()
+{
+    printf("Usage:\n");
+    printf("\tyuv_compare [-j threads] [-o metrics.csv] [-f first] [-n count] [-F format]\n"
+           "\t            a b [width height]\n");
+    printf("\tMeasures PSNR and SSIM per plane of every frame of b against a, in\n"
+           "\tlockstep up to the shorter of the two\n");
+    printf("\tWithout width and height both are chunk streams, otherwise raw frames\n");
+    printf("\t-o writes one CSV row per frame, - for stdout\n");
+    printf("\tformat: nv21 (default), nv12, i420, yv12, yuyv, uyvy, i422, i444\n");
+}
+
+int main(int argc, char *argv[])
+{
+    struct compare_input in[2];
+    struct compare_frame fa, fb;
+    struct compare_worst worst[YUV_PLANE_COUNT];
+    struct yuv_metrics m;
+    struct yuv_pool *pool;
+    enum yuv_format format = YUV_FORMAT_NV21;
+    uint64_t sse[YUV_PLANE_COUNT] = { 0 }, samples[YUV_PLANE_COUNT] = { 0 };
+    double ssim[YUV_PLANE_COUNT] = { 0 };
+    const char *csv_fn = NULL;
+    FILE *csv = NULL;
+    int opt, i, p, threads = 0, first = 1, count = -1, width = 0, height = 0;
+    int frames, last, done = 0, rc = 0;
+    double start, sec;
+
+    while ((opt = getopt(argc, argv, "j:o:f:n:F:h")) != -1) {
+        switch (opt) {
+        case 'j':
+            threads = atoi(optarg);
+            break;
+        case 'o':
+            csv_fn = optarg;
+            break;
+        case 'f':
+            first = atoi(optarg);
+            break;
+        case 'n':
+            count = atoi(optarg);
+            break;
+        case 'F':
+            format = yuv_format_parse(optarg);
+            if ((int) format < 0) {
+                print_help();
+                return 0;
+            }
+            break;
+        default:
+            print_help();
+            return 0;
+        }
+    }
+
+    if ((argc - optind != 2 && argc - optind != 4) || first < 1) {
+        print_help();
+        return 0;
+    }
+
+    memset(in, 0, sizeof(in));
+    for (i = 0; i < 2; i++) {
+        in[i].fn = argv[optind + i];
+        in[i].fd = -1;
+    }
+
+    if (argc - optind == 4) {
+        width = atoi(argv[optind + 2]);
+        height = atoi(argv[optind + 3]);
+        for (i = 0; i < 2 && rc == 0; i++)
+            rc = open_raw(&in[i], format, width, height);
+    }
+    else {
+        for (i = 0; i < 2 && rc == 0; i++)
+            rc = open_chunks(&in[i]);
+    }
+
+    if (rc < 0) {
+        printf("Open file error!\n");
+        return 1;
+    }
+
+    frames = in[0].frames < in[1].frames ? in[0].frames : in[1].frames;
+    if (in[0].frames != in[1].frames)
+        printf("%s has %d frames, %s has %d, comparing %d\n", in[0].fn,
+               in[0].frames, in[1].fn, in[1].frames, frames);
+
+    last = frames - 1;
+    if (count >= 0 && first - 1 + count - 1 < last)
+        last = first - 1 + count - 1;
+    if (first - 1 > last) {
+        printf("No frames to compare, %d in common\n", frames);
+        return 1;
+    }
+
+    if (csv_fn) {
+        csv = strcmp(csv_fn, "-") ? fopen(csv_fn, "w") : stdout;
+        if (csv == NULL) {
+            perror(csv_fn);
+            return 1;
+        }
+        fprintf(csv, "frame,psnr_y,psnr_u,psnr_v,ssim_y,ssim_u,ssim_v\n");
+    }
+
+    for (p = 0; p < YUV_PLANE_COUNT; p++) {
+        worst[p].psnr = YUV_PSNR_MAX + 1;
+        worst[p].ssim = 2;
+    }
+
+    /* Frames in order so the CSV streams, each one split over the pool */
+    pool = yuv_pool_create(threads);
+    fprintf(csv == stdout ? stderr : stdout,
+            "Comparing frames %d-%d of %s and %s, kernel %s, %d threads\n",
+            first, last + 1, in[0].fn, in[1].fn, yuv_metrics_kernel_name(),
+            yuv_pool_threads(pool));
+
+    start = now_sec();
+    for (i = first - 1; i <= last; i++) {
+        if (read_frame(&in[0], i, format, width, height, &fa) < 0 ||
+            read_frame(&in[1], i, format, width, height, &fb) < 0) {
+            rc = -1;
+            break;
+        }
+
+        if (fa.format != fb.format || fa.width != fb.width ||
+            fa.height != fb.height) {
+            fprintf(stderr, "Frame %d: %dx%d %s against %dx%d %s, "
+                    "cannot compare\n", i + 1, fa.width, fa.height,
+                    yuv_format_name(fa.format), fb.width, fb.height,
+                    yuv_format_name(fb.format));
+            rc = -1;
+            break;
+        }
+
+        if (yuv_metrics_compute(pool, &m, fa.yuv, fb.yuv, fa.format,
+                                fa.width, fa.height) < 0) {
+            rc = -1;
+            break;
+        }
+
+        for (p = 0; p < YUV_PLANE_COUNT; p++) {
+            sse[p] += m.sse[p];
+            samples[p] += m.samples[p];
+            ssim[p] += m.ssim[p];
+            if (m.psnr[p] < worst[p].psnr) {
+                worst[p].psnr = m.psnr[p];
+                worst[p].psnr_frame = i + 1;
+            }
+            if (m.ssim[p] < worst[p].ssim) {
+                worst[p].ssim = m.ssim[p];
+                worst[p].ssim_frame = i + 1;
+            }
+        }
+
+        if (csv)
+            fprintf(csv, "%d,%.4f,%.4f,%.4f,%.6f,%.6f,%.6f\n", i + 1,
+                    m.psnr[0], m.psnr[1], m.psnr[2],
+                    m.ssim[0], m.ssim[1], m.ssim[2]);
+        done++;
+    }
+    sec = now_sec() - start;
+
+    if (csv && csv != stdout && fclose(csv) != 0) {
+        perror(csv_fn);
+        rc = -1;
+    }
+
+    /* PSNR over the whole run comes from the summed errors, not frame dBs */
+    if (done) {
+        FILE *out = csv == stdout ? stderr : stdout;
+
+        for (p = 0; p < YUV_PLANE_COUNT; p++)
+            fprintf(out, "%s: PSNR %.2f dB (worst %.2f at frame %d), "
+                    "SSIM %.4f (worst %.4f at frame %d)\n", plane_names[p],
+                    yuv_psnr(sse[p], samples[p]), worst[p].psnr,
+                    worst[p].psnr_frame, ssim[p] / done, worst[p].ssim,
+                    worst[p].ssim_frame);
+        fprintf(out, "%d frames in %.2f s, %.1f frames/s\n", done, sec,
+                sec > 0 ? done / sec : 0);
+    }
+
+    yuv_pool_destroy(pool);
+    close_input(&in[0]);
+    close_input(&in[1]);
+
+    return rc < 0 ? 1 : 0;
+}
@@ -0,0 +1,1140 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "yuv_convert.h"
+#include "yuv_pool.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define YUV_HAVE_X86 1
+#include <immintrin.h>
+#endif
+
+#if defined(__ARM_NEON) || defined(__aarch64__)
+#define YUV_HAVE_NEON 1
+#include <arm_neon.h>
+#endif
+
+/*
+ * Coefficients with a 10 bit fraction, rounded from Kr/Kb of each matrix
+ * and scaled by 255/219 (luma) and 255/224 (chroma) for limited range.
+ * BT.601 limited keeps the 400 and 833 this converter always used, so
+ * its output is unchanged.
+ */
+static const struct yuv_coefs coef_table[YUV_MATRIX_COUNT][YUV_RANGE_COUNT] = {
+    [YUV_MATRIX_BT601] = {
+        [YUV_RANGE_LIMITED] = { 16, 1192, 1634, 400, 833, 2066 },
+        [YUV_RANGE_FULL]    = {  0, 1024, 1436, 352, 731, 1815 },
+    },
+    [YUV_MATRIX_BT709] = {
+        [YUV_RANGE_LIMITED] = { 16, 1192, 1836, 218, 546, 2163 },
+        [YUV_RANGE_FULL]    = {  0, 1024, 1613, 192, 479, 1900 },
+    },
+    [YUV_MATRIX_BT2020] = {
+        [YUV_RANGE_LIMITED] = { 16, 1192, 1719, 192, 666, 2193 },
+        [YUV_RANGE_FULL]    = {  0, 1024, 1510, 169, 585, 1927 },
+    },
+};
+
+static const char *matrix_names[] = {
+    [YUV_MATRIX_BT601] = "bt601",
+    [YUV_MATRIX_BT709] = "bt709",
+    [YUV_MATRIX_BT2020] = "bt2020",
+};
+
+static const char *range_names[] = {
+    [YUV_RANGE_LIMITED] = "limited",
+    [YUV_RANGE_FULL] = "full",
+};
+
+const struct yuv_coefs *yuv_coefs_get(enum yuv_matrix matrix,
+                                      enum yuv_range range)
+{
+    return &coef_table[matrix][range];
+}
+
+int yuv_matrix_parse(const char *name)
+{
+    int i;
+
+    for (i = 0; i < YUV_MATRIX_COUNT; i++) {
+        if (!strcmp(name, matrix_names[i]))
+            return i;
+    }
+
+    return -1;
+}
+
+const char *yuv_matrix_name(enum yuv_matrix matrix)
+{
+    return matrix_names[matrix];
+}
+
+int yuv_range_parse(const char *name)
+{
+    int i;
+
+    for (i = 0; i < YUV_RANGE_COUNT; i++) {
+        if (!strcmp(name, range_names[i]))
+            return i;
+    }
+
+    return -1;
+}
+
+const char *yuv_range_name(enum yuv_range range)
+{
+    return range_names[range];
+}
+
+/* u and v are already centered on 0 */
+static inline uint32_t yuv_pixel(const struct yuv_coefs *c, int y, int u, int v)
+{
+    y -= c->y_off;
+    if (y < 0) y = 0;
+
+    int yy = c->y * y;
+    int r = (yy + c->rv * v);
+    int g = (yy - c->gv * v - c->gu * u);
+    int b = (yy + c->bu * u);
+
+    if (r < 0) r = 0;
+    else if (r > 262143) r = 262143;
+    if (g < 0) g = 0;
+    else if (g > 262143) g = 262143;
+    if (b < 0) b = 0;
+    else if (b > 262143) b = 262143;
+
+    return 0xff000000 | ((r << 6) & 0xff0000) | ((g >> 2) & 0xff00) | ((b >> 10) & 0xff);
+}
+
+/*
+ * Sample layout within one row. Each kernel is written once over the
+ * layout and instantiated per layout with it as a constant, so the
+ * inner loops carry no format checks.
+ */
+enum row_layout {
+    LAYOUT_VU,          /* semi-planar, V first */
+    LAYOUT_UV,          /* semi-planar, U first */
+    LAYOUT_PLANAR,      /* separate U and V rows at half width */
+    LAYOUT_444,         /* separate U and V rows at full width */
+    LAYOUT_YUYV,
+    LAYOUT_UYVY,
+};
+
+#define ALWAYS_INLINE inline __attribute__((always_inline))
+
+/* Bytes between luma samples */
+static ALWAYS_INLINE int layout_y_step(enum row_layout l)
+{
+    return l == LAYOUT_YUYV || l == LAYOUT_UYVY ? 2 : 1;
+}
+
+/* Bytes between chroma samples of one plane */
+static ALWAYS_INLINE int layout_c_step(enum row_layout l)
+{
+    if (l == LAYOUT_VU || l == LAYOUT_UV)
+        return 2;
+    if (l == LAYOUT_YUYV || l == LAYOUT_UYVY)
+        return 4;
+    return 1;
+}
+
+/* Pixel i uses chroma sample i >> shift */
+static ALWAYS_INLINE int layout_c_shift(enum row_layout l)
+{
+    return l == LAYOUT_444 ? 0 : 1;
+}
+
+static ALWAYS_INLINE void row_c(uint32_t *rgb, const uint8_t *yp,
+                                const uint8_t *up, const uint8_t *vp,
+                                int width, const struct yuv_coefs *coefs,
+                                const enum row_layout l)
+{
+    /* A local copy, stores to rgb could otherwise alias the coefficients */
+    const struct yuv_coefs c = *coefs;
+    const int ys = layout_y_step(l);
+    const int cs = layout_c_step(l);
+    int i, u, v;
+
+    if (l == LAYOUT_444) {
+        for (i = 0; i < width; i++)
+            rgb[i] = yuv_pixel(&c, yp[i], up[i] - 128, vp[i] - 128);
+        return;
+    }
+
+    for (i = 0; i + 1 < width; i += 2) {
+        u = *up - 128;
+        v = *vp - 128;
+        rgb[i] = yuv_pixel(&c, yp[0], u, v);
+        rgb[i + 1] = yuv_pixel(&c, yp[ys], u, v);
+        yp += 2 * ys;
+        up += cs;
+        vp += cs;
+    }
+
+    if (i < width)
+        rgb[i] = yuv_pixel(&c, *yp, *up - 128, *vp - 128);
+}
+
+/* Finishes a row from pixel i with the scalar code */
+static ALWAYS_INLINE void row_tail(uint32_t *rgb, const uint8_t *yp,
+                                   const uint8_t *up, const uint8_t *vp,
+                                   int width, int i,
+                                   const struct yuv_coefs *coefs,
+                                   const enum row_layout l)
+{
+    int c = (i >> layout_c_shift(l)) * layout_c_step(l);
+
+    if (i < width)
+        row_c(rgb + i, yp + i * layout_y_step(l), up + c, vp + c, width - i,
+              coefs, l);
+}
+
+/* One yuv_row_fn per layout around a kernel template */
+#define ROW_INSTANCE(kernel, suffix, layout, attr)                          \
+    attr static void kernel##_##suffix(uint32_t *rgb, const uint8_t *yp,    \
+                                       const uint8_t *up, const uint8_t *vp,\
+                                       int width,                           \
+                                       const struct yuv_coefs *coefs)       \
+    {                                                                       \
+        kernel(rgb, yp, up, vp, width, coefs, layout);                      \
+    }
+
+#define ROW_INSTANCES(kernel, attr)                                         \
+    ROW_INSTANCE(kernel, vu, LAYOUT_VU, attr)                               \
+    ROW_INSTANCE(kernel, uv, LAYOUT_UV, attr)                               \
+    ROW_INSTANCE(kernel, planar, LAYOUT_PLANAR, attr)                       \
+    ROW_INSTANCE(kernel, 444, LAYOUT_444, attr)                             \
+    ROW_INSTANCE(kernel, yuyv, LAYOUT_YUYV, attr)                           \
+    ROW_INSTANCE(kernel, uyvy, LAYOUT_UYVY, attr)
+
+#define ROW_TABLE(kernel) {                                                 \
+        [YUV_FORMAT_NV21] = kernel##_vu,                                    \
+        [YUV_FORMAT_NV12] = kernel##_uv,                                    \
+        [YUV_FORMAT_I420] = kernel##_planar,                                \
+        [YUV_FORMAT_YV12] = kernel##_planar,                                \
+        [YUV_FORMAT_YUYV] = kernel##_yuyv,                                  \
+        [YUV_FORMAT_UYVY] = kernel##_uyvy,                                  \
+        [YUV_FORMAT_I422] = kernel##_planar,                                \
+        [YUV_FORMAT_I444] = kernel##_444,                                   \
+    }
+
+ROW_INSTANCES(row_c, )
+
+/*
+ * The vector kernels clamp after the >> 10 instead of before it, which
+ * gives the same 8 bit result as the scalar code for every input.
+ * Coefficients go through pmaddwd as (a, b) int16 pairs.
+ */
+#define COEF_PAIR(a, b) \
+    ((int) (((uint32_t) (uint16_t) (b) << 16) | (uint16_t) (a)))
+
+#ifdef YUV_HAVE_X86
+
+static int cpu_has_sse2(void)
+{
+    return __builtin_cpu_supports("sse2");
+}
+
+static int cpu_has_avx2(void)
+{
+    return __builtin_cpu_supports("avx2");
+}
+
+/* Coefficient pairs for pmaddwd, set up once per row */
+struct sse2_coefs {
+    __m128i r;
+    __m128i gv;
+    __m128i gu;
+    __m128i b;
+    __m128i y_off;
+};
+
+__attribute__((target("sse2")))
+static ALWAYS_INLINE void sse2_coefs_init(struct sse2_coefs *k,
+                                          const struct yuv_coefs *c)
+{
+    k->r = _mm_set1_epi32(COEF_PAIR(c->y, c->rv));
+    k->gv = _mm_set1_epi32(COEF_PAIR(c->y, -c->gv));
+    k->gu = _mm_set1_epi32(COEF_PAIR(0, -c->gu));
+    k->b = _mm_set1_epi32(COEF_PAIR(c->y, c->bu));
+    k->y_off = _mm_set1_epi16(c->y_off);
+}
+
+/* 8 pixels: y, u, v hold one int16 per pixel, returns R/G/B as int16 */
+__attribute__((target("sse2")))
+static inline void sse2_px8(const struct sse2_coefs *k,
+                            __m128i y, __m128i u, __m128i v,
+                            __m128i *r, __m128i *g, __m128i *b)
+{
+    const __m128i c_r = k->r;
+    const __m128i c_gv = k->gv;
+    const __m128i c_gu = k->gu;
+    const __m128i c_b = k->b;
+    __m128i yv0 = _mm_unpacklo_epi16(y, v);
+    __m128i yv1 = _mm_unpackhi_epi16(y, v);
+    __m128i yu0 = _mm_unpacklo_epi16(y, u);
+    __m128i yu1 = _mm_unpackhi_epi16(y, u);
+    __m128i t0, t1;
+
+    t0 = _mm_srai_epi32(_mm_madd_epi16(yv0, c_r), 10);
+    t1 = _mm_srai_epi32(_mm_madd_epi16(yv1, c_r), 10);
+    *r = _mm_packs_epi32(t0, t1);
+
+    t0 = _mm_add_epi32(_mm_madd_epi16(yv0, c_gv), _mm_madd_epi16(yu0, c_gu));
+    t1 = _mm_add_epi32(_mm_madd_epi16(yv1, c_gv), _mm_madd_epi16(yu1, c_gu));
+    *g = _mm_packs_epi32(_mm_srai_epi32(t0, 10), _mm_srai_epi32(t1, 10));
+
+    t0 = _mm_srai_epi32(_mm_madd_epi16(yu0, c_b), 10);
+    t1 = _mm_srai_epi32(_mm_madd_epi16(yu1, c_b), 10);
+    *b = _mm_packs_epi32(t0, t1);
+}
+
+/* 16 pixels per step */
+__attribute__((target("sse2")))
+static ALWAYS_INLINE void row_sse2(uint32_t *rgb, const uint8_t *yp,
+                                   const uint8_t *up, const uint8_t *vp,
+                                   int width, const struct yuv_coefs *coefs,
+                                   const enum row_layout l)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i alpha = _mm_set1_epi8((char) 0xff);
+    const __m128i uv_off = _mm_set1_epi16(128);
+    const __m128i lo_mask = _mm_set1_epi16(0xff);
+    const int ys = layout_y_step(l);
+    const int cs = layout_c_step(l);
+    const int sh = layout_c_shift(l);
+    struct sse2_coefs k;
+    int i;
+
+    sse2_coefs_init(&k, coefs);
+
+    for (i = 0; i + 16 <= width; i += 16) {
+        const uint8_t *y = yp + i * ys;
+        const uint8_t *u = up + (i >> sh) * cs;
+        const uint8_t *v = vp + (i >> sh) * cs;
+        __m128i ylo, yhi, ulo, uhi, vlo, vhi;
+        __m128i y8, c8, u16, v16, p0, p1;
+        __m128i r0, g0, b0, r1, g1, b1;
+        __m128i r8, g8, b8, bg, ra;
+
+        /* Widen to one int16 per pixel, chroma duplicated per pair */
+        if (l == LAYOUT_YUYV || l == LAYOUT_UYVY) {
+            /* 32 bytes from the start of the first pixel pair */
+            p0 = _mm_loadu_si128((const __m128i *) (l == LAYOUT_YUYV ? y : u));
+            p1 = _mm_loadu_si128((const __m128i *) ((l == LAYOUT_YUYV ? y : u) + 16));
+            if (l == LAYOUT_YUYV) {
+                ylo = _mm_and_si128(p0, lo_mask);
+                yhi = _mm_and_si128(p1, lo_mask);
+                c8 = _mm_packus_epi16(_mm_srli_epi16(p0, 8), _mm_srli_epi16(p1, 8));
+            }
+            else {
+                ylo = _mm_srli_epi16(p0, 8);
+                yhi = _mm_srli_epi16(p1, 8);
+                c8 = _mm_packus_epi16(_mm_and_si128(p0, lo_mask),
+                                      _mm_and_si128(p1, lo_mask));
+            }
+            u16 = _mm_and_si128(c8, lo_mask);
+            v16 = _mm_srli_epi16(c8, 8);
+        }
+        else {
+            y8 = _mm_loadu_si128((const __m128i *) y);
+            ylo = _mm_unpacklo_epi8(y8, zero);
+            yhi = _mm_unpackhi_epi8(y8, zero);
+
+            if (l == LAYOUT_VU) {
+                c8 = _mm_loadu_si128((const __m128i *) v);
+                v16 = _mm_and_si128(c8, lo_mask);
+                u16 = _mm_srli_epi16(c8, 8);
+            }
+            else if (l == LAYOUT_UV) {
+                c8 = _mm_loadu_si128((const __m128i *) u);
+                u16 = _mm_and_si128(c8, lo_mask);
+                v16 = _mm_srli_epi16(c8, 8);
+            }
+            else if (l == LAYOUT_PLANAR) {
+                u16 = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *) u), zero);
+                v16 = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *) v), zero);
+            }
+            else {
+                c8 = _mm_loadu_si128((const __m128i *) u);
+                ulo = _mm_unpacklo_epi8(c8, zero);
+                uhi = _mm_unpackhi_epi8(c8, zero);
+                c8 = _mm_loadu_si128((const __m128i *) v);
+                vlo = _mm_unpacklo_epi8(c8, zero);
+                vhi = _mm_unpackhi_epi8(c8, zero);
+            }
+        }
+
+        if (l != LAYOUT_444) {
+            ulo = _mm_unpacklo_epi16(u16, u16);
+            uhi = _mm_unpackhi_epi16(u16, u16);
+            vlo = _mm_unpacklo_epi16(v16, v16);
+            vhi = _mm_unpackhi_epi16(v16, v16);
+        }
+
+        ylo = _mm_max_epi16(_mm_sub_epi16(ylo, k.y_off), zero);
+        yhi = _mm_max_epi16(_mm_sub_epi16(yhi, k.y_off), zero);
+
+        sse2_px8(&k, ylo, _mm_sub_epi16(ulo, uv_off), _mm_sub_epi16(vlo, uv_off),
+                 &r0, &g0, &b0);
+        sse2_px8(&k, yhi, _mm_sub_epi16(uhi, uv_off), _mm_sub_epi16(vhi, uv_off),
+                 &r1, &g1, &b1);
+
+        r8 = _mm_packus_epi16(r0, r1);
+        g8 = _mm_packus_epi16(g0, g1);
+        b8 = _mm_packus_epi16(b0, b1);
+
+        bg = _mm_unpacklo_epi8(b8, g8);
+        ra = _mm_unpacklo_epi8(r8, alpha);
+        _mm_storeu_si128((__m128i *) (rgb + i), _mm_unpacklo_epi16(bg, ra));
+        _mm_storeu_si128((__m128i *) (rgb + i + 4), _mm_unpackhi_epi16(bg, ra));
+
+        bg = _mm_unpackhi_epi8(b8, g8);
+        ra = _mm_unpackhi_epi8(r8, alpha);
+        _mm_storeu_si128((__m128i *) (rgb + i + 8), _mm_unpacklo_epi16(bg, ra));
+        _mm_storeu_si128((__m128i *) (rgb + i + 12), _mm_unpackhi_epi16(bg, ra));
+    }
+
+    row_tail(rgb, yp, up, vp, width, i, coefs, l);
+}
+
+ROW_INSTANCES(row_sse2, __attribute__((target("sse2"))))
+
+struct avx2_coefs {
+    __m256i r;
+    __m256i gv;
+    __m256i gu;
+    __m256i b;
+    __m256i y_off;
+};
+
+__attribute__((target("avx2")))
+static ALWAYS_INLINE void avx2_coefs_init(struct avx2_coefs *k,
+                                          const struct yuv_coefs *c)
+{
+    k->r = _mm256_set1_epi32(COEF_PAIR(c->y, c->rv));
+    k->gv = _mm256_set1_epi32(COEF_PAIR(c->y, -c->gv));
+    k->gu = _mm256_set1_epi32(COEF_PAIR(0, -c->gu));
+    k->b = _mm256_set1_epi32(COEF_PAIR(c->y, c->bu));
+    k->y_off = _mm256_set1_epi32(c->y_off);
+}
+
+/*
+ * 8 pixels, one int32 lane per pixel, written straight as 0xAARRGGBB.
+ * y, u and v point at the samples of the first pixel.
+ */
+__attribute__((target("avx2")))
+static ALWAYS_INLINE void avx2_px8(uint32_t *rgb, const uint8_t *y8,
+                                   const uint8_t *u8, const uint8_t *v8,
+                                   const struct avx2_coefs *k,
+                                   const enum row_layout l)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i max = _mm256_set1_epi32(255);
+    const __m256i alpha = _mm256_set1_epi32((int) 0xff000000);
+    const __m256i uv_off = _mm256_set1_epi32(128);
+    const __m256i c_r = k->r;
+    const __m256i c_gv = k->gv;
+    const __m256i c_gu = k->gu;
+    const __m256i c_b = k->b;
+    const __m128i even_dup = _mm_setr_epi8(0, 0, 2, 2, 4, 4, 6, 6,
+                                           -1, -1, -1, -1, -1, -1, -1, -1);
+    const __m128i odd_dup = _mm_setr_epi8(1, 1, 3, 3, 5, 5, 7, 7,
+                                          -1, -1, -1, -1, -1, -1, -1, -1);
+    const __m128i pair_dup = _mm_setr_epi8(0, 0, 1, 1, 2, 2, 3, 3,
+                                           -1, -1, -1, -1, -1, -1, -1, -1);
+    __m128i c, cu, cv, cy;
+    __m256i y, u, v, yv, yu, r, g, b;
+    int32_t c4;
+
+    if (l == LAYOUT_YUYV || l == LAYOUT_UYVY) {
+        c = _mm_loadu_si128((const __m128i *) (l == LAYOUT_YUYV ? y8 : u8));
+        if (l == LAYOUT_YUYV) {
+            cy = _mm_shuffle_epi8(c, _mm_setr_epi8(0, 2, 4, 6, 8, 10, 12, 14,
+                                                   -1, -1, -1, -1, -1, -1, -1, -1));
+            cu = _mm_shuffle_epi8(c, _mm_setr_epi8(1, 1, 5, 5, 9, 9, 13, 13,
+                                                   -1, -1, -1, -1, -1, -1, -1, -1));
+            cv = _mm_shuffle_epi8(c, _mm_setr_epi8(3, 3, 7, 7, 11, 11, 15, 15,
+                                                   -1, -1, -1, -1, -1, -1, -1, -1));
+        }
+        else {
+            cy = _mm_shuffle_epi8(c, _mm_setr_epi8(1, 3, 5, 7, 9, 11, 13, 15,
+                                                   -1, -1, -1, -1, -1, -1, -1, -1));
+            cu = _mm_shuffle_epi8(c, _mm_setr_epi8(0, 0, 4, 4, 8, 8, 12, 12,
+                                                   -1, -1, -1, -1, -1, -1, -1, -1));
+            cv = _mm_shuffle_epi8(c, _mm_setr_epi8(2, 2, 6, 6, 10, 10, 14, 14,
+                                                   -1, -1, -1, -1, -1, -1, -1, -1));
+        }
+    }
+    else {
+        cy = _mm_loadl_epi64((const __m128i *) y8);
+
+        if (l == LAYOUT_VU) {
+            c = _mm_loadl_epi64((const __m128i *) v8);
+            cv = _mm_shuffle_epi8(c, even_dup);
+            cu = _mm_shuffle_epi8(c, odd_dup);
+        }
+        else if (l == LAYOUT_UV) {
+            c = _mm_loadl_epi64((const __m128i *) u8);
+            cu = _mm_shuffle_epi8(c, even_dup);
+            cv = _mm_shuffle_epi8(c, odd_dup);
+        }
+        else if (l == LAYOUT_PLANAR) {
+            memcpy(&c4, u8, 4);
+            cu = _mm_shuffle_epi8(_mm_cvtsi32_si128(c4), pair_dup);
+            memcpy(&c4, v8, 4);
+            cv = _mm_shuffle_epi8(_mm_cvtsi32_si128(c4), pair_dup);
+        }
+        else {
+            cu = _mm_loadl_epi64((const __m128i *) u8);
+            cv = _mm_loadl_epi64((const __m128i *) v8);
+        }
+    }
+
+    y = _mm256_cvtepu8_epi32(cy);
+    u = _mm256_cvtepu8_epi32(cu);
+    v = _mm256_cvtepu8_epi32(cv);
+
+    y = _mm256_max_epi32(_mm256_sub_epi32(y, k->y_off), zero);
+    v = _mm256_sub_epi32(v, uv_off);
+    u = _mm256_sub_epi32(u, uv_off);
+    yv = _mm256_or_si256(y, _mm256_slli_epi32(v, 16));
+    yu = _mm256_or_si256(y, _mm256_slli_epi32(u, 16));
+
+    r = _mm256_srai_epi32(_mm256_madd_epi16(yv, c_r), 10);
+    g = _mm256_srai_epi32(_mm256_add_epi32(_mm256_madd_epi16(yv, c_gv),
+                                           _mm256_madd_epi16(yu, c_gu)), 10);
+    b = _mm256_srai_epi32(_mm256_madd_epi16(yu, c_b), 10);
+
+    r = _mm256_min_epi32(_mm256_max_epi32(r, zero), max);
+    g = _mm256_min_epi32(_mm256_max_epi32(g, zero), max);
+    b = _mm256_min_epi32(_mm256_max_epi32(b, zero), max);
+
+    r = _mm256_or_si256(_mm256_or_si256(alpha, _mm256_slli_epi32(r, 16)),
+                        _mm256_or_si256(_mm256_slli_epi32(g, 8), b));
+    _mm256_storeu_si256((__m256i *) rgb, r);
+}
+
+/* 32 pixels per step */
+__attribute__((target("avx2")))
+static ALWAYS_INLINE void row_avx2(uint32_t *rgb, const uint8_t *yp,
+                                   const uint8_t *up, const uint8_t *vp,
+                                   int width, const struct yuv_coefs *coefs,
+                                   const enum row_layout l)
+{
+    const int ys = layout_y_step(l);
+    const int cs = layout_c_step(l);
+    const int sh = layout_c_shift(l);
+    struct avx2_coefs k;
+    int i, j;
+
+    avx2_coefs_init(&k, coefs);
+
+    for (i = 0; i + 32 <= width; i += 32) {
+        for (j = i; j < i + 32; j += 8)
+            avx2_px8(rgb + j, yp + j * ys, up + (j >> sh) * cs,
+                     vp + (j >> sh) * cs, &k, l);
+    }
+
+    row_tail(rgb, yp, up, vp, width, i, coefs, l);
+}
+
+ROW_INSTANCES(row_avx2, __attribute__((target("avx2"))))
+
+#endif /* YUV_HAVE_X86 */
+
+#ifdef YUV_HAVE_NEON
+
+/* One channel for 8 pixels: (y * cy + a * ca + b * cb) >> 10, saturated */
+static inline uint8x8_t neon_chan(int16x8_t y, int16_t cy, int16x8_t a,
+                                  int16_t ca, int16x8_t b, int16_t cb)
+{
+    int32x4_t lo = vmull_n_s16(vget_low_s16(y), cy);
+    int32x4_t hi = vmull_n_s16(vget_high_s16(y), cy);
+
+    lo = vmlal_n_s16(lo, vget_low_s16(a), ca);
+    hi = vmlal_n_s16(hi, vget_high_s16(a), ca);
+    lo = vmlal_n_s16(lo, vget_low_s16(b), cb);
+    hi = vmlal_n_s16(hi, vget_high_s16(b), cb);
+
+    return vqmovn_u16(vcombine_u16(vqshrun_n_s32(lo, 10), vqshrun_n_s32(hi, 10)));
+}
+
+/* 16 pixels per step */
+static ALWAYS_INLINE void row_neon(uint32_t *rgb, const uint8_t *yp,
+                                   const uint8_t *up, const uint8_t *vp,
+                                   int width, const struct yuv_coefs *coefs,
+                                   const enum row_layout l)
+{
+    const struct yuv_coefs c = *coefs;
+    const int16x8_t zero = vdupq_n_s16(0);
+    const int16x8_t y_off = vdupq_n_s16(c.y_off);
+    const uint8x8_t uv_off = vdup_n_u8(128);
+    const int ys = layout_y_step(l);
+    const int cs = layout_c_step(l);
+    const int sh = layout_c_shift(l);
+    int i;
+
+    for (i = 0; i + 16 <= width; i += 16) {
+        const uint8_t *yi = yp + i * ys;
+        const uint8_t *ui = up + (i >> sh) * cs;
+        const uint8_t *vi = vp + (i >> sh) * cs;
+        uint8x16_t y8;
+        uint8x8_t u8, v8;
+        int16x8x2_t vd, ud;
+        int16x8_t y[2];
+        uint8x8x4_t px;
+        int k;
+
+        if (l == LAYOUT_YUYV || l == LAYOUT_UYVY) {
+            uint8x8x4_t p = vld4_u8(l == LAYOUT_YUYV ? yi : ui);
+            uint8x8x2_t yz;
+
+            if (l == LAYOUT_YUYV) {
+                yz = vzip_u8(p.val[0], p.val[2]);
+                u8 = p.val[1];
+                v8 = p.val[3];
+            }
+            else {
+                yz = vzip_u8(p.val[1], p.val[3]);
+                u8 = p.val[0];
+                v8 = p.val[2];
+            }
+            y8 = vcombine_u8(yz.val[0], yz.val[1]);
+        }
+        else {
+            y8 = vld1q_u8(yi);
+
+            if (l == LAYOUT_VU || l == LAYOUT_UV) {
+                uint8x8x2_t c = vld2_u8(l == LAYOUT_VU ? vi : ui);
+
+                v8 = c.val[l == LAYOUT_VU ? 0 : 1];
+                u8 = c.val[l == LAYOUT_VU ? 1 : 0];
+            }
+            else if (l == LAYOUT_PLANAR) {
+                u8 = vld1_u8(ui);
+                v8 = vld1_u8(vi);
+            }
+        }
+
+        if (l == LAYOUT_444) {
+            uint8x16_t uq = vld1q_u8(ui);
+            uint8x16_t vq = vld1q_u8(vi);
+
+            ud.val[0] = vreinterpretq_s16_u16(vsubl_u8(vget_low_u8(uq), uv_off));
+            ud.val[1] = vreinterpretq_s16_u16(vsubl_u8(vget_high_u8(uq), uv_off));
+            vd.val[0] = vreinterpretq_s16_u16(vsubl_u8(vget_low_u8(vq), uv_off));
+            vd.val[1] = vreinterpretq_s16_u16(vsubl_u8(vget_high_u8(vq), uv_off));
+        }
+        else {
+            int16x8_t v = vreinterpretq_s16_u16(vsubl_u8(v8, uv_off));
+            int16x8_t u = vreinterpretq_s16_u16(vsubl_u8(u8, uv_off));
+
+            vd = vzipq_s16(v, v);
+            ud = vzipq_s16(u, u);
+        }
+
+        y[0] = vreinterpretq_s16_u16(vmovl_u8(vget_low_u8(y8)));
+        y[1] = vreinterpretq_s16_u16(vmovl_u8(vget_high_u8(y8)));
+
+        for (k = 0; k < 2; k++) {
+            int16x8_t yk = vmaxq_s16(vsubq_s16(y[k], y_off), zero);
+
+            px.val[0] = neon_chan(yk, c.y, ud.val[k], c.bu, zero, 0);
+            px.val[1] = neon_chan(yk, c.y, vd.val[k], -c.gv, ud.val[k], -c.gu);
+            px.val[2] = neon_chan(yk, c.y, vd.val[k], c.rv, zero, 0);
+            px.val[3] = vdup_n_u8(0xff);
+            vst4_u8((uint8_t *) (rgb + i + k * 8), px);
+        }
+    }
+
+    row_tail(rgb, yp, up, vp, width, i, coefs, l);
+}
+
+ROW_INSTANCES(row_neon, )
+
+#endif /* YUV_HAVE_NEON */
+
+static const struct yuv_kernel kernels[] = {
+#ifdef YUV_HAVE_X86
+    { "avx2", ROW_TABLE(row_avx2), cpu_has_avx2 },
+    { "sse2", ROW_TABLE(row_sse2), cpu_has_sse2 },
+#endif
+#ifdef YUV_HAVE_NEON
+    { "neon", ROW_TABLE(row_neon), NULL },
+#endif
+    { "scalar", ROW_TABLE(row_c), NULL },
+};
+
+#define NUM_KERNELS (int) (sizeof(kernels) / sizeof(kernels[0]))
+
+static const struct yuv_kernel *active_kernel;
+
+const struct yuv_kernel *yuv_kernel_list(int *count)
+{
+    *count = NUM_KERNELS;
+    return kernels;
+}
+
+const struct yuv_kernel *yuv_kernel_select(void)
+{
+    const char *force = getenv("YUV_KERNEL");
+    int i;
+
+    if (active_kernel)
+        return active_kernel;
+
+    for (i = 0; i < NUM_KERNELS; i++) {
+        if (kernels[i].supported && !kernels[i].supported())
+            continue;
+        if (force && strcmp(force, kernels[i].name))
+            continue;
+        active_kernel = &kernels[i];
+        return active_kernel;
+    }
+
+    if (force)
+        printf("Kernel %s not available, using scalar\n", force);
+
+    active_kernel = &kernels[NUM_KERNELS - 1];
+    return active_kernel;
+}
+
+/* Where each plane starts and how far apart its rows and samples are */
+struct yuv_planes {
+    const uint8_t *y;
+    const uint8_t *u;
+    const uint8_t *v;
+    int y_stride;
+    int c_stride;
+    int y_step;         /* bytes between samples in a row */
+    int c_step;
+    int c_hshift;       /* pixel (x, y) uses chroma (x >> hshift, y >> vshift) */
+    int c_vshift;
+};
+
+/* The layout from yuv_format_planes(), as pointers into src */
+static void planes_init(struct yuv_planes *p, const uint8_t *src,
+                        enum yuv_format format, int width, int height)
+{
+    struct yuv_plane_layout l[YUV_PLANE_COUNT];
+
+    yuv_format_planes(format, width, height, l);
+
+    p->y = src + l[YUV_PLANE_Y].offset;
+    p->u = src + l[YUV_PLANE_U].offset;
+    p->v = src + l[YUV_PLANE_V].offset;
+    p->y_stride = l[YUV_PLANE_Y].stride;
+    p->c_stride = l[YUV_PLANE_U].stride;
+    p->y_step = l[YUV_PLANE_Y].step;
+    p->c_step = l[YUV_PLANE_U].step;
+    p->c_hshift = l[YUV_PLANE_U].hshift;
+    p->c_vshift = l[YUV_PLANE_U].vshift;
+}
+
+void yuv_rgb_conversion_rows(const struct yuv_kernel *k, uint32_t *rgb,
+                             int rgb_stride, const uint8_t *src,
+                             enum yuv_format format,
+                             const struct yuv_coefs *coefs,
+                             int width, int height, int row_start, int row_end)
+{
+    yuv_row_fn row = k->row[format];
+    struct yuv_planes p;
+    int j;
+
+    if (coefs == NULL)
+        coefs = yuv_coefs_get(YUV_MATRIX_BT601, YUV_RANGE_LIMITED);
+
+    planes_init(&p, src, format, width, height);
+
+    for (j = row_start; j < row_end; j++) {
+        row((uint32_t *) ((uint8_t *) rgb + (size_t) j * rgb_stride),
+            p.y + (size_t) j * p.y_stride,
+            p.u + (size_t) (j >> p.c_vshift) * p.c_stride,
+            p.v + (size_t) (j >> p.c_vshift) * p.c_stride, width, coefs);
+    }
+}
+
+void yuv_rgb_conversion_kernel(const struct yuv_kernel *k, uint32_t *rgb,
+                               const uint8_t *src, enum yuv_format format,
+                               const struct yuv_coefs *coefs,
+                               int width, int height)
+{
+    yuv_rgb_conversion_rows(k, rgb, width * sizeof(uint32_t), src, format,
+                            coefs, width, height, 0, height);
+}
+
+struct band_job {
+    const struct yuv_kernel *k;
+    uint32_t *rgb;
+    int rgb_stride;
+    const uint8_t *src;
+    enum yuv_format format;
+    const struct yuv_coefs *coefs;
+    int width;
+    int height;
+    int band_rows;
+};
+
+static void band_convert(void *arg, int index, int count)
+{
+    struct band_job *job = arg;
+    int start = index * job->band_rows;
+    int end = start + job->band_rows;
+
+    if (end > job->height)
+        end = job->height;
+    if (start < end)
+        yuv_rgb_conversion_rows(job->k, job->rgb, job->rgb_stride, job->src,
+                                job->format, job->coefs, job->width,
+                                job->height, start, end);
+}
+
+void yuv_rgb_conversion_mt(struct yuv_pool *pool, const struct yuv_kernel *k,
+                           uint32_t *rgb, const uint8_t *src,
+                           enum yuv_format format, const struct yuv_coefs *coefs,
+                           int width, int height)
+{
+    yuv_rgb_conversion_stride_mt(pool, k, rgb, width * sizeof(uint32_t), src,
+                                 format, coefs, width, height);
+}
+
+void yuv_rgb_conversion_stride_mt(struct yuv_pool *pool,
+                                  const struct yuv_kernel *k,
+                                  uint32_t *rgb, int rgb_stride,
+                                  const uint8_t *src, enum yuv_format format,
+                                  const struct yuv_coefs *coefs,
+                                  int width, int height)
+{
+    struct band_job job = { k, rgb, rgb_stride, src, format, coefs, width,
+                            height, 0 };
+    int bands = yuv_pool_threads(pool);
+    int pairs = (height + 1) / 2;
+
+    if (bands > pairs)
+        bands = pairs;
+    if (bands <= 1) {
+        yuv_rgb_conversion_rows(k, rgb, rgb_stride, src, format, coefs,
+                                width, height, 0, height);
+        return;
+    }
+
+    /* Whole chroma row pairs per band */
+    job.band_rows = (pairs + bands - 1) / bands * 2;
+    bands = (height + job.band_rows - 1) / job.band_rows;
+
+    yuv_pool_run(pool, band_convert, &job, bands);
+}
+
+static const char *filter_names[] = {
+    [YUV_SCALE_NEAREST] = "nearest",
+    [YUV_SCALE_BILINEAR] = "bilinear",
+    [YUV_SCALE_BOX] = "box",
+};
+
+int yuv_scale_filter_parse(const char *name)
+{
+    int i;
+
+    for (i = 0; i < YUV_SCALE_FILTER_COUNT; i++) {
+        if (!strcmp(name, filter_names[i]))
+            return i;
+    }
+
+    return -1;
+}
+
+const char *yuv_scale_filter_name(enum yuv_scale_filter filter)
+{
+    return filter_names[filter];
+}
+
+/*
+ * Per axis sample positions for output index d of dst, over src samples.
+ * nearest:  i0 = sample
+ * bilinear: i0, i1 = neighbours, f = weight of i1 in 1/256
+ * box:      [i0, i1) = source footprint
+ */
+static inline void map_nearest(int d, int dst, int src, int *i0)
+{
+    int i = (int) (((int64_t) (2 * d + 1) * src) / (2 * dst));
+
+    *i0 = i < src ? i : src - 1;
+}
+
+static inline void map_bilinear(int d, int dst, int src,
+                                int *i0, int *i1, int *f)
+{
+    /* Pixel centers line up: pos = (d + 0.5) * src / dst - 0.5 */
+    int64_t pos = ((int64_t) (2 * d + 1) * src - dst) * 256 / (2 * dst);
+
+    if (pos < 0)
+        pos = 0;
+
+    *i0 = (int) (pos >> 8);
+    *f = (int) (pos & 255);
+    if (*i0 >= src - 1) {
+        *i0 = src - 1;
+        *f = 0;
+    }
+    *i1 = *i0 + (*f ? 1 : 0);
+}
+
+static inline void map_box(int d, int dst, int src, int *i0, int *i1)
+{
+    *i0 = (int) ((int64_t) d * src / dst);
+    *i1 = (int) ((int64_t) (d + 1) * src / dst);
+    if (*i1 <= *i0)
+        *i1 = *i0 + 1;
+    if (*i1 > src)
+        *i1 = src;
+    if (*i0 >= *i1)
+        *i0 = *i1 - 1;
+}
+
+struct scale_job {
+    enum yuv_scale_filter filter;
+    uint8_t *rgb;
+    int rgb_stride;
+    int dst_w;
+    int dst_h;
+    /* The part of the dst_w x dst_h image written to rgb */
+    int rect_x;
+    int rect_y;
+    int rect_w;
+    int rect_h;
+    struct yuv_planes p;
+    struct yuv_coefs coefs;
+    int height;
+    int band_rows;
+    /*
+     * Luma and chroma column maps, rect_w entries each. Positions are
+     * byte offsets into a row, bilinear weights stay in 1/256.
+     */
+    int *lx0, *lx1, *lf;
+    int *cx0, *cx1, *cf;
+};
+
+static void scale_row_nearest(struct scale_job *job, int j, uint32_t *out)
+{
+    const struct yuv_planes *p = &job->p;
+    const uint8_t *yrow, *urow, *vrow;
+    int sy, i;
+
+    map_nearest(j, job->dst_h, job->height, &sy);
+    yrow = p->y + sy * p->y_stride;
+    urow = p->u + (sy >> p->c_vshift) * p->c_stride;
+    vrow = p->v + (sy >> p->c_vshift) * p->c_stride;
+
+    for (i = 0; i < job->rect_w; i++) {
+        int c = job->cx0[i];
+
+        out[i] = yuv_pixel(&job->coefs, yrow[job->lx0[i]], urow[c] - 128,
+                           vrow[c] - 128);
+    }
+}
+
+static inline int bilinear(const uint8_t *r0, const uint8_t *r1,
+                           int x0, int x1, int fx, int fy)
+{
+    return ((r0[x0] * (256 - fx) + r0[x1] * fx) * (256 - fy) +
+            (r1[x0] * (256 - fx) + r1[x1] * fx) * fy + 32768) >> 16;
+}
+
+static void scale_row_bilinear(struct scale_job *job, int j, uint32_t *out)
+{
+    const struct yuv_planes *p = &job->p;
+    int ch = (job->height + (1 << p->c_vshift) - 1) >> p->c_vshift;
+    const uint8_t *y0, *y1, *u0, *u1, *v0, *v1;
+    int sy0, sy1, fy, cy0, cy1, cfy, i;
+
+    map_bilinear(j, job->dst_h, job->height, &sy0, &sy1, &fy);
+    map_bilinear(j, job->dst_h, ch, &cy0, &cy1, &cfy);
+    y0 = p->y + sy0 * p->y_stride;
+    y1 = p->y + sy1 * p->y_stride;
+    u0 = p->u + cy0 * p->c_stride;
+    u1 = p->u + cy1 * p->c_stride;
+    v0 = p->v + cy0 * p->c_stride;
+    v1 = p->v + cy1 * p->c_stride;
+
+    for (i = 0; i < job->rect_w; i++) {
+        int x0 = job->lx0[i], x1 = job->lx1[i], fx = job->lf[i];
+        int c0 = job->cx0[i], c1 = job->cx1[i], cfx = job->cf[i];
+
+        out[i] = yuv_pixel(&job->coefs, bilinear(y0, y1, x0, x1, fx, fy),
+                           bilinear(u0, u1, c0, c1, cfx, cfy) - 128,
+                           bilinear(v0, v1, c0, c1, cfx, cfy) - 128);
+    }
+}
+
+static void scale_row_box(struct scale_job *job, int j, uint32_t *out)
+{
+    const struct yuv_planes *p = &job->p;
+    int ch = (job->height + (1 << p->c_vshift) - 1) >> p->c_vshift;
+    int sy0, sy1, cy0, cy1, i, x, y;
+
+    map_box(j, job->dst_h, job->height, &sy0, &sy1);
+    map_box(j, job->dst_h, ch, &cy0, &cy1);
+
+    for (i = 0; i < job->rect_w; i++) {
+        int ysum = 0, usum = 0, vsum = 0, n, cn;
+
+        for (y = sy0; y < sy1; y++) {
+            const uint8_t *row = p->y + y * p->y_stride;
+            for (x = job->lx0[i]; x < job->lx1[i]; x += p->y_step)
+                ysum += row[x];
+        }
+        for (y = cy0; y < cy1; y++) {
+            const uint8_t *urow = p->u + y * p->c_stride;
+            const uint8_t *vrow = p->v + y * p->c_stride;
+            for (x = job->cx0[i]; x < job->cx1[i]; x += p->c_step) {
+                usum += urow[x];
+                vsum += vrow[x];
+            }
+        }
+
+        n = (sy1 - sy0) * ((job->lx1[i] - job->lx0[i]) / p->y_step);
+        cn = (cy1 - cy0) * ((job->cx1[i] - job->cx0[i]) / p->c_step);
+        out[i] = yuv_pixel(&job->coefs, (ysum + n / 2) / n,
+                           (usum + cn / 2) / cn - 128, (vsum + cn / 2) / cn - 128);
+    }
+}
+
+static void scale_band(void *arg, int index, int count)
+{
+    struct scale_job *job = arg;
+    int start = index * job->band_rows;
+    int end = start + job->band_rows;
+    void (*row)(struct scale_job *, int, uint32_t *);
+    int j;
+
+    switch (job->filter) {
+    case YUV_SCALE_NEAREST:
+        row = scale_row_nearest;
+        break;
+    case YUV_SCALE_BOX:
+        row = scale_row_box;
+        break;
+    default:
+        row = scale_row_bilinear;
+        break;
+    }
+
+    if (end > job->rect_h)
+        end = job->rect_h;
+    for (j = start; j < end; j++)
+        row(job, job->rect_y + j, (uint32_t *) (job->rgb + j * job->rgb_stride));
+}
+
+void yuv_rgb_conversion_scaled_rect(struct yuv_pool *pool, uint32_t *rgb,
+                                    int rgb_stride, int dst_w, int dst_h,
+                                    int rect_x, int rect_y,
+                                    int rect_w, int rect_h,
+                                    const uint8_t *src, enum yuv_format format,
+                                    const struct yuv_coefs *coefs,
+                                    int width, int height,
+                                    enum yuv_scale_filter filter)
+{
+    struct scale_job job;
+    int bands, cw, ys, cs, i;
+
+    if (rect_x < 0 || rect_y < 0 || rect_w <= 0 || rect_h <= 0 ||
+        rect_x + rect_w > dst_w || rect_y + rect_h > dst_h)
+        return;
+
+    if (dst_w == width && dst_h == height && rect_w == width &&
+        rect_h == height && rgb_stride == width * (int) sizeof(uint32_t)) {
+        yuv_rgb_conversion_mt(pool, yuv_kernel_select(), rgb, src, format,
+                              coefs, width, height);
+        return;
+    }
+
+    memset(&job, 0, sizeof(job));
+    job.filter = filter;
+    job.rgb = (uint8_t *) rgb;
+    job.rgb_stride = rgb_stride;
+    job.dst_w = dst_w;
+    job.dst_h = dst_h;
+    job.rect_x = rect_x;
+    job.rect_y = rect_y;
+    job.rect_w = rect_w;
+    job.rect_h = rect_h;
+    job.height = height;
+    job.coefs = *(coefs ? coefs : yuv_coefs_get(YUV_MATRIX_BT601,
+                                                YUV_RANGE_LIMITED));
+    planes_init(&job.p, src, format, width, height);
+
+    job.lx0 = malloc(6 * rect_w * sizeof(int));
+    if (job.lx0 == NULL) {
+        perror("Memory scale map malloc fail");
+        return;
+    }
+    job.lx1 = job.lx0 + rect_w;
+    job.lf = job.lx1 + rect_w;
+    job.cx0 = job.lf + rect_w;
+    job.cx1 = job.cx0 + rect_w;
+    job.cf = job.cx1 + rect_w;
+
+    cw = (width + (1 << job.p.c_hshift) - 1) >> job.p.c_hshift;
+    ys = job.p.y_step;
+    cs = job.p.c_step;
+
+    for (i = 0; i < rect_w; i++) {
+        int d = rect_x + i;
+
+        switch (filter) {
+        case YUV_SCALE_NEAREST:
+            map_nearest(d, dst_w, width, &job.lx0[i]);
+            /* Chroma of the pair the luma sample belongs to */
+            job.cx0[i] = job.lx0[i] >> job.p.c_hshift;
+            job.lx1[i] = job.lx0[i];
+            job.cx1[i] = job.cx0[i];
+            break;
+        case YUV_SCALE_BOX:
+            map_box(d, dst_w, width, &job.lx0[i], &job.lx1[i]);
+            map_box(d, dst_w, cw, &job.cx0[i], &job.cx1[i]);
+            break;
+        default:
+            map_bilinear(d, dst_w, width, &job.lx0[i], &job.lx1[i], &job.lf[i]);
+            map_bilinear(d, dst_w, cw, &job.cx0[i], &job.cx1[i], &job.cf[i]);
+            break;
+        }
+
+        /* Sample indices to byte offsets */
+        job.lx0[i] *= ys;
+        job.lx1[i] *= ys;
+        job.cx0[i] *= cs;
+        job.cx1[i] *= cs;
+    }
+
+    bands = yuv_pool_threads(pool) * 2;
+    if (bands > rect_h)
+        bands = rect_h;
+    job.band_rows = (rect_h + bands - 1) / bands;
+    bands = (rect_h + job.band_rows - 1) / job.band_rows;
+
+    yuv_pool_run(pool, scale_band, &job, bands);
+
+    free(job.lx0);
+}
+
+void yuv_rgb_conversion_scaled(struct yuv_pool *pool, uint32_t *rgb,
+                               int rgb_stride, int dst_w, int dst_h,
+                               const uint8_t *src, enum yuv_format format,
+                               const struct yuv_coefs *coefs,
+                               int width, int height,
+                               enum yuv_scale_filter filter)
+{
+    yuv_rgb_conversion_scaled_rect(pool, rgb, rgb_stride, dst_w, dst_h,
+                                   0, 0, dst_w, dst_h, src, format, coefs,
+                                   width, height, filter);
+}
+
+void yuv_rgb_conversion(uint32_t *rgb, const uint8_t *src,
+                        enum yuv_format format, int width, int height)
+{
+    yuv_rgb_conversion_kernel(yuv_kernel_select(), rgb, src, format, NULL,
+                              width, height);
+}
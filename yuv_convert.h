@@ -0,0 +1,150 @@
+#ifndef YUV_CONVERT_H
+#define YUV_CONVERT_H
+
+#include <stdint.h>
+
+#include "yuv_format.h"
+
+struct yuv_pool;
+
+enum yuv_matrix {
+    YUV_MATRIX_BT601,
+    YUV_MATRIX_BT709,
+    YUV_MATRIX_BT2020,
+    YUV_MATRIX_COUNT
+};
+
+enum yuv_range {
+    YUV_RANGE_LIMITED,  /* Y 16..235, U/V 16..240 */
+    YUV_RANGE_FULL,     /* all 0..255 */
+    YUV_RANGE_COUNT
+};
+
+/*
+ * One matrix and range in 10 bit fixed point, with U and V centered on 0:
+ * R = (y * (Y - y_off) + rv * V) >> 10
+ * G = (y * (Y - y_off) - gu * U - gv * V) >> 10
+ * B = (y * (Y - y_off) + bu * U) >> 10
+ */
+struct yuv_coefs {
+    int y_off;
+    int y;
+    int rv;
+    int gu;
+    int gv;
+    int bu;
+};
+
+/* Precomputed, the pointer stays valid */
+const struct yuv_coefs *yuv_coefs_get(enum yuv_matrix matrix,
+                                      enum yuv_range range);
+
+/* Return -1 for an unknown name */
+int yuv_matrix_parse(const char *name);
+const char *yuv_matrix_name(enum yuv_matrix matrix);
+int yuv_range_parse(const char *name);
+const char *yuv_range_name(enum yuv_range range);
+
+/*
+ * Convert one row to packed 0xAARRGGBB. y, u and v point at the first
+ * sample of each for this row; how far apart samples are is fixed by the
+ * format the function was built for.
+ */
+typedef void (*yuv_row_fn)(uint32_t *rgb, const uint8_t *y,
+                           const uint8_t *u, const uint8_t *v, int width,
+                           const struct yuv_coefs *coefs);
+
+struct yuv_kernel {
+    const char *name;
+    yuv_row_fn row[YUV_FORMAT_COUNT];
+    int (*supported)(void);
+};
+
+/* Kernels compiled in, best first. Unsupported ones are skipped by select. */
+const struct yuv_kernel *yuv_kernel_list(int *count);
+
+/*
+ * Pick the best kernel for this CPU. YUV_KERNEL=<name> in the environment
+ * forces a specific one (if the CPU supports it).
+ */
+const struct yuv_kernel *yuv_kernel_select(void);
+
+/* A NULL coefs is BT.601 limited range, here and below */
+void yuv_rgb_conversion_kernel(const struct yuv_kernel *k, uint32_t *rgb,
+                               const uint8_t *src, enum yuv_format format,
+                               const struct yuv_coefs *coefs,
+                               int width, int height);
+
+/*
+ * Rows [row_start, row_end) only, row_start must be even. rgb_stride is
+ * in bytes, rgb points at the frame's first row either way.
+ */
+void yuv_rgb_conversion_rows(const struct yuv_kernel *k, uint32_t *rgb,
+                             int rgb_stride, const uint8_t *src,
+                             enum yuv_format format,
+                             const struct yuv_coefs *coefs,
+                             int width, int height, int row_start, int row_end);
+
+/*
+ * Splits the frame in bands of whole chroma row pairs and converts them
+ * on the pool. A NULL pool converts on the calling thread.
+ */
+void yuv_rgb_conversion_mt(struct yuv_pool *pool, const struct yuv_kernel *k,
+                           uint32_t *rgb, const uint8_t *src,
+                           enum yuv_format format, const struct yuv_coefs *coefs,
+                           int width, int height);
+
+/*
+ * The same into rows rgb_stride bytes apart, e.g. straight into a cairo
+ * image surface
+ */
+void yuv_rgb_conversion_stride_mt(struct yuv_pool *pool,
+                                  const struct yuv_kernel *k,
+                                  uint32_t *rgb, int rgb_stride,
+                                  const uint8_t *src, enum yuv_format format,
+                                  const struct yuv_coefs *coefs,
+                                  int width, int height);
+
+enum yuv_scale_filter {
+    YUV_SCALE_NEAREST,
+    YUV_SCALE_BILINEAR,
+    YUV_SCALE_BOX,
+    YUV_SCALE_FILTER_COUNT
+};
+
+/* Returns -1 for an unknown name */
+int yuv_scale_filter_parse(const char *name);
+const char *yuv_scale_filter_name(enum yuv_scale_filter filter);
+
+/*
+ * Converts straight to a dst_w x dst_h image, sampling the YUV planes at
+ * the output resolution. rgb_stride is in bytes. Cost follows the output
+ * size except for box, which averages each output pixel's footprint.
+ */
+void yuv_rgb_conversion_scaled(struct yuv_pool *pool, uint32_t *rgb,
+                               int rgb_stride, int dst_w, int dst_h,
+                               const uint8_t *src, enum yuv_format format,
+                               const struct yuv_coefs *coefs,
+                               int width, int height,
+                               enum yuv_scale_filter filter);
+
+/*
+ * Like yuv_rgb_conversion_scaled(), but only writes the rect_w x rect_h
+ * part at rect_x, rect_y of the dst_w x dst_h image; rgb points at its
+ * first pixel. Cost follows the rect, so a zoomed in view can convert
+ * just what is visible.
+ */
+void yuv_rgb_conversion_scaled_rect(struct yuv_pool *pool, uint32_t *rgb,
+                                    int rgb_stride, int dst_w, int dst_h,
+                                    int rect_x, int rect_y,
+                                    int rect_w, int rect_h,
+                                    const uint8_t *src, enum yuv_format format,
+                                    const struct yuv_coefs *coefs,
+                                    int width, int height,
+                                    enum yuv_scale_filter filter);
+
+/* Converts with the kernel chosen by yuv_kernel_select(), BT.601 limited */
+void yuv_rgb_conversion(uint32_t *rgb, const uint8_t *src,
+                        enum yuv_format format, int width, int height);
+
+#endif
@@ -0,0 +1,87 @@
+#include <string.h>
+
+#include "yuv_copy.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define YUV_HAVE_X86 1
+#include <immintrin.h>
+#endif
+
+#ifdef YUV_HAVE_X86
+/*
+ * Cached head up to a 16 byte aligned dst, streamed body, cached tail.
+ * Whole 64 byte lines at a time fill the write combining buffers.
+ */
+__attribute__((target("sse2")))
+static void row_stream_sse2(uint8_t *dst, const uint8_t *src, size_t width)
+{
+    size_t head = (16 - ((uintptr_t) dst & 15)) & 15;
+    size_t i;
+
+    if (head > width)
+        head = width;
+    memcpy(dst, src, head);
+    dst += head;
+    src += head;
+    width -= head;
+
+    for (i = 0; i + 64 <= width; i += 64) {
+        __m128i a = _mm_loadu_si128((const __m128i *) (src + i));
+        __m128i b = _mm_loadu_si128((const __m128i *) (src + i + 16));
+        __m128i c = _mm_loadu_si128((const __m128i *) (src + i + 32));
+        __m128i d = _mm_loadu_si128((const __m128i *) (src + i + 48));
+
+        _mm_stream_si128((__m128i *) (dst + i), a);
+        _mm_stream_si128((__m128i *) (dst + i + 16), b);
+        _mm_stream_si128((__m128i *) (dst + i + 32), c);
+        _mm_stream_si128((__m128i *) (dst + i + 48), d);
+    }
+
+    for (; i + 16 <= width; i += 16)
+        _mm_stream_si128((__m128i *) (dst + i),
+                         _mm_loadu_si128((const __m128i *) (src + i)));
+
+    memcpy(dst + i, src + i, width - i);
+}
+
+__attribute__((target("sse2")))
+static void copy_stream_sse2(uint8_t *dst, size_t dst_pitch,
+                             const uint8_t *src, size_t src_pitch,
+                             size_t width, int height)
+{
+    int j;
+
+    for (j = 0; j < height; j++)
+        row_stream_sse2(dst + j * dst_pitch, src + j * src_pitch, width);
+
+    /* Streamed stores are weakly ordered, finish them before handing off */
+    _mm_sfence();
+}
+#endif
+
+void yuv_plane_copy(uint8_t *dst, size_t dst_pitch,
+                    const uint8_t *src, size_t src_pitch,
+                    size_t width, int height, int stream)
+{
+    int j;
+
+    if (width == 0 || height <= 0)
+        return;
+
+    /* No padding on either side, one block */
+    if (dst_pitch == width && src_pitch == width) {
+        width *= height;
+        height = 1;
+    }
+
+#ifdef YUV_HAVE_X86
+    if (stream && width * height >= YUV_COPY_STREAM_MIN &&
+        __builtin_cpu_supports("sse2")) {
+        copy_stream_sse2(dst, dst_pitch, src, src_pitch, width, height);
+        return;
+    }
+#endif
+
+    for (j = 0; j < height; j++)
+        memcpy(dst + j * dst_pitch, src + j * src_pitch, width);
+}
@@ -0,0 +1,22 @@
+#ifndef YUV_COPY_H
+#define YUV_COPY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Planes at least this big are written with non-temporal stores when the
+ * caller streams, smaller ones stay in cache
+ */
+#define YUV_COPY_STREAM_MIN (256 * 1024)
+
+/*
+ * Copies height rows of width bytes between planes with their own row
+ * pitches in bytes. Set stream when the CPU will not read dst back soon,
+ * e.g. a mapped GPU image, so large planes bypass the cache.
+ */
+void yuv_plane_copy(uint8_t *dst, size_t dst_pitch,
+                    const uint8_t *src, size_t src_pitch,
+                    size_t width, int height, int stream);
+
+#endif
@@ -0,0 +1,451 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <png.h>
+
+#include "yuv_convert.h"
+#include "yuv_pool.h"
+#include "yuv_chunk.h"
+
+enum export_type {
+    EXPORT_PPM,
+    EXPORT_PNG,
+};
+
+struct export_cfg {
+    char *fn;
+    char *pattern;
+    enum export_type type;
+    enum yuv_format format;
+    const struct yuv_coefs *coefs;
+    int threads;
+    int width;          /* raw input only, chunks carry their own */
+    int height;
+    int first;          /* 0 based */
+    int last;           /* inclusive */
+
+    /* Raw input: frames back to back in the mapping */
+    uint8_t *map;
+    size_t map_size;
+    size_t frame_size;
+
+    /* Chunk input */
+    int fd;
+    struct yuv_index index;
+
+    /* Shared between workers */
+    int next;
+    int written;
+    int failed;
+};
+
+static struct export_cfg cfg;
+
+static double now_sec(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Per worker buffers, sized for the largest frame seen so far */
+struct export_buf {
+    uint8_t *yuv;
+    size_t yuv_size;
+    uint32_t *rgb;
+    size_t rgb_size;
+    uint8_t *row;
+    size_t row_size;
+};
+
+static int buf_reserve(struct export_buf *b, int width, int height)
+{
+    size_t rgb_size = (size_t) width * height * sizeof(uint32_t);
+    size_t row_size = (size_t) width * 3;
+
+    if (rgb_size > b->rgb_size) {
+        free(b->rgb);
+        b->rgb = malloc(rgb_size);
+        b->rgb_size = b->rgb ? rgb_size : 0;
+    }
+    if (row_size > b->row_size) {
+        free(b->row);
+        b->row = malloc(row_size);
+        b->row_size = b->row ? row_size : 0;
+    }
+
+    if (b->rgb == NULL || b->row == NULL) {
+        perror("Memory export malloc fail");
+        return -1;
+    }
+
+    return 0;
+}
+
+/* 0xAARRGGBB to packed R, G, B bytes */
+static void pack_rgb(uint8_t *dst, const uint32_t *src, int width)
+{
+    int i;
+
+    for (i = 0; i < width; i++) {
+        dst[3 * i] = src[i] >> 16;
+        dst[3 * i + 1] = src[i] >> 8;
+        dst[3 * i + 2] = src[i];
+    }
+}
+
+static int write_ppm(FILE *fp, struct export_buf *b, int width, int height)
+{
+    int j;
+
+    fprintf(fp, "P6\n%d %d\n255\n", width, height);
+
+    for (j = 0; j < height; j++) {
+        pack_rgb(b->row, b->rgb + (size_t) j * width, width);
+        if (fwrite(b->row, 1, width * 3, fp) != (size_t) width * 3)
+            return -1;
+    }
+
+    return 0;
+}
+
+static int write_png(FILE *fp, struct export_buf *b, int width, int height)
+{
+    png_structp png;
+    png_infop info;
+    int j;
+
+    png = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+    if (png == NULL)
+        return -1;
+
+    info = png_create_info_struct(png);
+    if (info == NULL || setjmp(png_jmpbuf(png))) {
+        png_destroy_write_struct(&png, &info);
+        return -1;
+    }
+
+    png_init_io(png, fp);
+    /* Review copies, favour export speed over file size */
+    png_set_compression_level(png, 1);
+    png_set_IHDR(png, info, width, height, 8, PNG_COLOR_TYPE_RGB,
+                 PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_DEFAULT,
+                 PNG_FILTER_TYPE_DEFAULT);
+    png_write_info(png, info);
+
+    for (j = 0; j < height; j++) {
+        pack_rgb(b->row, b->rgb + (size_t) j * width, width);
+        png_write_row(png, b->row);
+    }
+
+    png_write_end(png, NULL);
+    png_destroy_write_struct(&png, &info);
+
+    return 0;
+}
+
+static int export_frame(struct export_buf *b, int id)
+{
+    const uint8_t *yuv;
+    enum yuv_format format = cfg.format;
+    int width = cfg.width, height = cfg.height;
+    char name[4096];
+    FILE *fp;
+    int rc;
+
+    if (cfg.map) {
+        yuv = cfg.map + (size_t) id * cfg.frame_size;
+    }
+    else {
+        struct yuv_chunk chunk;
+
+        if (yuv_chunk_pread(cfg.fd, cfg.index.offsets[id], &chunk,
+                            &b->yuv, &b->yuv_size) < 0) {
+            printf("Read frame %d fail\n", id + 1);
+            return -1;
+        }
+        yuv = b->yuv;
+        format = chunk.format;
+        width = chunk.width;
+        height = chunk.height;
+    }
+
+    if (buf_reserve(b, width, height) < 0)
+        return -1;
+
+    /* Frames are spread over the workers, each converts on its own */
+    yuv_rgb_conversion_kernel(yuv_kernel_select(), b->rgb, yuv, format,
+                              cfg.coefs, width, height);
+
+    snprintf(name, sizeof(name), cfg.pattern, id + 1);
+    fp = fopen(name, "wb");
+    if (!fp) {
+        perror(name);
+        return -1;
+    }
+
+    if (cfg.type == EXPORT_PNG)
+        rc = write_png(fp, b, width, height);
+    else
+        rc = write_ppm(fp, b, width, height);
+
+    if (fclose(fp) != 0)
+        rc = -1;
+    if (rc < 0)
+        printf("Write %s fail\n", name);
+
+    return rc;
+}
+
+static void export_worker(void *arg, int index, int count)
+{
+    struct export_buf b;
+    int id;
+
+    memset(&b, 0, sizeof(b));
+
+    while ((id = __atomic_fetch_add(&cfg.next, 1, __ATOMIC_RELAXED)) <= cfg.last) {
+        if (export_frame(&b, id) < 0)
+            __atomic_fetch_add(&cfg.failed, 1, __ATOMIC_RELAXED);
+        else
+            __atomic_fetch_add(&cfg.written, 1, __ATOMIC_RELAXED);
+    }
+
+    free(b.yuv);
+    free(b.rgb);
+    free(b.row);
+}
+
+static int open_raw(void)
+{
+    struct stat st;
+    int fd;
+
+    cfg.frame_size = yuv_format_frame_size(cfg.format, cfg.width, cfg.height);
+
+    fd = open(cfg.fn, O_RDONLY);
+    if (fd < 0) {
+        perror("File open fail!");
+        return -1;
+    }
+
+    if (fstat(fd, &st) < 0 || cfg.frame_size == 0 ||
+        (uint64_t) st.st_size < cfg.frame_size) {
+        printf("File size is not match resolution setting!\n");
+        close(fd);
+        return -1;
+    }
+
+    if ((uint64_t) st.st_size > SIZE_MAX ||
+        (uint64_t) st.st_size / cfg.frame_size > INT_MAX) {
+        printf("File is too large to map on this system\n");
+        close(fd);
+        return -1;
+    }
+
+    cfg.map_size = st.st_size / cfg.frame_size * cfg.frame_size;
+    cfg.map = mmap(NULL, cfg.map_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if (cfg.map == MAP_FAILED) {
+        perror("File mmap fail");
+        cfg.map = NULL;
+        return -1;
+    }
+
+    /* Each frame is read once, roughly in order */
+    madvise(cfg.map, cfg.map_size, MADV_SEQUENTIAL);
+
+    return cfg.map_size / cfg.frame_size;
+}
+
+static int open_chunks(void)
+{
+    cfg.fd = open(cfg.fn, O_RDONLY);
+    if (cfg.fd < 0) {
+        perror("File open fail!");
+        return -1;
+    }
+
+    if (yuv_index_open(cfg.fn, cfg.fd, &cfg.index) < 0)
+        return -1;
+
+    return cfg.index.count;
+}
+
+/*
+ * The pattern is handed to snprintf with the frame number as its only
+ * argument, so it must hold exactly one int conversion and nothing else
+ * that would read an argument.
+ */
+static int pattern_valid(const char *p)
+{
+    int convs = 0;
+
+    for (; *p; p++) {
+        if (*p != '%')
+            continue;
+        if (*++p == '%')
+            continue;
+        p += strspn(p, "-+ #0");
+        p += strspn(p, "0123456789");
+        if (*p == '.') {
+            p++;
+            p += strspn(p, "0123456789");
+        }
+        if (*p == '\0' || !strchr("diouxX", *p))
+            return 0;
+        convs++;
+    }
+
+    return convs == 1;
+}
+
+static void print_help()
+{
+    printf("Usage:\n");
+    printf("\tyuv_export [-j threads] [-t ppm|png] [-o pattern] [-f first] [-n count]\n"
+           "\t           [-F format] [-m matrix] [-R range] file [width height]\n");
+    printf("\tWithout width and height file is a chunk stream, otherwise raw frames\n");
+    printf("\tpattern is a printf format with one integer conversion for the\n"
+           "\t1 based frame number, default frame_%%06d.ppm or .png\n");
+    printf("\tformat: nv21 (default), nv12, i420, yv12, yuyv, uyvy, i422, i444\n");
+    printf("\tmatrix: bt601 (default), bt709, bt2020; range: limited (default), full\n");
+}
+
+int main(int argc, char *argv[])
+{
+    struct yuv_pool *pool;
+    int matrix = YUV_MATRIX_BT601, range = YUV_RANGE_LIMITED;
+    int opt, frames, count = -1, first = 1;
+    double start, sec;
+
+    memset(&cfg, 0, sizeof(cfg));
+    cfg.fd = -1;
+
+    while ((opt = getopt(argc, argv, "j:t:o:f:n:F:m:R:h")) != -1) {
+        switch (opt) {
+        case 'j':
+            cfg.threads = atoi(optarg);
+            break;
+        case 't':
+            if (!strcmp(optarg, "png")) {
+                cfg.type = EXPORT_PNG;
+            }
+            else if (!strcmp(optarg, "ppm")) {
+                cfg.type = EXPORT_PPM;
+            }
+            else {
+                print_help();
+                return 0;
+            }
+            break;
+        case 'o':
+            cfg.pattern = optarg;
+            break;
+        case 'f':
+            first = atoi(optarg);
+            break;
+        case 'n':
+            count = atoi(optarg);
+            break;
+        case 'F':
+            cfg.format = yuv_format_parse(optarg);
+            if ((int) cfg.format < 0) {
+                print_help();
+                return 0;
+            }
+            break;
+        case 'm':
+            matrix = yuv_matrix_parse(optarg);
+            if (matrix < 0) {
+                print_help();
+                return 0;
+            }
+            break;
+        case 'R':
+            range = yuv_range_parse(optarg);
+            if (range < 0) {
+                print_help();
+                return 0;
+            }
+            break;
+        default:
+            print_help();
+            return 0;
+        }
+    }
+
+    if ((argc - optind != 1 && argc - optind != 3) || first < 1) {
+        print_help();
+        return 0;
+    }
+
+    cfg.fn = argv[optind];
+    cfg.coefs = yuv_coefs_get(matrix, range);
+    if (cfg.pattern == NULL)
+        cfg.pattern = cfg.type == EXPORT_PNG ? "frame_%06d.png" : "frame_%06d.ppm";
+    if (!pattern_valid(cfg.pattern)) {
+        printf("%s: pattern needs exactly one integer conversion\n", cfg.pattern);
+        return 1;
+    }
+
+    if (argc - optind == 3) {
+        cfg.width = atoi(argv[optind + 1]);
+        cfg.height = atoi(argv[optind + 2]);
+        frames = open_raw();
+    }
+    else {
+        frames = open_chunks();
+    }
+
+    if (frames <= 0) {
+        printf("Open file error!\n");
+        return 1;
+    }
+
+    cfg.first = first - 1;
+    cfg.last = frames - 1;
+    if (count >= 0 && cfg.first + count - 1 < cfg.last)
+        cfg.last = cfg.first + count - 1;
+    if (cfg.first > cfg.last) {
+        printf("No frames to export, %s has %d\n", cfg.fn, frames);
+        return 1;
+    }
+    cfg.next = cfg.first;
+
+    pool = yuv_pool_create(cfg.threads);
+    printf("Exporting frames %d-%d of %s, kernel %s, %d threads\n",
+           cfg.first + 1, cfg.last + 1, cfg.fn, yuv_kernel_select()->name,
+           yuv_pool_threads(pool));
+
+    /* One job per thread, each pulls frames until none are left */
+    start = now_sec();
+    yuv_pool_run(pool, export_worker, NULL, yuv_pool_threads(pool));
+    sec = now_sec() - start;
+
+    printf("%d frames in %.2f s, %.1f frames/s", cfg.written, sec,
+           sec > 0 ? cfg.written / sec : 0);
+    if (cfg.failed)
+        printf(", %d failed", cfg.failed);
+    printf("\n");
+
+    yuv_pool_destroy(pool);
+    if (cfg.map)
+        munmap(cfg.map, cfg.map_size);
+    if (cfg.fd >= 0)
+        close(cfg.fd);
+    yuv_index_free(&cfg.index);
+
+    return cfg.failed ? 1 : 0;
+}
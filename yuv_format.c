@@ -0,0 +1,122 @@
+#include <string.h>
+#include <strings.h>
+
+#include "yuv_format.h"
+
+static const char *format_names[] = {
+    [YUV_FORMAT_NV21] = "nv21",
+    [YUV_FORMAT_NV12] = "nv12",
+    [YUV_FORMAT_I420] = "i420",
+    [YUV_FORMAT_YV12] = "yv12",
+    [YUV_FORMAT_YUYV] = "yuyv",
+    [YUV_FORMAT_UYVY] = "uyvy",
+    [YUV_FORMAT_I422] = "i422",
+    [YUV_FORMAT_I444] = "i444",
+};
+
+int yuv_format_parse(const char *name)
+{
+    int i;
+
+    for (i = 0; i < YUV_FORMAT_COUNT; i++) {
+        if (!strcasecmp(name, format_names[i]))
+            return i;
+    }
+
+    /* What the sample files and the old converter called NV21 */
+    if (!strcasecmp(name, "yuv420sp"))
+        return YUV_FORMAT_NV21;
+
+    return -1;
+}
+
+const char *yuv_format_name(enum yuv_format format)
+{
+    if ((unsigned int) format >= YUV_FORMAT_COUNT)
+        return "unknown";
+
+    return format_names[format];
+}
+
+size_t yuv_format_frame_size(enum yuv_format format, int width, int height)
+{
+    size_t luma = (size_t) width * height;
+    size_t cw = (width + 1) / 2;
+    size_t ch = (height + 1) / 2;
+
+    switch (format) {
+    case YUV_FORMAT_NV21:
+    case YUV_FORMAT_NV12:
+    case YUV_FORMAT_I420:
+    case YUV_FORMAT_YV12:
+        return luma + 2 * cw * ch;
+    case YUV_FORMAT_YUYV:
+    case YUV_FORMAT_UYVY:
+        return 4 * cw * height;
+    case YUV_FORMAT_I422:
+        return luma + 2 * cw * height;
+    case YUV_FORMAT_I444:
+        return 3 * luma;
+    default:
+        return 0;
+    }
+}
+
+void yuv_format_planes(enum yuv_format format, int width, int height,
+                       struct yuv_plane_layout *p)
+{
+    size_t luma = (size_t) width * height;
+    int cw = (width + 1) / 2;
+    int ch = (height + 1) / 2;
+    int i;
+
+    p[YUV_PLANE_Y] = (struct yuv_plane_layout) { 0, width, height, width, 1 };
+
+    switch (format) {
+    case YUV_FORMAT_NV21:
+    case YUV_FORMAT_NV12:
+        p[YUV_PLANE_U] = (struct yuv_plane_layout) { luma, cw, ch, 2 * cw, 2 };
+        p[YUV_PLANE_V] = p[YUV_PLANE_U];
+        p[format == YUV_FORMAT_NV21 ? YUV_PLANE_U : YUV_PLANE_V].offset++;
+        break;
+    case YUV_FORMAT_I420:
+    case YUV_FORMAT_YV12:
+        p[YUV_PLANE_U] = (struct yuv_plane_layout) { luma, cw, ch, cw, 1 };
+        p[YUV_PLANE_V] = p[YUV_PLANE_U];
+        p[format == YUV_FORMAT_I420 ? YUV_PLANE_V : YUV_PLANE_U].offset +=
+            (size_t) cw * ch;
+        break;
+    case YUV_FORMAT_YUYV:
+    case YUV_FORMAT_UYVY:
+        for (i = 0; i < YUV_PLANE_COUNT; i++)
+            p[i] = (struct yuv_plane_layout) { 0, cw, height, 4 * cw, 4 };
+        p[YUV_PLANE_Y].width = width;
+        p[YUV_PLANE_Y].step = 2;
+        if (format == YUV_FORMAT_YUYV) {
+            p[YUV_PLANE_U].offset = 1;
+            p[YUV_PLANE_V].offset = 3;
+        }
+        else {
+            p[YUV_PLANE_Y].offset = 1;
+            p[YUV_PLANE_V].offset = 2;
+        }
+        break;
+    case YUV_FORMAT_I422:
+        p[YUV_PLANE_U] = (struct yuv_plane_layout) { luma, cw, height, cw, 1 };
+        p[YUV_PLANE_V] = p[YUV_PLANE_U];
+        p[YUV_PLANE_V].offset += (size_t) cw * height;
+        break;
+    default:
+        p[YUV_PLANE_U] = (struct yuv_plane_layout) { luma, width, height, width, 1 };
+        p[YUV_PLANE_V] = p[YUV_PLANE_U];
+        p[YUV_PLANE_V].offset += luma;
+        break;
+    }
+
+    /* Chroma subsampling, the plane sizes above round it up */
+    for (i = YUV_PLANE_U; i < YUV_PLANE_COUNT; i++) {
+        p[i].hshift = format != YUV_FORMAT_I444;
+        p[i].vshift = format == YUV_FORMAT_NV21 || format == YUV_FORMAT_NV12 ||
+                      format == YUV_FORMAT_I420 || format == YUV_FORMAT_YV12;
+    }
+}
@@ -0,0 +1,54 @@
+#ifndef YUV_FORMAT_H
+#define YUV_FORMAT_H
+
+#include <stddef.h>
+
+/*
+ * 8 bit YUV frame layouts. The values are stored in the v2 chunk header,
+ * 0 is the NV21 layout of v1 streams. Odd sizes round chroma up.
+ */
+enum yuv_format {
+    YUV_FORMAT_NV21,    /* Y plane, interleaved V/U at 1/2 x 1/2 */
+    YUV_FORMAT_NV12,    /* Y plane, interleaved U/V at 1/2 x 1/2 */
+    YUV_FORMAT_I420,    /* Y, U, V planes at 1/2 x 1/2 */
+    YUV_FORMAT_YV12,    /* Y, V, U planes at 1/2 x 1/2 */
+    YUV_FORMAT_YUYV,    /* packed Y0 U Y1 V */
+    YUV_FORMAT_UYVY,    /* packed U Y0 V Y1 */
+    YUV_FORMAT_I422,    /* Y, U, V planes at 1/2 x 1 */
+    YUV_FORMAT_I444,    /* Y, U, V planes at full size */
+    YUV_FORMAT_COUNT
+};
+
+enum yuv_plane {
+    YUV_PLANE_Y,
+    YUV_PLANE_U,
+    YUV_PLANE_V,
+    YUV_PLANE_COUNT
+};
+
+/*
+ * Where one plane's samples are in a frame. Interleaved chroma and the
+ * packed formats have step > 1.
+ */
+struct yuv_plane_layout {
+    size_t offset;      /* of the first sample */
+    int width;
+    int height;
+    int stride;         /* bytes between rows */
+    int step;           /* bytes between samples in a row */
+    int hshift;         /* pixel (x, y) uses sample (x >> hshift, y >> vshift) */
+    int vshift;
+};
+
+/* Returns -1 for an unknown name */
+int yuv_format_parse(const char *name);
+const char *yuv_format_name(enum yuv_format format);
+
+/* Bytes in one frame, 0 for an unknown format */
+size_t yuv_format_frame_size(enum yuv_format format, int width, int height);
+
+/* Layout of the Y, U and V planes, in that order */
+void yuv_format_planes(enum yuv_format format, int width, int height,
+                       struct yuv_plane_layout *planes);
+
+#endif
@@ -0,0 +1,750 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "yuv_metrics.h"
+#include "yuv_pool.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define YUV_HAVE_X86 1
+#include <immintrin.h>
+#endif
+
+/* (0.01 * 255)^2 and (0.03 * 255)^2 from the SSIM paper */
+#define SSIM_C1 6.5025
+#define SSIM_C2 58.5225
+
+/*
+ * Vector loops. sse() sums squared differences over a row, block_sums()
+ * takes four rows of each frame and gives every 4x4 block's sum of a,
+ * sum of b, sum of a^2 + b^2 and sum of a * b. ssim_row() adds up the
+ * SSIM of the windows over two rows of block sums.
+ */
+struct metric_kernel {
+    const char *name;
+    uint64_t (*sse)(const uint8_t *a, const uint8_t *b, int width);
+    void (*block_sums)(const uint8_t *const *a, const uint8_t *const *b,
+                       int blocks, int (*sums)[4]);
+    double (*ssim_row)(const int (*prev)[4], const int (*cur)[4],
+                       int windows);
+    int (*supported)(void);
+};
+
+/*
+ * SSIM of one 8x8 window from its sums over 64 samples. Means, variances
+ * and the covariance are all kept scaled by 64 * 64; every product is an
+ * exact integer in a double until the final ratio.
+ */
+static inline double ssim_window(int s1, int s2, int ss, int s12)
+{
+    double c1 = SSIM_C1 * 64 * 64;
+    double c2 = SSIM_C2 * 64 * 64;
+    double mean = (double) s1 * s2;
+    double sq = (double) s1 * s1 + (double) s2 * s2;
+    double vars = 64.0 * ss - sq;
+    double covar = 64.0 * s12 - mean;
+
+    return (2 * mean + c1) * (2 * covar + c2) / ((sq + c1) * (vars + c2));
+}
+
+static uint64_t sse_c(const uint8_t *a, const uint8_t *b, int width)
+{
+    uint64_t sum = 0;
+    int i, d;
+
+    for (i = 0; i < width; i++) {
+        d = a[i] - b[i];
+        sum += d * d;
+    }
+
+    return sum;
+}
+
+static void block_sums_c(const uint8_t *const *a, const uint8_t *const *b,
+                         int blocks, int (*sums)[4])
+{
+    int x, r, i, pa, pb;
+
+    for (x = 0; x < blocks; x++) {
+        int s1 = 0, s2 = 0, ss = 0, s12 = 0;
+
+        for (r = 0; r < 4; r++) {
+            for (i = 4 * x; i < 4 * x + 4; i++) {
+                pa = a[r][i];
+                pb = b[r][i];
+                s1 += pa;
+                s2 += pb;
+                ss += pa * pa + pb * pb;
+                s12 += pa * pb;
+            }
+        }
+
+        sums[x][0] = s1;
+        sums[x][1] = s2;
+        sums[x][2] = ss;
+        sums[x][3] = s12;
+    }
+}
+
+/* Window x covers blocks x and x + 1 of both block rows */
+static double ssim_row_c(const int (*prev)[4], const int (*cur)[4],
+                         int windows)
+{
+    double sum = 0;
+    int x, c, s[4];
+
+    for (x = 0; x < windows; x++) {
+        for (c = 0; c < 4; c++)
+            s[c] = prev[x][c] + prev[x + 1][c] + cur[x][c] + cur[x + 1][c];
+        sum += ssim_window(s[0], s[1], s[2], s[3]);
+    }
+
+    return sum;
+}
+
+/* The vector loops leave blocks past the last whole vector to this */
+static void block_sums_tail(const uint8_t *const *a, const uint8_t *const *b,
+                            int x, int blocks, int (*sums)[4])
+{
+    const uint8_t *ta[4], *tb[4];
+    int r;
+
+    for (r = 0; r < 4; r++) {
+        ta[r] = a[r] + 4 * x;
+        tb[r] = b[r] + 4 * x;
+    }
+    block_sums_c(ta, tb, blocks - x, sums + x);
+}
+
+#ifdef YUV_HAVE_X86
+
+static int cpu_has_sse2(void)
+{
+    return __builtin_cpu_supports("sse2");
+}
+
+static int cpu_has_avx2(void)
+{
+    return __builtin_cpu_supports("avx2");
+}
+
+/*
+ * Squares of 16 bit differences pair up in 32 bit lanes through pmaddwd,
+ * each vector adds at most 4 * 255^2 per lane. Lanes are flushed to the
+ * 64 bit total every SSE_FLUSH vectors, well before they could wrap.
+ */
+#define SSE_FLUSH 4096
+
+__attribute__((target("sse2")))
+static uint64_t sse_sse2(const uint8_t *a, const uint8_t *b, int width)
+{
+    const __m128i zero = _mm_setzero_si128();
+    uint32_t lanes[4];
+    uint64_t sum = 0;
+    int i = 0, end;
+
+    while (i + 16 <= width) {
+        __m128i acc = zero;
+
+        end = i + 16 * SSE_FLUSH;
+        if (end > width)
+            end = width;
+
+        for (; i + 16 <= end; i += 16) {
+            __m128i va = _mm_loadu_si128((const __m128i *) (a + i));
+            __m128i vb = _mm_loadu_si128((const __m128i *) (b + i));
+            __m128i d0 = _mm_sub_epi16(_mm_unpacklo_epi8(va, zero),
+                                       _mm_unpacklo_epi8(vb, zero));
+            __m128i d1 = _mm_sub_epi16(_mm_unpackhi_epi8(va, zero),
+                                       _mm_unpackhi_epi8(vb, zero));
+
+            acc = _mm_add_epi32(acc, _mm_madd_epi16(d0, d0));
+            acc = _mm_add_epi32(acc, _mm_madd_epi16(d1, d1));
+        }
+
+        _mm_storeu_si128((__m128i *) lanes, acc);
+        sum += (uint64_t) lanes[0] + lanes[1] + lanes[2] + lanes[3];
+    }
+
+    return sum + sse_c(a + i, b + i, width - i);
+}
+
+/*
+ * lo and hi hold two 32 bit partial sums per block, blocks 0, 1 and 2, 3.
+ * Adding the even lanes to the odd ones gives the four block sums.
+ */
+__attribute__((target("sse2")))
+static inline __m128i pair_sum_sse2(__m128i lo, __m128i hi)
+{
+    __m128 l = _mm_castsi128_ps(lo);
+    __m128 h = _mm_castsi128_ps(hi);
+
+    return _mm_add_epi32(_mm_castps_si128(_mm_shuffle_ps(l, h, _MM_SHUFFLE(2, 0, 2, 0))),
+                         _mm_castps_si128(_mm_shuffle_ps(l, h, _MM_SHUFFLE(3, 1, 3, 1))));
+}
+
+/* Four blocks, 16 samples wide, per iteration */
+__attribute__((target("sse2")))
+static void block_sums_sse2(const uint8_t *const *a, const uint8_t *const *b,
+                            int blocks, int (*sums)[4])
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i ones = _mm_set1_epi16(1);
+    int x, r;
+
+    for (x = 0; x + 4 <= blocks; x += 4) {
+        __m128i s1l = zero, s1h = zero, s2l = zero, s2h = zero;
+        __m128i ssl = zero, ssh = zero, s12l = zero, s12h = zero;
+        __m128i v0, v1, v2, v3, t0, t1, t2, t3;
+
+        for (r = 0; r < 4; r++) {
+            __m128i va = _mm_loadu_si128((const __m128i *) (a[r] + 4 * x));
+            __m128i vb = _mm_loadu_si128((const __m128i *) (b[r] + 4 * x));
+            __m128i a0 = _mm_unpacklo_epi8(va, zero);
+            __m128i a1 = _mm_unpackhi_epi8(va, zero);
+            __m128i b0 = _mm_unpacklo_epi8(vb, zero);
+            __m128i b1 = _mm_unpackhi_epi8(vb, zero);
+
+            s1l = _mm_add_epi32(s1l, _mm_madd_epi16(a0, ones));
+            s1h = _mm_add_epi32(s1h, _mm_madd_epi16(a1, ones));
+            s2l = _mm_add_epi32(s2l, _mm_madd_epi16(b0, ones));
+            s2h = _mm_add_epi32(s2h, _mm_madd_epi16(b1, ones));
+            ssl = _mm_add_epi32(ssl, _mm_add_epi32(_mm_madd_epi16(a0, a0),
+                                                   _mm_madd_epi16(b0, b0)));
+            ssh = _mm_add_epi32(ssh, _mm_add_epi32(_mm_madd_epi16(a1, a1),
+                                                   _mm_madd_epi16(b1, b1)));
+            s12l = _mm_add_epi32(s12l, _mm_madd_epi16(a0, b0));
+            s12h = _mm_add_epi32(s12h, _mm_madd_epi16(a1, b1));
+        }
+
+        v0 = pair_sum_sse2(s1l, s1h);
+        v1 = pair_sum_sse2(s2l, s2h);
+        v2 = pair_sum_sse2(ssl, ssh);
+        v3 = pair_sum_sse2(s12l, s12h);
+
+        /* Transpose to one s1, s2, ss, s12 row per block */
+        t0 = _mm_unpacklo_epi32(v0, v1);
+        t1 = _mm_unpacklo_epi32(v2, v3);
+        t2 = _mm_unpackhi_epi32(v0, v1);
+        t3 = _mm_unpackhi_epi32(v2, v3);
+        _mm_storeu_si128((__m128i *) sums[x], _mm_unpacklo_epi64(t0, t1));
+        _mm_storeu_si128((__m128i *) sums[x + 1], _mm_unpackhi_epi64(t0, t1));
+        _mm_storeu_si128((__m128i *) sums[x + 2], _mm_unpacklo_epi64(t2, t3));
+        _mm_storeu_si128((__m128i *) sums[x + 3], _mm_unpackhi_epi64(t2, t3));
+    }
+
+    block_sums_tail(a, b, x, blocks, sums);
+}
+
+/* Sums of window x, one s1, s2, ss, s12 vector */
+__attribute__((target("sse2")))
+static inline __m128i window_sse2(const int (*prev)[4], const int (*cur)[4],
+                                  int x)
+{
+    __m128i l = _mm_add_epi32(_mm_loadu_si128((const __m128i *) prev[x]),
+                              _mm_loadu_si128((const __m128i *) cur[x]));
+    __m128i r = _mm_add_epi32(_mm_loadu_si128((const __m128i *) prev[x + 1]),
+                              _mm_loadu_si128((const __m128i *) cur[x + 1]));
+
+    return _mm_add_epi32(l, r);
+}
+
+/* ssim_window() on two windows at a time in double lanes */
+__attribute__((target("sse2")))
+static double ssim_row_sse2(const int (*prev)[4], const int (*cur)[4],
+                            int windows)
+{
+    const __m128d c1 = _mm_set1_pd(SSIM_C1 * 64 * 64);
+    const __m128d c2 = _mm_set1_pd(SSIM_C2 * 64 * 64);
+    const __m128d n = _mm_set1_pd(64.0);
+    const __m128d two = _mm_set1_pd(2.0);
+    __m128d acc = _mm_setzero_pd();
+    double lanes[2];
+    int x;
+
+    for (x = 0; x + 2 <= windows; x += 2) {
+        __m128i w0 = window_sse2(prev, cur, x);
+        __m128i w1 = window_sse2(prev, cur, x + 1);
+        __m128i lo = _mm_unpacklo_epi32(w0, w1);     /* s1 s1 s2 s2 */
+        __m128i hi = _mm_unpackhi_epi32(w0, w1);     /* ss ss s12 s12 */
+        __m128d s1 = _mm_cvtepi32_pd(lo);
+        __m128d s2 = _mm_cvtepi32_pd(_mm_shuffle_epi32(lo, _MM_SHUFFLE(3, 2, 3, 2)));
+        __m128d ss = _mm_cvtepi32_pd(hi);
+        __m128d s12 = _mm_cvtepi32_pd(_mm_shuffle_epi32(hi, _MM_SHUFFLE(3, 2, 3, 2)));
+        __m128d mean = _mm_mul_pd(s1, s2);
+        __m128d sq = _mm_add_pd(_mm_mul_pd(s1, s1), _mm_mul_pd(s2, s2));
+        __m128d vars = _mm_sub_pd(_mm_mul_pd(n, ss), sq);
+        __m128d covar = _mm_sub_pd(_mm_mul_pd(n, s12), mean);
+        __m128d num = _mm_mul_pd(_mm_add_pd(_mm_mul_pd(two, mean), c1),
+                                 _mm_add_pd(_mm_mul_pd(two, covar), c2));
+        __m128d den = _mm_mul_pd(_mm_add_pd(sq, c1), _mm_add_pd(vars, c2));
+
+        acc = _mm_add_pd(acc, _mm_div_pd(num, den));
+    }
+
+    _mm_storeu_pd(lanes, acc);
+
+    return lanes[0] + lanes[1] + ssim_row_c(prev + x, cur + x, windows - x);
+}
+
+/*
+ * Every step-th byte of src into dst, 16 at a time for the interleaved
+ * chroma (2) and packed (2 and 4) layouts. Stops short of the last group
+ * so loads never reach past the row's final sample. Returns how many it
+ * did.
+ */
+__attribute__((target("sse2")))
+static int gather_sse2(uint8_t *dst, const uint8_t *src, int width, int step)
+{
+    const __m128i low16 = _mm_set1_epi16(0xff);
+    const __m128i low32 = _mm_set1_epi32(0xff);
+    int i = 0;
+
+    if (step == 2) {
+        for (; i + 16 < width; i += 16) {
+            __m128i v0 = _mm_loadu_si128((const __m128i *) (src + 2 * i));
+            __m128i v1 = _mm_loadu_si128((const __m128i *) (src + 2 * i + 16));
+
+            _mm_storeu_si128((__m128i *) (dst + i),
+                             _mm_packus_epi16(_mm_and_si128(v0, low16),
+                                              _mm_and_si128(v1, low16)));
+        }
+    }
+    else if (step == 4) {
+        for (; i + 16 < width; i += 16) {
+            __m128i v0 = _mm_loadu_si128((const __m128i *) (src + 4 * i));
+            __m128i v1 = _mm_loadu_si128((const __m128i *) (src + 4 * i + 16));
+            __m128i v2 = _mm_loadu_si128((const __m128i *) (src + 4 * i + 32));
+            __m128i v3 = _mm_loadu_si128((const __m128i *) (src + 4 * i + 48));
+            __m128i p0 = _mm_packs_epi32(_mm_and_si128(v0, low32),
+                                         _mm_and_si128(v1, low32));
+            __m128i p1 = _mm_packs_epi32(_mm_and_si128(v2, low32),
+                                         _mm_and_si128(v3, low32));
+
+            _mm_storeu_si128((__m128i *) (dst + i), _mm_packus_epi16(p0, p1));
+        }
+    }
+
+    return i;
+}
+
+__attribute__((target("avx2")))
+static uint64_t sse_avx2(const uint8_t *a, const uint8_t *b, int width)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    uint32_t lanes[8];
+    uint64_t sum = 0;
+    int i = 0, end, l;
+
+    while (i + 32 <= width) {
+        __m256i acc = zero;
+
+        end = i + 32 * SSE_FLUSH;
+        if (end > width)
+            end = width;
+
+        for (; i + 32 <= end; i += 32) {
+            __m256i va = _mm256_loadu_si256((const __m256i *) (a + i));
+            __m256i vb = _mm256_loadu_si256((const __m256i *) (b + i));
+            __m256i d0 = _mm256_sub_epi16(_mm256_unpacklo_epi8(va, zero),
+                                          _mm256_unpacklo_epi8(vb, zero));
+            __m256i d1 = _mm256_sub_epi16(_mm256_unpackhi_epi8(va, zero),
+                                          _mm256_unpackhi_epi8(vb, zero));
+
+            acc = _mm256_add_epi32(acc, _mm256_madd_epi16(d0, d0));
+            acc = _mm256_add_epi32(acc, _mm256_madd_epi16(d1, d1));
+        }
+
+        _mm256_storeu_si256((__m256i *) lanes, acc);
+        for (l = 0; l < 8; l++)
+            sum += lanes[l];
+    }
+
+    return sum + sse_sse2(a + i, b + i, width - i);
+}
+
+__attribute__((target("avx2")))
+static inline __m256i pair_sum_avx2(__m256i lo, __m256i hi)
+{
+    __m256 l = _mm256_castsi256_ps(lo);
+    __m256 h = _mm256_castsi256_ps(hi);
+
+    return _mm256_add_epi32(_mm256_castps_si256(_mm256_shuffle_ps(l, h, _MM_SHUFFLE(2, 0, 2, 0))),
+                            _mm256_castps_si256(_mm256_shuffle_ps(l, h, _MM_SHUFFLE(3, 1, 3, 1))));
+}
+
+/*
+ * Eight blocks per iteration. The unpacks work within 128 bit lanes, so
+ * the low lane ends up with blocks 0-3 and the high one with 4-7, which
+ * the final permutes put back in order.
+ */
+__attribute__((target("avx2")))
+static void block_sums_avx2(const uint8_t *const *a, const uint8_t *const *b,
+                            int blocks, int (*sums)[4])
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i ones = _mm256_set1_epi16(1);
+    int x, r;
+
+    for (x = 0; x + 8 <= blocks; x += 8) {
+        __m256i s1l = zero, s1h = zero, s2l = zero, s2h = zero;
+        __m256i ssl = zero, ssh = zero, s12l = zero, s12h = zero;
+        __m256i v0, v1, v2, v3, t0, t1, t2, t3, r0, r1, r2, r3;
+
+        for (r = 0; r < 4; r++) {
+            __m256i va = _mm256_loadu_si256((const __m256i *) (a[r] + 4 * x));
+            __m256i vb = _mm256_loadu_si256((const __m256i *) (b[r] + 4 * x));
+            __m256i a0 = _mm256_unpacklo_epi8(va, zero);
+            __m256i a1 = _mm256_unpackhi_epi8(va, zero);
+            __m256i b0 = _mm256_unpacklo_epi8(vb, zero);
+            __m256i b1 = _mm256_unpackhi_epi8(vb, zero);
+
+            s1l = _mm256_add_epi32(s1l, _mm256_madd_epi16(a0, ones));
+            s1h = _mm256_add_epi32(s1h, _mm256_madd_epi16(a1, ones));
+            s2l = _mm256_add_epi32(s2l, _mm256_madd_epi16(b0, ones));
+            s2h = _mm256_add_epi32(s2h, _mm256_madd_epi16(b1, ones));
+            ssl = _mm256_add_epi32(ssl, _mm256_add_epi32(_mm256_madd_epi16(a0, a0),
+                                                         _mm256_madd_epi16(b0, b0)));
+            ssh = _mm256_add_epi32(ssh, _mm256_add_epi32(_mm256_madd_epi16(a1, a1),
+                                                         _mm256_madd_epi16(b1, b1)));
+            s12l = _mm256_add_epi32(s12l, _mm256_madd_epi16(a0, b0));
+            s12h = _mm256_add_epi32(s12h, _mm256_madd_epi16(a1, b1));
+        }
+
+        v0 = pair_sum_avx2(s1l, s1h);
+        v1 = pair_sum_avx2(s2l, s2h);
+        v2 = pair_sum_avx2(ssl, ssh);
+        v3 = pair_sum_avx2(s12l, s12h);
+
+        t0 = _mm256_unpacklo_epi32(v0, v1);
+        t1 = _mm256_unpacklo_epi32(v2, v3);
+        t2 = _mm256_unpackhi_epi32(v0, v1);
+        t3 = _mm256_unpackhi_epi32(v2, v3);
+        r0 = _mm256_unpacklo_epi64(t0, t1);     /* blocks 0 and 4 */
+        r1 = _mm256_unpackhi_epi64(t0, t1);     /* 1 and 5 */
+        r2 = _mm256_unpacklo_epi64(t2, t3);     /* 2 and 6 */
+        r3 = _mm256_unpackhi_epi64(t2, t3);     /* 3 and 7 */
+
+        _mm256_storeu_si256((__m256i *) sums[x], _mm256_permute2x128_si256(r0, r1, 0x20));
+        _mm256_storeu_si256((__m256i *) sums[x + 2], _mm256_permute2x128_si256(r2, r3, 0x20));
+        _mm256_storeu_si256((__m256i *) sums[x + 4], _mm256_permute2x128_si256(r0, r1, 0x31));
+        _mm256_storeu_si256((__m256i *) sums[x + 6], _mm256_permute2x128_si256(r2, r3, 0x31));
+    }
+
+    block_sums_tail(a, b, x, blocks, sums);
+}
+
+/* Four windows at a time, 4 double lanes */
+__attribute__((target("avx2")))
+static double ssim_row_avx2(const int (*prev)[4], const int (*cur)[4],
+                            int windows)
+{
+    const __m256d c1 = _mm256_set1_pd(SSIM_C1 * 64 * 64);
+    const __m256d c2 = _mm256_set1_pd(SSIM_C2 * 64 * 64);
+    const __m256d n = _mm256_set1_pd(64.0);
+    const __m256d two = _mm256_set1_pd(2.0);
+    __m256d acc = _mm256_setzero_pd();
+    double lanes[4];
+    int x;
+
+    for (x = 0; x + 4 <= windows; x += 4) {
+        __m128i w0 = window_sse2(prev, cur, x);
+        __m128i w1 = window_sse2(prev, cur, x + 1);
+        __m128i w2 = window_sse2(prev, cur, x + 2);
+        __m128i w3 = window_sse2(prev, cur, x + 3);
+        __m128i t0 = _mm_unpacklo_epi32(w0, w1);
+        __m128i t1 = _mm_unpacklo_epi32(w2, w3);
+        __m128i t2 = _mm_unpackhi_epi32(w0, w1);
+        __m128i t3 = _mm_unpackhi_epi32(w2, w3);
+        __m256d s1 = _mm256_cvtepi32_pd(_mm_unpacklo_epi64(t0, t1));
+        __m256d s2 = _mm256_cvtepi32_pd(_mm_unpackhi_epi64(t0, t1));
+        __m256d ss = _mm256_cvtepi32_pd(_mm_unpacklo_epi64(t2, t3));
+        __m256d s12 = _mm256_cvtepi32_pd(_mm_unpackhi_epi64(t2, t3));
+        __m256d mean = _mm256_mul_pd(s1, s2);
+        __m256d sq = _mm256_add_pd(_mm256_mul_pd(s1, s1), _mm256_mul_pd(s2, s2));
+        __m256d vars = _mm256_sub_pd(_mm256_mul_pd(n, ss), sq);
+        __m256d covar = _mm256_sub_pd(_mm256_mul_pd(n, s12), mean);
+        __m256d num = _mm256_mul_pd(_mm256_add_pd(_mm256_mul_pd(two, mean), c1),
+                                    _mm256_add_pd(_mm256_mul_pd(two, covar), c2));
+        __m256d den = _mm256_mul_pd(_mm256_add_pd(sq, c1), _mm256_add_pd(vars, c2));
+
+        acc = _mm256_add_pd(acc, _mm256_div_pd(num, den));
+    }
+
+    _mm256_storeu_pd(lanes, acc);
+
+    return lanes[0] + lanes[1] + lanes[2] + lanes[3] +
+           ssim_row_sse2(prev + x, cur + x, windows - x);
+}
+
+/* Returns how many pixels it did, the caller finishes the rest */
+__attribute__((target("sse2")))
+static size_t difference_sse2(uint32_t *dst, const uint32_t *a,
+                              const uint32_t *b, size_t count, int shift)
+{
+    const __m128i alpha = _mm_set1_epi32(0xff000000);
+    size_t i;
+    int s;
+
+    for (i = 0; i + 4 <= count; i += 4) {
+        __m128i va = _mm_loadu_si128((const __m128i *) (a + i));
+        __m128i vb = _mm_loadu_si128((const __m128i *) (b + i));
+        __m128i d = _mm_or_si128(_mm_subs_epu8(va, vb), _mm_subs_epu8(vb, va));
+
+        /* Saturating doubling is a clamped shift */
+        for (s = 0; s < shift; s++)
+            d = _mm_adds_epu8(d, d);
+
+        _mm_storeu_si128((__m128i *) (dst + i), _mm_or_si128(d, alpha));
+    }
+
+    return i;
+}
+
+#endif /* YUV_HAVE_X86 */
+
+static const struct metric_kernel kernels[] = {
+#ifdef YUV_HAVE_X86
+    { "avx2", sse_avx2, block_sums_avx2, ssim_row_avx2, cpu_has_avx2 },
+    { "sse2", sse_sse2, block_sums_sse2, ssim_row_sse2, cpu_has_sse2 },
+#endif
+    { "scalar", sse_c, block_sums_c, ssim_row_c, NULL },
+};
+
+#define NUM_KERNELS (int) (sizeof(kernels) / sizeof(kernels[0]))
+
+static const struct metric_kernel *active_kernel;
+
+/* Same rules as yuv_kernel_select(), without a second warning */
+static const struct metric_kernel *kernel_select(void)
+{
+    const char *force = getenv("YUV_KERNEL");
+    int i;
+
+    if (active_kernel)
+        return active_kernel;
+
+    active_kernel = &kernels[NUM_KERNELS - 1];
+    for (i = 0; i < NUM_KERNELS; i++) {
+        if (kernels[i].supported && !kernels[i].supported())
+            continue;
+        if (force && strcmp(force, kernels[i].name))
+            continue;
+        active_kernel = &kernels[i];
+        break;
+    }
+
+    return active_kernel;
+}
+
+const char *yuv_metrics_kernel_name(void)
+{
+    return kernel_select()->name;
+}
+
+/*
+ * Row j of a plane, gathered into scratch when its samples are spread
+ * out, as in interleaved chroma and the packed formats
+ */
+static const uint8_t *plane_row(const struct yuv_plane_layout *p,
+                                const uint8_t *frame, int j, uint8_t *scratch)
+{
+    const uint8_t *src = frame + p->offset + (size_t) j * p->stride;
+    int i = 0;
+
+    if (p->step == 1)
+        return src;
+
+#ifdef YUV_HAVE_X86
+    if (__builtin_cpu_supports("sse2"))
+        i = gather_sse2(scratch, src, p->width, p->step);
+#endif
+    for (; i < p->width; i++)
+        scratch[i] = src[i * p->step];
+
+    return scratch;
+}
+
+struct band_result {
+    uint64_t sse;
+    double ssim;
+    int windows;
+    int failed;
+};
+
+struct metric_job {
+    const struct metric_kernel *k;
+    const uint8_t *a;
+    const uint8_t *b;
+    struct yuv_plane_layout planes[YUV_PLANE_COUNT];
+    int bands;                      /* per plane */
+    struct band_result *results;    /* plane * bands + band */
+};
+
+/*
+ * One band of 4 row block rows of one plane. The band owns the SSE of
+ * its rows and the windows whose top block row it holds, so it reads one
+ * block row past its end. The last band also takes the rows left over
+ * below the last whole block row.
+ */
+static void band_measure(void *arg, int index, int count)
+{
+    struct metric_job *job = arg;
+    const struct yuv_plane_layout *p = &job->planes[index / job->bands];
+    struct band_result *res = &job->results[index];
+    int band = index % job->bands;
+    int bw = p->width / 4, bh = p->height / 4;
+    int per = (bh + job->bands - 1) / job->bands;
+    int b0 = band * per, b1 = b0 + per, last;
+    const uint8_t *ra[4], *rb[4];
+    uint8_t *scratch = NULL;
+    int (*sums)[4], (*prev)[4], (*cur)[4], (*tmp)[4];
+    int by, r;
+
+    if (b1 > bh)
+        b1 = bh;
+    last = b1 < bh ? b1 : bh - 1;
+
+    sums = malloc(2 * (size_t) (bw + 1) * sizeof(*sums));
+    if (p->step > 1)
+        scratch = malloc(8 * (size_t) p->width);
+    if (sums == NULL || (p->step > 1 && scratch == NULL)) {
+        res->failed = 1;
+        goto out;
+    }
+    prev = sums;
+    cur = sums + bw + 1;
+
+    for (by = b0; by <= last && b0 < b1; by++) {
+        for (r = 0; r < 4; r++) {
+            ra[r] = plane_row(p, job->a, 4 * by + r,
+                              scratch + (size_t) r * p->width);
+            rb[r] = plane_row(p, job->b, 4 * by + r,
+                              scratch + (size_t) (4 + r) * p->width);
+            if (by < b1)
+                res->sse += job->k->sse(ra[r], rb[r], p->width);
+        }
+
+        job->k->block_sums(ra, rb, bw, cur);
+
+        /* Windows of 2x2 blocks, 8x8 samples stepped by 4 */
+        if (by > b0 && bw > 1) {
+            res->ssim += job->k->ssim_row(prev, cur, bw - 1);
+            res->windows += bw - 1;
+        }
+
+        tmp = prev;
+        prev = cur;
+        cur = tmp;
+    }
+
+    if (band == job->bands - 1) {
+        for (r = 4 * bh; r < p->height; r++)
+            res->sse += job->k->sse(plane_row(p, job->a, r, scratch),
+                                    plane_row(p, job->b, r,
+                                              scratch + p->width),
+                                    p->width);
+    }
+
+out:
+    free(scratch);
+    free(sums);
+}
+
+double yuv_psnr(uint64_t sse, uint64_t samples)
+{
+    double psnr;
+
+    if (sse == 0 || samples == 0)
+        return YUV_PSNR_MAX;
+
+    psnr = 10 * log10(255.0 * 255.0 * samples / sse);
+
+    return psnr < YUV_PSNR_MAX ? psnr : YUV_PSNR_MAX;
+}
+
+int yuv_metrics_compute(struct yuv_pool *pool, struct yuv_metrics *m,
+                        const uint8_t *a, const uint8_t *b,
+                        enum yuv_format format, int width, int height)
+{
+    struct metric_job job;
+    struct band_result *res;
+    double ssim;
+    int i, band, windows, failed = 0;
+
+    memset(&job, 0, sizeof(job));
+    job.k = kernel_select();
+    job.a = a;
+    job.b = b;
+    yuv_format_planes(format, width, height, job.planes);
+
+    /* Enough bands per plane to keep every thread busy on the chroma too */
+    job.bands = yuv_pool_threads(pool);
+    if (job.bands > (height + 7) / 8)
+        job.bands = (height + 7) / 8;
+    if (job.bands < 1)
+        job.bands = 1;
+
+    job.results = calloc(YUV_PLANE_COUNT * job.bands, sizeof(*job.results));
+    if (job.results == NULL) {
+        perror("Memory metrics calloc fail");
+        return -1;
+    }
+
+    yuv_pool_run(pool, band_measure, &job, YUV_PLANE_COUNT * job.bands);
+
+    /* Bands are added in order, the result does not depend on timing */
+    for (i = 0; i < YUV_PLANE_COUNT; i++) {
+        m->sse[i] = 0;
+        ssim = 0;
+        windows = 0;
+        for (band = 0; band < job.bands; band++) {
+            res = &job.results[i * job.bands + band];
+            m->sse[i] += res->sse;
+            ssim += res->ssim;
+            windows += res->windows;
+            failed |= res->failed;
+        }
+
+        m->samples[i] = (uint64_t) job.planes[i].width * job.planes[i].height;
+        m->psnr[i] = yuv_psnr(m->sse[i], m->samples[i]);
+
+        /* Planes under 8x8 samples have no window */
+        if (windows)
+            m->ssim[i] = ssim / windows;
+        else
+            m->ssim[i] = m->sse[i] == 0 ? 1.0 : 0.0;
+    }
+
+    free(job.results);
+
+    if (failed) {
+        perror("Memory metrics malloc fail");
+        return -1;
+    }
+
+    return 0;
+}
+
+void yuv_rgb_difference(uint32_t *dst, const uint32_t *a, const uint32_t *b,
+                        size_t count, int shift)
+{
+    size_t i = 0;
+    uint32_t out;
+    int c, d;
+
+#ifdef YUV_HAVE_X86
+    if (__builtin_cpu_supports("sse2"))
+        i = difference_sse2(dst, a, b, count, shift);
+#endif
+
+    for (; i < count; i++) {
+        out = 0xff000000;
+        for (c = 0; c < 24; c += 8) {
+            d = abs((int) ((a[i] >> c) & 0xff) - (int) ((b[i] >> c) & 0xff)) << shift;
+            out |= (uint32_t) (d > 255 ? 255 : d) << c;
+        }
+        dst[i] = out;
+    }
+}
@@ -0,0 +1,47 @@
+#ifndef YUV_METRICS_H
+#define YUV_METRICS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "yuv_format.h"
+
+struct yuv_pool;
+
+/* PSNR of identical planes, so averages and CSV columns stay finite */
+#define YUV_PSNR_MAX 100.0
+
+/*
+ * Per plane quality of frame b against reference a. SSIM is the mean
+ * over 8x8 windows stepped by 4 samples, with the usual C1 and C2 for
+ * 8 bit samples.
+ */
+struct yuv_metrics {
+    uint64_t sse[YUV_PLANE_COUNT];      /* sum of squared errors */
+    uint64_t samples[YUV_PLANE_COUNT];
+    double psnr[YUV_PLANE_COUNT];       /* dB */
+    double ssim[YUV_PLANE_COUNT];
+};
+
+/* Name of the vector kernels in use, YUV_KERNEL forces them as for convert */
+const char *yuv_metrics_kernel_name(void);
+
+/*
+ * Compares two frames of the same format and size. Planes are split in
+ * bands of rows and measured on the pool, a NULL pool measures on the
+ * calling thread. Returns -1 if scratch memory runs out.
+ */
+int yuv_metrics_compute(struct yuv_pool *pool, struct yuv_metrics *m,
+                        const uint8_t *a, const uint8_t *b,
+                        enum yuv_format format, int width, int height);
+
+double yuv_psnr(uint64_t sse, uint64_t samples);
+
+/*
+ * Per channel |a - b| of packed 0xAARRGGBB pixels, multiplied by
+ * 1 << shift and clamped, with opaque alpha.
+ */
+void yuv_rgb_difference(uint32_t *dst, const uint32_t *a, const uint32_t *b,
+                        size_t count, int shift);
+
+#endif
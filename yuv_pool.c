@@ -0,0 +1,158 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "yuv_pool.h"
+
+struct yuv_pool {
+    int threads;
+    pthread_t *workers;
+    pthread_mutex_t lock;
+    pthread_cond_t start;
+    pthread_cond_t done;
+    unsigned int generation;
+    int quit;
+
+    /* Current batch, protected by lock */
+    yuv_job_fn fn;
+    void *arg;
+    int count;
+    int next;
+    int pending;
+};
+
+int yuv_cpu_count(void)
+{
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+
+    return n > 0 ? (int) n : 1;
+}
+
+/* Called with lock held, returns with lock held */
+static void run_jobs(struct yuv_pool *pool)
+{
+    while (pool->next < pool->count) {
+        int i = pool->next++;
+
+        pthread_mutex_unlock(&pool->lock);
+        pool->fn(pool->arg, i, pool->count);
+        pthread_mutex_lock(&pool->lock);
+
+        if (--pool->pending == 0)
+            pthread_cond_broadcast(&pool->done);
+    }
+}
+
+static void *worker_main(void *data)
+{
+    struct yuv_pool *pool = data;
+    unsigned int seen;
+
+    pthread_mutex_lock(&pool->lock);
+    seen = pool->generation;
+
+    for (;;) {
+        while (!pool->quit && pool->generation == seen)
+            pthread_cond_wait(&pool->start, &pool->lock);
+
+        if (pool->quit)
+            break;
+
+        seen = pool->generation;
+        run_jobs(pool);
+    }
+
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+struct yuv_pool *yuv_pool_create(int threads)
+{
+    struct yuv_pool *pool;
+    int i;
+
+    if (threads <= 0)
+        threads = yuv_cpu_count();
+
+    pool = calloc(1, sizeof(*pool));
+    if (pool == NULL) {
+        perror("Memory pool calloc fail");
+        return NULL;
+    }
+
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->start, NULL);
+    pthread_cond_init(&pool->done, NULL);
+    pool->threads = 1;
+
+    /* The caller is thread 0 */
+    pool->workers = calloc(threads, sizeof(pthread_t));
+    if (pool->workers == NULL) {
+        perror("Memory pool calloc fail");
+        return pool;
+    }
+
+    for (i = 1; i < threads; i++) {
+        if (pthread_create(&pool->workers[i], NULL, worker_main, pool)) {
+            perror("Worker thread create fail");
+            break;
+        }
+        pool->threads++;
+    }
+
+    return pool;
+}
+
+void yuv_pool_destroy(struct yuv_pool *pool)
+{
+    int i;
+
+    if (pool == NULL)
+        return;
+
+    pthread_mutex_lock(&pool->lock);
+    pool->quit = 1;
+    pthread_cond_broadcast(&pool->start);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (i = 1; i < pool->threads; i++)
+        pthread_join(pool->workers[i], NULL);
+
+    pthread_cond_destroy(&pool->done);
+    pthread_cond_destroy(&pool->start);
+    pthread_mutex_destroy(&pool->lock);
+    free(pool->workers);
+    free(pool);
+}
+
+int yuv_pool_threads(struct yuv_pool *pool)
+{
+    return pool ? pool->threads : 1;
+}
+
+void yuv_pool_run(struct yuv_pool *pool, yuv_job_fn fn, void *arg, int count)
+{
+    int i;
+
+    if (pool == NULL || pool->threads == 1 || count <= 1) {
+        for (i = 0; i < count; i++)
+            fn(arg, i, count);
+        return;
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    pool->fn = fn;
+    pool->arg = arg;
+    pool->count = count;
+    pool->next = 0;
+    pool->pending = count;
+    pool->generation++;
+    pthread_cond_broadcast(&pool->start);
+
+    run_jobs(pool);
+    while (pool->pending > 0)
+        pthread_cond_wait(&pool->done, &pool->lock);
+    pthread_mutex_unlock(&pool->lock);
+}
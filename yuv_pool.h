@@ -0,0 +1,25 @@
+#ifndef YUV_POOL_H
+#define YUV_POOL_H
+
+/*
+ * Fixed set of worker threads running indexed jobs. The calling thread
+ * takes part in the work, so a pool of 1 thread spawns no workers.
+ */
+struct yuv_pool;
+
+typedef void (*yuv_job_fn)(void *arg, int index, int count);
+
+/* threads <= 0 uses one thread per online CPU */
+struct yuv_pool *yuv_pool_create(int threads);
+void yuv_pool_destroy(struct yuv_pool *pool);
+int yuv_pool_threads(struct yuv_pool *pool);
+
+/*
+ * Runs fn(arg, i, count) for every i in [0, count), returns when all are
+ * done. One batch at a time: a pool must not be shared between callers.
+ */
+void yuv_pool_run(struct yuv_pool *pool, yuv_job_fn fn, void *arg, int count);
+
+int yuv_cpu_count(void);
+
+#endif
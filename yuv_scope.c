@@ -0,0 +1,381 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "yuv_scope.h"
+#include "yuv_pool.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define YUV_HAVE_X86 1
+#include <immintrin.h>
+#endif
+
+/* Counters of one band, interleaved so repeated values do not stall */
+#define SUB_HISTOGRAMS 4
+
+/* Panel colours, 0x00RRGGBB */
+#define SCOPE_BACKDROP 0x101010
+#define SCOPE_BAR 0xc0c0c0
+
+static void count_c(uint32_t (*sub)[256], const uint8_t *s, int n)
+{
+    int i;
+
+    for (i = 0; i + 4 <= n; i += 4) {
+        sub[0][s[i]]++;
+        sub[1][s[i + 1]]++;
+        sub[2][s[i + 2]]++;
+        sub[3][s[i + 3]]++;
+    }
+    for (; i < n; i++)
+        sub[0][s[i]]++;
+}
+
+static void add_c(uint32_t *dst, const uint32_t *src, size_t n)
+{
+    size_t i;
+
+    for (i = 0; i < n; i++)
+        dst[i] += src[i];
+}
+
+#ifdef YUV_HAVE_X86
+
+/*
+ * 16 samples per load, taken out a 32 bit lane at a time and spread over
+ * the sub-histograms by their byte within the lane. Returns how many it
+ * counted, the caller finishes the rest.
+ */
+__attribute__((target("sse2")))
+static int count_sse2(uint32_t (*sub)[256], const uint8_t *s, int n)
+{
+    uint32_t w;
+    int i, lane;
+
+    for (i = 0; i + 16 <= n; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *) (s + i));
+
+        for (lane = 0; lane < 4; lane++) {
+            w = _mm_cvtsi128_si32(v);
+            v = _mm_srli_si128(v, 4);
+            sub[0][w & 0xff]++;
+            sub[1][(w >> 8) & 0xff]++;
+            sub[2][(w >> 16) & 0xff]++;
+            sub[3][w >> 24]++;
+        }
+    }
+
+    return i;
+}
+
+__attribute__((target("sse2")))
+static size_t add_sse2(uint32_t *dst, const uint32_t *src, size_t n)
+{
+    size_t i;
+
+    for (i = 0; i + 4 <= n; i += 4) {
+        __m128i d = _mm_loadu_si128((const __m128i *) (dst + i));
+        __m128i v = _mm_loadu_si128((const __m128i *) (src + i));
+
+        _mm_storeu_si128((__m128i *) (dst + i), _mm_add_epi32(d, v));
+    }
+
+    return i;
+}
+
+#endif /* YUV_HAVE_X86 */
+
+static void count_samples(uint32_t (*sub)[256], const uint8_t *s, int n)
+{
+    int i = 0;
+
+#ifdef YUV_HAVE_X86
+    if (__builtin_cpu_supports("sse2"))
+        i = count_sse2(sub, s, n);
+#endif
+    count_c(sub, s + i, n - i);
+}
+
+/* dst[i] += src[i] */
+static void add_counts(uint32_t *dst, const uint32_t *src, size_t n)
+{
+    size_t i = 0;
+
+#ifdef YUV_HAVE_X86
+    if (__builtin_cpu_supports("sse2"))
+        i = add_sse2(dst, src, n);
+#endif
+    add_c(dst + i, src + i, n - i);
+}
+
+struct yuv_scopes *yuv_scopes_create(void)
+{
+    struct yuv_scopes *s = calloc(1, sizeof(*s));
+
+    if (s == NULL)
+        perror("Memory scopes calloc fail");
+
+    return s;
+}
+
+void yuv_scopes_destroy(struct yuv_scopes *s)
+{
+    if (s == NULL)
+        return;
+
+    free(s->partial);
+    free(s);
+}
+
+struct scope_job {
+    struct yuv_scopes *s;
+    const uint8_t *src;
+    struct yuv_plane_layout planes[YUV_PLANE_COUNT];
+    int step;
+    int bands;
+    int *failed;        /* per band */
+};
+
+/* First sample of the step grid at or after x */
+static inline int grid_start(int x, int step)
+{
+    return (x + step - 1) / step * step;
+}
+
+/*
+ * Luma of waveform column c, every step-th sample of every step-th row,
+ * gathered into one run and counted into sub.
+ */
+static void column_count(const struct scope_job *job, int c, uint8_t *run,
+                         uint32_t (*sub)[256])
+{
+    const struct yuv_plane_layout *p = &job->planes[YUV_PLANE_Y];
+    int x0 = (int) ((int64_t) c * p->width / YUV_SCOPE_WIDTH);
+    int x1 = (int) ((int64_t) (c + 1) * p->width / YUV_SCOPE_WIDTH);
+    int dx = job->step * p->step;
+    const uint8_t *row;
+    int j, x, n = 0;
+
+    x0 = grid_start(x0, job->step);
+    if (x0 >= x1)
+        return;
+
+    for (j = 0; j < p->height; j += job->step) {
+        row = job->src + p->offset + (size_t) j * p->stride;
+        if (dx == 1) {
+            memcpy(run + n, row + x0, x1 - x0);
+            n += x1 - x0;
+            continue;
+        }
+        for (x = x0 * p->step; x < x1 * p->step; x += dx)
+            run[n++] = row[x];
+    }
+
+    count_samples(sub, run, n);
+}
+
+/*
+ * One stripe of waveform columns and of chroma columns. Its columns of
+ * the waveform are its own, the vectorscope is per band and summed once
+ * all are done.
+ */
+static void band_scope(void *arg, int index, int count)
+{
+    struct scope_job *job = arg;
+    struct yuv_scopes *s = job->s;
+    const struct yuv_plane_layout *pu = &job->planes[YUV_PLANE_U];
+    const struct yuv_plane_layout *pv = &job->planes[YUV_PLANE_V];
+    uint32_t (*vector)[256] = index ? s->partial[index - 1] : s->vectorscope;
+    uint32_t (*sub)[256];
+    int c0 = index * YUV_SCOPE_WIDTH / job->bands;
+    int c1 = (index + 1) * YUV_SCOPE_WIDTH / job->bands;
+    int x0 = index * pu->width / job->bands;
+    int x1 = (index + 1) * pu->width / job->bands;
+    /* Widest column rounded up, in samples, times the rows taken */
+    size_t run_size = ((size_t) job->planes[YUV_PLANE_Y].width /
+                       YUV_SCOPE_WIDTH + 2) *
+                      ((job->planes[YUV_PLANE_Y].height + job->step - 1) /
+                       job->step);
+    const uint8_t *ru, *rv;
+    uint8_t *run;
+    int c, k, j, x;
+
+    sub = malloc(SUB_HISTOGRAMS * sizeof(*sub));
+    run = malloc(run_size);
+    if (sub == NULL || run == NULL) {
+        job->failed[index] = 1;
+        goto out;
+    }
+
+    for (c = c0; c < c1; c++) {
+        memset(sub, 0, SUB_HISTOGRAMS * sizeof(*sub));
+        column_count(job, c, run, sub);
+
+        memcpy(s->waveform[c], sub[0], sizeof(s->waveform[c]));
+        for (k = 1; k < SUB_HISTOGRAMS; k++)
+            add_counts(s->waveform[c], sub[k], 256);
+    }
+
+    /* Samples spread over 64K bins seldom repeat back to back */
+    memset(vector, 0, sizeof(s->vectorscope));
+    x0 = grid_start(x0, job->step);
+    for (j = 0; j < pu->height; j += job->step) {
+        ru = job->src + pu->offset + (size_t) j * pu->stride;
+        rv = job->src + pv->offset + (size_t) j * pv->stride;
+        for (x = x0; x < x1; x += job->step)
+            vector[rv[x * pv->step]][ru[x * pu->step]]++;
+    }
+
+out:
+    free(run);
+    free(sub);
+}
+
+int yuv_scopes_compute(struct yuv_pool *pool, struct yuv_scopes *s,
+                       const uint8_t *src, enum yuv_format format,
+                       int width, int height, int step)
+{
+    struct scope_job job;
+    int i, c, failed = 0;
+    void *partial;
+
+    memset(&job, 0, sizeof(job));
+    job.s = s;
+    job.src = src;
+    job.step = step > 1 ? step : 1;
+    yuv_format_planes(format, width, height, job.planes);
+
+    job.bands = yuv_pool_threads(pool);
+    if (job.bands > YUV_SCOPE_WIDTH)
+        job.bands = YUV_SCOPE_WIDTH;
+    if (job.bands < 1)
+        job.bands = 1;
+
+    /* Kept for the next frame, a pool does not change its size */
+    if (s->partials < job.bands - 1) {
+        partial = realloc(s->partial, (job.bands - 1) * sizeof(*s->partial));
+        if (partial == NULL) {
+            perror("Memory scopes realloc fail");
+            return -1;
+        }
+        s->partial = partial;
+        s->partials = job.bands - 1;
+    }
+
+    job.failed = calloc(job.bands, sizeof(*job.failed));
+    if (job.failed == NULL) {
+        perror("Memory scopes calloc fail");
+        return -1;
+    }
+
+    yuv_pool_run(pool, band_scope, &job, job.bands);
+
+    for (i = 0; i < job.bands; i++)
+        failed |= job.failed[i];
+    free(job.failed);
+    if (failed) {
+        perror("Memory scopes malloc fail");
+        return -1;
+    }
+
+    for (i = 1; i < job.bands; i++)
+        add_counts(&s->vectorscope[0][0], &s->partial[i - 1][0][0], 256 * 256);
+
+    /* The histogram is the waveform with its columns added up */
+    memset(s->histogram, 0, sizeof(s->histogram));
+    for (c = 0; c < YUV_SCOPE_WIDTH; c++)
+        add_counts(s->histogram, s->waveform[c], 256);
+
+    s->luma_samples = 0;
+    for (i = 0; i < 256; i++)
+        s->luma_samples += s->histogram[i];
+    s->chroma_samples = (uint64_t) ((job.planes[YUV_PLANE_U].width +
+                                     job.step - 1) / job.step) *
+                        ((job.planes[YUV_PLANE_U].height + job.step - 1) /
+                         job.step);
+
+    return 0;
+}
+
+static inline uint32_t *panel_row(uint32_t *rgb, int stride, int y)
+{
+    return (uint32_t *) ((uint8_t *) rgb + (size_t) y * stride);
+}
+
+/*
+ * Phosphor green, log scaled against the busiest bin so a few samples
+ * still show next to a flat area
+ */
+static inline uint32_t trace_colour(uint32_t n, double scale)
+{
+    uint32_t g;
+
+    if (n == 0)
+        return SCOPE_BACKDROP;
+
+    g = 64 + (uint32_t) (191 * log1p(n) * scale);
+    if (g > 255)
+        g = 255;
+
+    return (g / 2) << 16 | g << 8 | g / 2;
+}
+
+static inline double trace_scale(uint32_t max)
+{
+    return max ? 1 / log1p(max) : 0;
+}
+
+void yuv_scopes_render(const struct yuv_scopes *s, uint32_t *rgb, int stride)
+{
+    uint32_t max, n, *row;
+    double scale;
+    int x, y, c, h;
+
+    for (y = 0; y < YUV_SCOPE_HEIGHT; y++) {
+        row = panel_row(rgb, stride, y);
+        for (x = 0; x < YUV_SCOPE_WIDTH; x++)
+            row[x] = 0;
+    }
+
+    /* Histogram bars, scaled to the highest */
+    max = 0;
+    for (x = 0; x < 256; x++)
+        max = s->histogram[x] > max ? s->histogram[x] : max;
+    for (x = 0; x < 256; x++) {
+        h = max ? (int) ((uint64_t) s->histogram[x] * YUV_SCOPE_HIST_HEIGHT /
+                         max) : 0;
+        for (y = 0; y < YUV_SCOPE_HIST_HEIGHT; y++)
+            panel_row(rgb, stride, y)[x] =
+                y >= YUV_SCOPE_HIST_HEIGHT - h ? SCOPE_BAR : SCOPE_BACKDROP;
+    }
+
+    /* Waveform, white at the top as on a monitor */
+    max = 0;
+    for (c = 0; c < YUV_SCOPE_WIDTH; c++) {
+        for (y = 0; y < 256; y += 2) {
+            n = s->waveform[c][y] + s->waveform[c][y + 1];
+            max = n > max ? n : max;
+        }
+    }
+    scale = trace_scale(max);
+    for (y = 0; y < YUV_SCOPE_WAVE_HEIGHT; y++) {
+        row = panel_row(rgb, stride, YUV_SCOPE_WAVE_TOP + y);
+        for (c = 0; c < YUV_SCOPE_WIDTH; c++)
+            row[c] = trace_colour(s->waveform[c][254 - 2 * y] +
+                                  s->waveform[c][255 - 2 * y], scale);
+    }
+
+    /* Vectorscope, U across and V up */
+    max = 0;
+    for (y = 0; y < 256; y++) {
+        for (x = 0; x < 256; x++)
+            max = s->vectorscope[y][x] > max ? s->vectorscope[y][x] : max;
+    }
+    scale = trace_scale(max);
+    for (y = 0; y < YUV_SCOPE_VECTOR_SIZE; y++) {
+        row = panel_row(rgb, stride, YUV_SCOPE_VECTOR_TOP + y);
+        for (x = 0; x < YUV_SCOPE_VECTOR_SIZE; x++)
+            row[x] = trace_colour(s->vectorscope[255 - y][x], scale);
+    }
+}
@@ -0,0 +1,57 @@
+#ifndef YUV_SCOPE_H
+#define YUV_SCOPE_H
+
+#include <stdint.h>
+
+#include "yuv_format.h"
+
+struct yuv_pool;
+
+/* Panel drawn by yuv_scopes_render(), the three scopes stacked */
+#define YUV_SCOPE_WIDTH 256
+#define YUV_SCOPE_HIST_HEIGHT 96
+#define YUV_SCOPE_WAVE_HEIGHT 128   /* two luma levels per row */
+#define YUV_SCOPE_VECTOR_SIZE 256
+#define YUV_SCOPE_GAP 8
+#define YUV_SCOPE_WAVE_TOP (YUV_SCOPE_HIST_HEIGHT + YUV_SCOPE_GAP)
+#define YUV_SCOPE_VECTOR_TOP (YUV_SCOPE_WAVE_TOP + YUV_SCOPE_WAVE_HEIGHT + \
+                              YUV_SCOPE_GAP)
+#define YUV_SCOPE_HEIGHT (YUV_SCOPE_VECTOR_TOP + YUV_SCOPE_VECTOR_SIZE)
+
+/*
+ * Video scopes of one frame, counted on the YUV samples as stored, so
+ * they show the signal before any matrix or range is applied. The
+ * waveform has one column per YUV_SCOPE_WIDTH-th of the frame width.
+ */
+struct yuv_scopes {
+    uint32_t histogram[256];                    /* luma */
+    uint32_t waveform[YUV_SCOPE_WIDTH][256];    /* [column][luma] */
+    uint32_t vectorscope[256][256];             /* [v][u] */
+    uint64_t luma_samples;
+    uint64_t chroma_samples;
+
+    /* Vectorscopes of the bands past the first, kept between frames */
+    uint32_t (*partial)[256][256];
+    int partials;
+};
+
+struct yuv_scopes *yuv_scopes_create(void);
+void yuv_scopes_destroy(struct yuv_scopes *s);
+
+/*
+ * Counts every step-th sample of every step-th row, step 1 takes them
+ * all. The frame is split in column stripes on the pool, a NULL pool
+ * counts on the calling thread. Returns -1 if memory runs out.
+ */
+int yuv_scopes_compute(struct yuv_pool *pool, struct yuv_scopes *s,
+                       const uint8_t *src, enum yuv_format format,
+                       int width, int height, int step);
+
+/*
+ * Draws the scopes into a YUV_SCOPE_WIDTH x YUV_SCOPE_HEIGHT picture of
+ * 0x00RRGGBB pixels (cairo RGB24), stride in bytes. The graticules are
+ * left to the caller.
+ */
+void yuv_scopes_render(const struct yuv_scopes *s, uint32_t *rgb, int stride);
+
+#endif
@@ -0,0 +1,333 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#include "yuv_shm.h"
+
+#define SHM_ALIGN 64
+
+/*
+ * Start of the mapping. The producer and consumer fields sit on their
+ * own cache lines so the two sides do not bounce one line between them.
+ * data_seq and space_seq are the futex words: bumped after every publish
+ * and release, a sleeper waits for them to change.
+ */
+struct shm_header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t slots;
+    uint32_t reserved;
+    uint64_t slot_size;
+    uint64_t data_offset;
+
+    /* Written by the producer */
+    uint64_t head __attribute__((aligned(SHM_ALIGN)));
+    uint32_t data_seq;
+    uint32_t closed;
+    uint32_t space_waiters;
+
+    /* Written by the consumer */
+    uint64_t tail __attribute__((aligned(SHM_ALIGN)));
+    uint32_t space_seq;
+    uint32_t data_waiters;
+};
+
+struct yuv_shm {
+    struct shm_header *hdr;
+    uint8_t *data;
+    size_t map_size;
+    char *name;         /* set for the producer, which removes it */
+};
+
+static int64_t now_ms(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/* Not FUTEX_PRIVATE, the word is shared with another process */
+static void futex_wait(uint32_t *addr, uint32_t val, int64_t timeout_ms)
+{
+    struct timespec ts, *tp = NULL;
+
+    if (timeout_ms >= 0) {
+        ts.tv_sec = timeout_ms / 1000;
+        ts.tv_nsec = (timeout_ms % 1000) * 1000000;
+        tp = &ts;
+    }
+
+    syscall(SYS_futex, addr, FUTEX_WAIT, val, tp, NULL, 0);
+}
+
+static void futex_wake(uint32_t *addr)
+{
+    syscall(SYS_futex, addr, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+}
+
+/*
+ * Sleeps on seq until it moves past the value read before the caller's
+ * check, or the deadline passes. The waiter count lets the other side
+ * skip the wake syscall when nobody sleeps.
+ */
+static void seq_wait(uint32_t *seq, uint32_t val, uint32_t *waiters,
+                     int64_t deadline)
+{
+    int64_t left = -1;
+
+    if (deadline >= 0) {
+        left = deadline - now_ms();
+        if (left <= 0)
+            return;
+    }
+
+    __atomic_fetch_add(waiters, 1, __ATOMIC_SEQ_CST);
+    futex_wait(seq, val, left);
+    __atomic_fetch_sub(waiters, 1, __ATOMIC_SEQ_CST);
+}
+
+static void seq_bump(uint32_t *seq, uint32_t *waiters)
+{
+    __atomic_fetch_add(seq, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(waiters, __ATOMIC_SEQ_CST))
+        futex_wake(seq);
+}
+
+/* shm_open() wants a leading slash */
+static char *shm_name(const char *name)
+{
+    char *path = malloc(strlen(name) + 2);
+
+    if (path == NULL) {
+        perror("Memory shm name malloc fail");
+        return NULL;
+    }
+
+    sprintf(path, "%s%s", name[0] == '/' ? "" : "/", name);
+    return path;
+}
+
+struct yuv_shm *yuv_shm_create(const char *name, int slots, size_t slot_size)
+{
+    struct yuv_shm *shm;
+    struct shm_header *hdr;
+    size_t page = sysconf(_SC_PAGESIZE);
+    size_t data_offset;
+    int fd;
+
+    if (slots < 2 || slot_size == 0) {
+        printf("Shared ring needs 2 or more slots\n");
+        return NULL;
+    }
+
+    shm = calloc(1, sizeof(*shm));
+    if (shm == NULL || (shm->name = shm_name(name)) == NULL) {
+        perror("Memory shm calloc fail");
+        free(shm);
+        return NULL;
+    }
+
+    slot_size = (slot_size + SHM_ALIGN - 1) & ~(size_t) (SHM_ALIGN - 1);
+    data_offset = (sizeof(*hdr) + page - 1) & ~(page - 1);
+    shm->map_size = data_offset + (size_t) slots * slot_size;
+
+    /* A ring left behind by a producer that crashed */
+    shm_unlink(shm->name);
+
+    fd = shm_open(shm->name, O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd < 0) {
+        perror("Shared memory open fail");
+        goto fail;
+    }
+
+    if (ftruncate(fd, shm->map_size) < 0) {
+        perror("Shared memory resize fail");
+        close(fd);
+        shm_unlink(shm->name);
+        goto fail;
+    }
+
+    hdr = mmap(NULL, shm->map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (hdr == MAP_FAILED) {
+        perror("Shared memory mmap fail");
+        shm_unlink(shm->name);
+        goto fail;
+    }
+
+    /* ftruncate zeroed the rest; magic last, a consumer checks it first */
+    hdr->version = YUV_SHM_VERSION;
+    hdr->slots = slots;
+    hdr->slot_size = slot_size;
+    hdr->data_offset = data_offset;
+    __atomic_store_n(&hdr->magic, YUV_SHM_MAGIC, __ATOMIC_RELEASE);
+
+    shm->hdr = hdr;
+    shm->data = (uint8_t *) hdr + data_offset;
+
+    return shm;
+
+fail:
+    free(shm->name);
+    free(shm);
+    return NULL;
+}
+
+struct yuv_shm *yuv_shm_open(const char *name)
+{
+    struct yuv_shm *shm;
+    struct shm_header *hdr;
+    struct stat st;
+    char *path;
+    int fd;
+
+    path = shm_name(name);
+    if (path == NULL)
+        return NULL;
+
+    /* Read-write: the consumer moves tail */
+    fd = shm_open(path, O_RDWR, 0);
+    free(path);
+    if (fd < 0) {
+        perror("Shared memory open fail");
+        return NULL;
+    }
+
+    if (fstat(fd, &st) < 0 || (size_t) st.st_size < sizeof(*hdr)) {
+        printf("Shared memory is not a frame ring\n");
+        close(fd);
+        return NULL;
+    }
+
+    hdr = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (hdr == MAP_FAILED) {
+        perror("Shared memory mmap fail");
+        return NULL;
+    }
+
+    if (__atomic_load_n(&hdr->magic, __ATOMIC_ACQUIRE) != YUV_SHM_MAGIC ||
+        hdr->version != YUV_SHM_VERSION || hdr->slots < 2 ||
+        hdr->data_offset + hdr->slots * hdr->slot_size > (uint64_t) st.st_size) {
+        printf("Shared memory is not a frame ring\n");
+        munmap(hdr, st.st_size);
+        return NULL;
+    }
+
+    shm = calloc(1, sizeof(*shm));
+    if (shm == NULL) {
+        perror("Memory shm calloc fail");
+        munmap(hdr, st.st_size);
+        return NULL;
+    }
+
+    shm->hdr = hdr;
+    shm->data = (uint8_t *) hdr + hdr->data_offset;
+    shm->map_size = st.st_size;
+
+    return shm;
+}
+
+void yuv_shm_close(struct yuv_shm *shm)
+{
+    if (shm == NULL)
+        return;
+
+    munmap(shm->hdr, shm->map_size);
+    if (shm->name) {
+        shm_unlink(shm->name);
+        free(shm->name);
+    }
+    free(shm);
+}
+
+size_t yuv_shm_slot_size(const struct yuv_shm *shm)
+{
+    return shm->hdr->slot_size;
+}
+
+uint8_t *yuv_shm_acquire(struct yuv_shm *shm, int timeout_ms)
+{
+    struct shm_header *h = shm->hdr;
+    int64_t deadline = timeout_ms >= 0 ? now_ms() + timeout_ms : -1;
+    uint32_t seq;
+
+    for (;;) {
+        seq = __atomic_load_n(&h->space_seq, __ATOMIC_ACQUIRE);
+        if (h->head - __atomic_load_n(&h->tail, __ATOMIC_ACQUIRE) < h->slots)
+            return shm->data + (h->head % h->slots) * h->slot_size;
+
+        if (deadline >= 0 && now_ms() >= deadline)
+            return NULL;
+        seq_wait(&h->space_seq, seq, &h->space_waiters, deadline);
+    }
+}
+
+void yuv_shm_publish(struct yuv_shm *shm)
+{
+    struct shm_header *h = shm->hdr;
+
+    /* Release: the slot contents are visible before the new head */
+    __atomic_store_n(&h->head, h->head + 1, __ATOMIC_RELEASE);
+    seq_bump(&h->data_seq, &h->data_waiters);
+}
+
+void yuv_shm_finish(struct yuv_shm *shm)
+{
+    struct shm_header *h = shm->hdr;
+
+    __atomic_store_n(&h->closed, 1, __ATOMIC_RELEASE);
+    __atomic_fetch_add(&h->data_seq, 1, __ATOMIC_SEQ_CST);
+    futex_wake(&h->data_seq);
+}
+
+int yuv_shm_wait(struct yuv_shm *shm, int timeout_ms)
+{
+    struct shm_header *h = shm->hdr;
+    int64_t deadline = timeout_ms >= 0 ? now_ms() + timeout_ms : -1;
+    uint32_t seq;
+
+    for (;;) {
+        seq = __atomic_load_n(&h->data_seq, __ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&h->head, __ATOMIC_ACQUIRE) != h->tail)
+            return 1;
+        if (__atomic_load_n(&h->closed, __ATOMIC_ACQUIRE))
+            return -1;
+
+        if (deadline >= 0 && now_ms() >= deadline)
+            return 0;
+        seq_wait(&h->data_seq, seq, &h->data_waiters, deadline);
+    }
+}
+
+const uint8_t *yuv_shm_peek(struct yuv_shm *shm, uint64_t *available)
+{
+    struct shm_header *h = shm->hdr;
+    uint64_t n = __atomic_load_n(&h->head, __ATOMIC_ACQUIRE) - h->tail;
+
+    if (available)
+        *available = n;
+    if (n == 0)
+        return NULL;
+
+    return shm->data + (h->tail % h->slots) * h->slot_size;
+}
+
+void yuv_shm_release(struct yuv_shm *shm)
+{
+    struct shm_header *h = shm->hdr;
+
+    /* Release: done reading the slot before the producer may reuse it */
+    __atomic_store_n(&h->tail, h->tail + 1, __ATOMIC_RELEASE);
+    seq_bump(&h->space_seq, &h->space_waiters);
+}
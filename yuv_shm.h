@@ -0,0 +1,58 @@
+#ifndef YUV_SHM_H
+#define YUV_SHM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define YUV_SHM_MAGIC 0x4d485359    /* "YSHM" */
+#define YUV_SHM_VERSION 1
+
+/*
+ * Named shared memory ring of chunks, one producer and one consumer.
+ * Each slot holds a chunk exactly as in a file, header then payload, so
+ * the consumer can convert straight out of the mapping. head and tail
+ * count frames written and consumed; each side only writes its own.
+ * Waits sleep on a futex in the mapping, so both sides can be separate
+ * processes.
+ */
+struct yuv_shm;
+
+/*
+ * Producer: creates /name (replacing a stale one) with slots of at least
+ * slot_size bytes. NULL on error.
+ */
+struct yuv_shm *yuv_shm_create(const char *name, int slots, size_t slot_size);
+
+/* Consumer: attaches to a ring made by yuv_shm_create() */
+struct yuv_shm *yuv_shm_open(const char *name);
+
+/* Unmaps; the producer also removes the name */
+void yuv_shm_close(struct yuv_shm *shm);
+
+size_t yuv_shm_slot_size(const struct yuv_shm *shm);
+
+/*
+ * Producer: the next free slot, waiting up to timeout_ms (-1 forever)
+ * for the consumer to release one. NULL if the ring stayed full.
+ */
+uint8_t *yuv_shm_acquire(struct yuv_shm *shm, int timeout_ms);
+
+/* Producer: makes the acquired slot visible and wakes the consumer */
+void yuv_shm_publish(struct yuv_shm *shm);
+
+/* Producer: no more frames, the consumer sees the end once it drains */
+void yuv_shm_finish(struct yuv_shm *shm);
+
+/*
+ * Consumer: waits up to timeout_ms (-1 forever) for a frame. 1 if one is
+ * ready, 0 on timeout, -1 once the producer finished and all are read.
+ */
+int yuv_shm_wait(struct yuv_shm *shm, int timeout_ms);
+
+/* Consumer: oldest unread slot, or NULL. *available counts unread ones. */
+const uint8_t *yuv_shm_peek(struct yuv_shm *shm, uint64_t *available);
+
+/* Consumer: done with the peeked slot, the producer may reuse it */
+void yuv_shm_release(struct yuv_shm *shm);
+
+#endif
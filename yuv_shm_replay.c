@@ -0,0 +1,232 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#include "yuv_chunk.h"
+#include "yuv_shm.h"
+
+#define DEFAULT_SLOTS 4
+#define DEFAULT_FPS 30      /* v1 streams carry no timestamps */
+#define POLL_MS 100         /* unpaced waits for a slot, between stop checks */
+
+static volatile sig_atomic_t stop;
+
+static void stop_handler(int sig)
+{
+    stop = 1;
+}
+
+static void print_help()
+{
+    printf("Usage:\n");
+    printf("\tyuv_shm_replay [-n slots] [-r fps] [-l loops] name file\n");
+    printf("\tReplays the chunks of file into the shared memory ring name, paced\n"
+           "\tby the stream timestamps, or at fps (v1 default %d). -r 0 goes as\n"
+           "\tfast as the reader frees slots, otherwise a frame finding the ring\n"
+           "\tfull is dropped like a live capture would. -l 0 loops forever.\n",
+           DEFAULT_FPS);
+    printf("\tView with: gtk_player shm:name\n");
+}
+
+static int64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void sleep_until(int64_t ns)
+{
+    struct timespec ts = { ns / 1000000000, ns % 1000000000 };
+
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR &&
+           !stop)
+        ;
+}
+
+/*
+ * Header plus payload length of the chunk at offset, -1 on error. The
+ * header may be longer than struct yuv_info_v2, the extension goes along
+ * into the slot.
+ */
+static int64_t chunk_length(int fd, int64_t offset, int64_t file_size)
+{
+    struct yuv_info_v2 hdr;
+    struct yuv_chunk chunk;
+    ssize_t n;
+    int len;
+
+    n = pread(fd, &hdr, sizeof(hdr), offset);
+    if (n < (ssize_t) sizeof(struct yuv_info))
+        return -1;
+
+    len = yuv_chunk_decode(&hdr, n, &chunk);
+    if (len < 0 || chunk.version == 0 || yuv_chunk_verify_header(&chunk) < 0 ||
+        offset + len + (int64_t) chunk.size > file_size)
+        return -1;
+
+    return len + (int64_t) chunk.size;
+}
+
+static int pread_full(int fd, uint8_t *buf, size_t size, int64_t offset)
+{
+    ssize_t n;
+
+    while (size) {
+        n = pread(fd, buf, size, offset);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return -1;
+        buf += n;
+        size -= n;
+        offset += n;
+    }
+
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    struct yuv_index index;
+    struct yuv_shm *shm;
+    struct stat st;
+    int64_t *lengths, max_length = 0;
+    int64_t start, due, loop_ns, interval_ns;
+    uint64_t published = 0, dropped = 0;
+    double fps = -1;
+    int slots = DEFAULT_SLOTS, loops = 1, loop, opt, fd, i;
+    uint8_t *slot;
+
+    while ((opt = getopt(argc, argv, "n:r:l:h")) != -1) {
+        switch (opt) {
+        case 'n':
+            slots = atoi(optarg);
+            break;
+        case 'r':
+            fps = atof(optarg);
+            break;
+        case 'l':
+            loops = atoi(optarg);
+            break;
+        default:
+            print_help();
+            return 0;
+        }
+    }
+
+    if (argc - optind != 2 || slots < 2 || loops < 0) {
+        print_help();
+        return 0;
+    }
+
+    fd = open(argv[optind + 1], O_RDONLY);
+    if (fd < 0) {
+        perror("File open fail!");
+        return 1;
+    }
+
+    if (fstat(fd, &st) < 0 ||
+        yuv_index_open(argv[optind + 1], fd, &index) < 0 || index.count == 0) {
+        printf("No chunks in %s\n", argv[optind + 1]);
+        return 1;
+    }
+
+    if (fps < 0 && index.timestamps == NULL)
+        fps = DEFAULT_FPS;
+
+    /* Every slot takes the largest chunk whole */
+    lengths = malloc(index.count * sizeof(*lengths));
+    if (lengths == NULL) {
+        perror("Memory malloc fail");
+        return 1;
+    }
+    for (i = 0; i < index.count; i++) {
+        lengths[i] = chunk_length(fd, index.offsets[i], st.st_size);
+        if (lengths[i] < 0) {
+            printf("Bad chunk %d in %s\n", i + 1, argv[optind + 1]);
+            return 1;
+        }
+        if (lengths[i] > max_length)
+            max_length = lengths[i];
+    }
+
+    shm = yuv_shm_create(argv[optind], slots, max_length);
+    if (shm == NULL)
+        return 1;
+
+    signal(SIGINT, stop_handler);
+    signal(SIGTERM, stop_handler);
+
+    printf("Replaying %d frames of %s into %s, %d slots of %zu bytes\n",
+           index.count, argv[optind + 1], argv[optind], slots,
+           yuv_shm_slot_size(shm));
+
+    /* Timestamps restart each loop, one frame interval after the last */
+    interval_ns = fps > 0 ? (int64_t) (1e9 / fps) : 0;
+    if (fps < 0 && index.count > 1)
+        interval_ns = (index.timestamps[index.count - 1] - index.timestamps[0]) *
+                      1000 / (index.count - 1);
+    if (fps < 0)
+        loop_ns = (index.timestamps[index.count - 1] - index.timestamps[0]) *
+                  1000 + interval_ns;
+    else
+        loop_ns = interval_ns * index.count;
+
+    start = now_ns();
+    for (loop = 0; !stop && (loops == 0 || loop < loops); loop++) {
+        for (i = 0; i < index.count && !stop; i++) {
+            if (fps < 0)
+                due = (index.timestamps[i] - index.timestamps[0]) * 1000;
+            else
+                due = i * interval_ns;
+            due += start + loop * loop_ns;
+
+            if (fps != 0)
+                sleep_until(due);
+
+            /*
+             * Paced, a frame that finds the ring full is lost. Unpaced it
+             * waits for the reader, but still stops on a signal when no
+             * reader ever comes.
+             */
+            if (fps != 0)
+                slot = yuv_shm_acquire(shm, 0);
+            else
+                while ((slot = yuv_shm_acquire(shm, POLL_MS)) == NULL && !stop)
+                    ;
+            if (slot == NULL) {
+                if (!stop)
+                    dropped++;
+                continue;
+            }
+
+            if (pread_full(fd, slot, lengths[i], index.offsets[i]) < 0) {
+                perror("File read fail");
+                stop = 1;
+                break;
+            }
+            yuv_shm_publish(shm);
+            published++;
+        }
+    }
+
+    yuv_shm_finish(shm);
+    printf("%llu frames published, %llu dropped on a full ring, %.2f s\n",
+           (unsigned long long) published, (unsigned long long) dropped,
+           (now_ns() - start) / 1e9);
+
+    yuv_shm_close(shm);
+    yuv_index_free(&index);
+    free(lengths);
+    close(fd);
+
+    return 0;
+}
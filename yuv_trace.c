@@ -0,0 +1,128 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/syscall.h>
+
+#include "yuv_trace.h"
+
+static FILE *trace_fp;
+static int trace_events;
+static int64_t trace_base_ns;
+static pthread_mutex_t trace_lock = PTHREAD_MUTEX_INITIALIZER;
+
+int64_t yuv_time_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void trace_event(const char *name, int frame, int64_t start_ns,
+                        int64_t dur_ns)
+{
+    /* Timestamps are in us, relative to the open so they stay short */
+    pthread_mutex_lock(&trace_lock);
+    if (trace_fp) {
+        fprintf(trace_fp, "%s\n{\"name\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,"
+                "\"dur\":%.3f,\"pid\":%d,\"tid\":%ld,\"args\":{\"frame\":%d}}",
+                trace_events ? "," : "", name,
+                (start_ns - trace_base_ns) / 1000.0, dur_ns / 1000.0,
+                (int) getpid(), (long) syscall(SYS_gettid), frame);
+        trace_events++;
+    }
+    pthread_mutex_unlock(&trace_lock);
+}
+
+int64_t yuv_stage_end(struct yuv_stage *stage, int frame, int64_t start_ns)
+{
+    int64_t now = yuv_time_ns();
+    int64_t ns = now - start_ns;
+
+    stage->last_ns = ns;
+    stage->total_ns += ns;
+    stage->count++;
+    if (ns > stage->max_ns)
+        stage->max_ns = ns;
+
+    if (trace_fp)
+        trace_event(stage->name, frame, start_ns, ns);
+
+    return now;
+}
+
+int yuv_stage_format(char *buf, size_t len, const struct yuv_stage *stages,
+                     int count)
+{
+    size_t used = 0;
+    int i, n;
+
+    if (len)
+        buf[0] = '\0';
+
+    for (i = 0; i < count && used < len; i++) {
+        const struct yuv_stage *s = &stages[i];
+
+        n = snprintf(buf + used, len - used, "%s%-8s %7.3f %7.3f %7.3f ms",
+                     i ? "\n" : "", s->name, s->last_ns / 1e6,
+                     s->count ? s->total_ns / 1e6 / s->count : 0,
+                     s->max_ns / 1e6);
+        if (n < 0)
+            break;
+        used += n;
+    }
+
+    return used < len ? (int) used : (int) len - 1;
+}
+
+void yuv_stage_print(const struct yuv_stage *stages, int count)
+{
+    int i;
+
+    printf("stage      count   avg ms   max ms\n");
+    for (i = 0; i < count; i++) {
+        const struct yuv_stage *s = &stages[i];
+
+        if (s->count == 0)
+            continue;
+        printf("%-8s %7llu %8.3f %8.3f\n", s->name,
+               (unsigned long long) s->count, s->total_ns / 1e6 / s->count,
+               s->max_ns / 1e6);
+    }
+}
+
+int yuv_trace_open(const char *fn)
+{
+    FILE *fp = fopen(fn, "w");
+
+    if (!fp) {
+        perror(fn);
+        return -1;
+    }
+
+    fprintf(fp, "[");
+
+    pthread_mutex_lock(&trace_lock);
+    trace_fp = fp;
+    trace_events = 0;
+    trace_base_ns = yuv_time_ns();
+    pthread_mutex_unlock(&trace_lock);
+
+    return 0;
+}
+
+void yuv_trace_close(void)
+{
+    pthread_mutex_lock(&trace_lock);
+    if (trace_fp) {
+        fprintf(trace_fp, "\n]\n");
+        if (fclose(trace_fp) != 0)
+            perror("Trace close fail");
+        printf("Wrote %d trace events\n", trace_events);
+    }
+    trace_fp = NULL;
+    pthread_mutex_unlock(&trace_lock);
+}
@@ -0,0 +1,41 @@
+#ifndef YUV_TRACE_H
+#define YUV_TRACE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Timings of one pipeline stage on the monotonic clock. A stage is only
+ * recorded from one thread; others may read it for display.
+ */
+struct yuv_stage {
+    const char *name;
+    int64_t last_ns;
+    int64_t max_ns;
+    int64_t total_ns;
+    uint64_t count;
+};
+
+int64_t yuv_time_ns(void);
+
+/*
+ * Records a run of stage from start_ns until now for frame, and writes it
+ * to the trace file if one is open. Returns now, the start of whatever
+ * comes next.
+ */
+int64_t yuv_stage_end(struct yuv_stage *stage, int frame, int64_t start_ns);
+
+/* One "name last/avg/max ms" line per stage, returns the length */
+int yuv_stage_format(char *buf, size_t len, const struct yuv_stage *stages,
+                     int count);
+void yuv_stage_print(const struct yuv_stage *stages, int count);
+
+/*
+ * Chrome trace event JSON (chrome://tracing, Perfetto). Every recorded
+ * stage becomes a complete event on its thread's track. Safe to record
+ * from several threads.
+ */
+int yuv_trace_open(const char *fn);
+void yuv_trace_close(void);
+
+#endif
@@ -0,0 +1,136 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "yuv_chunk.h"
+
+static void print_help()
+{
+    printf("Usage:\n");
+    printf("\tyuv_v2convert [-r fps] in_v1_file out_v2_file\n");
+    printf("\tv1 has no capture times, frames get timestamps at fps (default 10)\n");
+}
+
+int main(int argc, char *argv[])
+{
+    struct yuv_chunk chunk;
+    struct yuv_index index;
+    FILE *in, *out;
+    uint8_t *buf = NULL;
+    size_t buf_size = 0;
+    double fps = 10;
+    int capacity = 0;
+    int opt, rc = 1, bad = 0;
+
+    while ((opt = getopt(argc, argv, "r:h")) != -1) {
+        switch (opt) {
+        case 'r':
+            fps = atof(optarg);
+            break;
+        default:
+            print_help();
+            return 0;
+        }
+    }
+
+    if (argc - optind != 2 || fps <= 0) {
+        print_help();
+        return 0;
+    }
+
+    in = fopen(argv[optind], "r");
+    if (!in) {
+        perror("File open fail!");
+        return 1;
+    }
+
+    out = fopen(argv[optind + 1], "w");
+    if (!out) {
+        perror("File open fail!");
+        fclose(in);
+        return 1;
+    }
+
+    memset(&index, 0, sizeof(index));
+
+    while ((rc = yuv_chunk_read_header(in, &chunk)) == 0) {
+        rc = 1;
+        if (chunk.size > buf_size) {
+            free(buf);
+            buf = malloc(chunk.size);
+            if (buf == NULL) {
+                perror("Memory malloc fail");
+                goto out;
+            }
+            buf_size = chunk.size;
+        }
+
+        if (fread(buf, 1, chunk.size, in) != chunk.size) {
+            printf("Truncated chunk %d, stopping\n", index.count);
+            bad = 1;
+            break;
+        }
+
+        /* Already v2 input keeps its own timing */
+        if (chunk.version < 2) {
+            chunk.timestamp_us = (uint64_t) (index.count * 1000000.0 / fps);
+            chunk.frame = index.count;
+        }
+
+        if (index.count == capacity) {
+            int64_t *p;
+            uint64_t *t;
+
+            capacity = capacity ? capacity * 2 : 1024;
+            p = realloc(index.offsets, capacity * sizeof(int64_t));
+            if (p)
+                index.offsets = p;
+            t = realloc(index.timestamps, capacity * sizeof(uint64_t));
+            if (t)
+                index.timestamps = t;
+            if (p == NULL || t == NULL) {
+                perror("Memory realloc fail");
+                goto out;
+            }
+        }
+
+        index.offsets[index.count] = ftello(out);
+        index.timestamps[index.count] = chunk.timestamp_us;
+
+        if (yuv_chunk_write_v2(out, &chunk, buf) < 0) {
+            perror("File write fail");
+            goto out;
+        }
+        index.count++;
+    }
+
+    /* A bad header mid-stream, the frames before it are still kept */
+    if (rc < 0)
+        bad = 1;
+
+    rc = 1;
+    if (index.count == 0) {
+        printf("No chunks in %s\n", argv[optind]);
+        goto out;
+    }
+
+    if (yuv_chunk_write_index(out, &index) < 0) {
+        perror("File write fail");
+        goto out;
+    }
+
+    printf("%d frames written to %s\n", index.count, argv[optind + 1]);
+    if (bad)
+        printf("Input %s stopped at a bad chunk, not converted past it\n",
+               argv[optind]);
+    rc = bad;
+
+out:
+    if (fclose(out) != 0)
+        rc = 1;
+    fclose(in);
+    yuv_index_free(&index);
+    free(buf);
+    return rc;
+}